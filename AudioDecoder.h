@@ -23,4 +23,11 @@ public:
     virtual AudioInfo getInfo() const = 0;
     virtual size_t read(float* buffer, size_t frames) = 0;
     virtual bool seek(long long frame) = 0;
+
+    // 任意の位置へシークできるか（パイプやソケットからのストリーム入力では false）
+    virtual bool isSeekable() const { return true; }
+
+    // 待っている read() を中断して入力の終わりとして返させる（別のスレッドから呼べる）。
+    // ファイルからの読み込みは待たないため、既定では何もしない
+    virtual void interrupt() {}
 };
\ No newline at end of file
@@ -2,10 +2,81 @@
 #include "AudioDecoderFactory.h"
 #include "SndfileDecoder.h"
 #include "MPG123Decoder.h" // MPG123Decoder を利用
+#include "PcmStreamDecoder.h"
+#include "FdStream.h"
 #include <iostream>
+#include <cstring>
+
+namespace {
+
+// "raw:<形式>:<サンプルレート>:<チャンネル数>:<入力>" を読む
+bool parseRawSpec(const std::string& spec, PcmFormat& format, std::string& source) {
+    size_t pos = 4;
+    std::string fields[3];
+    for (std::string& field : fields) {
+        const size_t colon = spec.find(':', pos);
+        if (colon == std::string::npos) return false;
+        field = spec.substr(pos, colon - pos);
+        pos = colon + 1;
+    }
+    source = spec.substr(pos);
+    try {
+        format.sampleRate = std::stoi(fields[1]);
+        format.channels = std::stoi(fields[2]);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return PcmFormat::parseEncoding(fields[0], format.encoding) && !source.empty();
+}
+
+// ストリームの先頭を覗いて形式を判定し、対応するデコーダーで開く
+std::unique_ptr<AudioDecoder> createStreamDecoder(const std::string& source) {
+    std::unique_ptr<FdStream> stream = FdStream::open(source);
+    if (!stream) return nullptr;
+
+    uint8_t head[12] = {};
+    const size_t got = stream->peek(head, sizeof(head));
+    if (got >= 12 && (std::memcmp(head, "RIFF", 4) == 0 || std::memcmp(head, "RF64", 4) == 0) && std::memcmp(head + 8, "WAVE", 4) == 0) {
+        std::cout << "Info: WAV stream detected. Using PCM Stream Decoder." << std::endl;
+        auto decoder = std::make_unique<PcmStreamDecoder>();
+        if (decoder->openWav(std::move(stream))) return decoder;
+    } else if ((got >= 3 && std::memcmp(head, "ID3", 3) == 0) || (got >= 2 && head[0] == 0xFF && (head[1] & 0xE0) == 0xE0)) {
+        std::cout << "Info: MP3 stream detected. Using MPG123 Decoder (feed)." << std::endl;
+        auto decoder = std::make_unique<MPG123Decoder>();
+        if (decoder->openStream(std::move(stream))) return decoder;
+    } else {
+        std::cerr << "Factory Error: Could not detect the stream format of '" << source
+                  << "'. Declare raw PCM as raw:<s16le|s24le|s32le|f32le|f64le|u8>:<rate>:<channels>:" << source << std::endl;
+        return nullptr;
+    }
+    std::cerr << "Factory Error: Failed to open stream with the selected decoder." << std::endl;
+    return nullptr;
+}
+
+} // namespace
 
 std::unique_ptr<AudioDecoder> AudioDecoderFactory::createDecoder(const std::string& filePath) {
-    std::string extension = filePath.substr(filePath.find_last_of("."));
+    if (filePath.rfind("raw:", 0) == 0) {
+        PcmFormat format;
+        std::string source;
+        if (!parseRawSpec(filePath, format, source)) {
+            std::cerr << "Factory Error: Invalid raw PCM spec '" << filePath << "'. Expected raw:<format>:<rate>:<channels>:<source>" << std::endl;
+            return nullptr;
+        }
+        std::unique_ptr<FdStream> stream = FdStream::open(source);
+        auto decoder = std::make_unique<PcmStreamDecoder>();
+        if (stream && decoder->openRaw(std::move(stream), format)) {
+            std::cout << "Info: Raw PCM stream. Using PCM Stream Decoder." << std::endl;
+            return decoder;
+        }
+        return nullptr;
+    }
+    if (FdStream::isStreamSource(filePath)) {
+        return createStreamDecoder(filePath);
+    }
+
+    const size_t dot = filePath.find_last_of(".");
+    std::string extension = (dot == std::string::npos) ? std::string() : filePath.substr(dot);
     for (char& c : extension) {
         c = tolower(c);
     }
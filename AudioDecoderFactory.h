@@ -9,5 +9,7 @@
 class AudioDecoderFactory {
 public:
     // ファイルパスを受け取り、適切なデコーダーのインスタンスを生成して返す
+    // "-"・"fd:N"・"tcp:host:port"・パイプ/ソケットのパスは先頭を覗いて形式を判定するストリーム入力、
+    // "raw:<形式>:<レート>:<チャンネル数>:<入力>" は形式を指定した生のPCMとして開く
     static std::unique_ptr<AudioDecoder> createDecoder(const std::string& filePath);
 };
\ No newline at end of file
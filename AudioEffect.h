@@ -4,7 +4,15 @@
 
 #include <vector>
 #include <string>
+#include <cstddef>
+#include <cstdint>
 #include <nlohmann/json.hpp>
+#include "spectral_frame.h"
+#include "channel_layout.h"
+#include "state_archive.h"
+
+class AnalysisBus;
+struct BiquadCoefficients;
 
 // jsonエイリアス
 using json = nlohmann::json;
@@ -33,6 +41,155 @@ public:
      */
     virtual void reset() = 0;
 
+    /**
+     * @brief 処理するチャンネル数を設定する
+     *
+     * EffectChain はセットアップ時に setup() の後で1回呼ぶ。チャンネル数で特殊化したカーネル
+     * （channel_kernel.h）を持つエフェクトはここでモノラル・ステレオ・汎用版を選ぶため、
+     * process() の内側ループでチャンネル数を判定しない。呼ばれずに process() された場合は、
+     * 最初の process() で同じ選択を行う。
+     */
+    virtual void setChannelCount(int channels) { (void)channels; }
+
+    /**
+     * @brief チャンネルの役割（L/R/C/LFE/サラウンド）を設定する
+     *
+     * EffectChain はセットアップ時に setChannelCount() の代わりにこちらを呼ぶ。音色系の
+     * エフェクトはLFEを処理せず、ステレオ幅やM/S処理は左右の組ごとに行う。役割を使わない
+     * エフェクトは既定の実装でチャンネル数だけを受け取る。単独で実行される場合は、
+     * そのチャンネル数の既定のレイアウト（ChannelLayout::defaultFor）を使う。
+     */
+    virtual void setChannelLayout(const ChannelLayout& layout) { setChannelCount(layout.channels()); }
+
+    /**
+     * @brief 現在のパラメータで出力に影響するかどうか
+     *
+     * 無効化されている、またはパラメータが恒等変換（0dBのEQ、mix 0 など）になっている
+     * エフェクトは false を返す。EffectChain はこのようなエフェクトを実行計画から外し、
+     * process() を呼ばない。
+     */
+    virtual bool isActive() const { return true; }
+
+    /// getTailSamples() が「テールが終わらない（無音でも省略できない）」ことを表す値
+    static constexpr size_t kInfiniteTail = static_cast<size_t>(-1);
+
+    /**
+     * @brief 入力が無音になってから出力が無音になるまでのサンプル数（テール長）
+     *
+     * フィルタの残響（-144dBまで減衰する長さ）、ルックアヘッドやFFTの遅延を含める。
+     * EffectChain は無音の入力がこの長さ以上続いたエフェクトを reset() して実行を省略し、
+     * 出力を厳密な0にする。既定値 kInfiniteTail のエフェクトは省略されない。
+     */
+    virtual size_t getTailSamples() const { return kInfiniteTail; }
+
+    /**
+     * @brief 出力が入力に対して遅れるサンプル数（ルックアヘッド・FFTの遅延・分割畳み込みの先頭ブロックなど）
+     *
+     * EffectChain はステージごとの遅延を合計し、再生位置の報告とシーク先の補正に使う。
+     * 周波数領域のエフェクトは単独で実行したときの遅延を返す。チェーンのスペクトルセグメントでは
+     * 共有STFTの遅延1つ分として数える。
+     */
+    virtual size_t getLatencySamples() const { return 0; }
+
+    /**
+     * @brief ワーカースレッドの結果が期限に間に合わず、process() が待った回数（起動からの累計）
+     *
+     * 処理スレッドの外で計算するエフェクト（分割畳み込みのテール段など）が返す。
+     * reset() や設定の変更で待った回数は含めない。--live の latency コマンドで表示する。
+     */
+    virtual uint64_t getDeadlineMisses() const { return 0; }
+
+    /// テール長の和（kInfiniteTail で飽和する）
+    static size_t addTails(size_t a, size_t b) { return (a > kInfiniteTail - b) ? kInfiniteTail : a + b; }
+
+    /**
+     * @brief エフェクト全体が線形なバイクアッドの縦続接続で表せる場合に、その係数を返す
+     * @param sections 各段の係数（全チャンネル共通）を追加する
+     * @return 縦続接続で表せる場合は true
+     *
+     * true を返すエフェクトがチェーン内で連続している場合、EffectChain はそれらを
+     * 1つのフィルタバンクにまとめて実行する。
+     */
+    virtual bool getBiquadCascade(std::vector<BiquadCoefficients>& sections) const { (void)sections; return false; }
+
+    /**
+     * @brief チェーンの融合ループに組み込めるかどうか
+     *
+     * 出力が各サンプル（フレーム）までの入力と内部状態だけで決まり、ブロック長や
+     * ルックアヘッドに依存しないエフェクトは true を返す。このようなエフェクトは
+     * ブロックを任意の位置で分割して処理しても結果が変わらないため、EffectChain が
+     * 隣接するエフェクトをまとめて小さなタイル単位で実行できる。
+     */
+    virtual bool isFusable() const { return false; }
+
+    /**
+     * @brief 周波数領域で処理する場合のSTFT設定（既定は時間領域のエフェクト）
+     *
+     * 有効な設定を返すエフェクトは processSpectrum() も実装する。EffectChain は同じ設定を
+     * 返す連続したエフェクトを1つのスペクトルセグメントにまとめ、共有のSTFTフレームに対して
+     * 順に processSpectrum() を呼ぶため、FFT/IFFTの組はセグメントあたり1つで済む。
+     */
+    virtual StftConfig getStftConfig() const { return {}; }
+
+    /**
+     * @brief 時間順に並んだSTFTフレーム列をインプレースで処理する
+     * @param frames フレームの配列（全チャンネル分のスペクトルを持つ）
+     * @param count フレーム数
+     */
+    virtual void processSpectrum(SpectralFrame* frames, size_t count) { (void)frames; (void)count; }
+
+    /**
+     * @brief チェーンの解析バスに必要な特徴量（エンベロープ・ピーク・RMS・M/Sレベル）を登録する
+     *
+     * 登録した特徴量は EffectChain がブロックごとに1回だけ計算し、同じ特徴量を要求した
+     * エフェクト間で共有する。エフェクトはバスへのポインタを保持し、process() の中で
+     * 読み取り専用で参照する。単独で実行される場合は呼ばれないため、その場合は
+     * 自前の検波器で同じ特徴量を計算する。
+     */
+    virtual void declareAnalysis(AnalysisBus& bus) { (void)bus; }
+
+    /**
+     * @brief 再生中にパラメータを1つ変更する（オートメーション用）
+     * @param name パラメータ名（params.json のキー。EQの帯域は "bands.<番号>.gain_db" など）
+     * @param value 新しい値
+     * @param ramp_samples この長さをかけて新しい値へサンプルごとに移る（0 なら直ちに）。
+     *                     係数の再計算が必要なパラメータは、補間した値で短いサブブロックごとに
+     *                     係数を設計し直してランプさせる（ParametricEQ）。STFTのフレーム単位で
+     *                     処理するパラメータは次のフレームから反映する
+     * @return 対応するパラメータであれば true
+     *
+     * EffectChain は値が変わったときだけ、process() の前に呼ぶ。状態はリセットしない。
+     */
+    virtual bool setParameter(const std::string& name, double value, size_t ramp_samples) {
+        (void)name; (void)value; (void)ramp_samples;
+        return false;
+    }
+
+    /**
+     * @brief 処理状態（フィルタ・エンベロープ・遅延線・STFTなど）を保存または復元する
+     * @param ar ar.saving() なら書き出し、そうでなければ読み込む
+     * @return 対応していれば true。非対応のエフェクトは復元の代わりに reset() される
+     *
+     * シーク時に、再生中に取ったスナップショットから状態を戻すために使う。パラメータ（係数）は
+     * 含めないため、同じパラメータで setup() とチャンネルの設定を行ったエフェクトの間でのみ有効。
+     */
+    virtual bool serializeState(StateArchive& ar) { (void)ar; return false; }
+
+    /// serializeState() の結果を1つの要素として ar に保存・復元する。非対応、または状態が
+    /// 合わず復元できなかったエフェクトは reset() する
+    static void transferState(AudioEffect& effect, StateArchive& ar) {
+        std::vector<uint8_t> state;
+        if (ar.saving()) {
+            StateArchive inner = StateArchive::writer(state);
+            if (!effect.serializeState(inner)) state.clear();
+            ar.buffer(state);
+            return;
+        }
+        ar.buffer(state);
+        StateArchive inner = StateArchive::reader(state.data(), state.size());
+        if (state.empty() || !effect.serializeState(inner) || !inner.ok()) effect.reset();
+    }
+
     /**
      * @brief エフェクトの名前を取得する
      * @return エフェクト名
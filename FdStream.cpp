@@ -0,0 +1,187 @@
+// ./FdStream.cpp
+#include "FdStream.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace {
+
+// "tcp:<ホスト>:<ポート>" に接続する
+int connectTcp(const std::string& address) {
+    const size_t colon = address.find_last_of(':');
+    if (colon == std::string::npos) return -1;
+    const std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0) return -1;
+    int fd = -1;
+    for (addrinfo* ai = results; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(results);
+    return fd;
+}
+
+int connectUnix(const std::string& path) {
+    sockaddr_un addr = {};
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+bool FdStream::isStreamSource(const std::string& source) {
+    if (source == "-" || source.rfind("fd:", 0) == 0 || source.rfind("tcp:", 0) == 0) return true;
+    struct stat st;
+    return stat(source.c_str(), &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode));
+}
+
+std::unique_ptr<FdStream> FdStream::open(const std::string& source, size_t capacity) {
+    int fd = -1;
+    bool owns = true;
+    if (source == "-") {
+        fd = STDIN_FILENO;
+        owns = false;
+    } else if (source.rfind("fd:", 0) == 0) {
+        char* end = nullptr;
+        const long number = std::strtol(source.c_str() + 3, &end, 10);
+        if (end != source.c_str() + 3 && *end == '\0' && number >= 0) fd = static_cast<int>(number);
+    } else if (source.rfind("tcp:", 0) == 0) {
+        fd = connectTcp(source.substr(4));
+    } else {
+        struct stat st;
+        if (stat(source.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            fd = connectUnix(source);
+        } else {
+            fd = ::open(source.c_str(), O_RDONLY);
+        }
+    }
+    if (fd < 0) {
+        std::cerr << "FdStream Error: Could not open stream '" << source << "'. " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    return std::make_unique<FdStream>(fd, owns, capacity);
+}
+
+FdStream::FdStream(int fd, bool owns_fd, size_t capacity)
+    : fd_(fd), owns_fd_(owns_fd), buffer_(std::max<size_t>(capacity, 16)) {
+    if (pipe(wake_) != 0) {
+        std::cerr << "FdStream Warning: Could not create the wake-up pipe (" << std::strerror(errno) << "). Reads cannot be interrupted." << std::endl;
+        wake_[0] = wake_[1] = -1;
+    }
+}
+
+FdStream::~FdStream() {
+    if (owns_fd_ && fd_ >= 0) close(fd_);
+    for (int fd : wake_) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+void FdStream::interrupt() {
+    if (wake_[1] < 0) return;
+    const uint8_t byte = 1;
+    while (::write(wake_[1], &byte, 1) < 0 && errno == EINTR) {}
+}
+
+bool FdStream::fill() {
+    if (eof_) return false;
+    if (begin_ == end_) begin_ = end_ = 0;
+    if (end_ == buffer_.size()) {
+        // 未消費のデータを先頭に寄せて空きを作る
+        std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+        if (end_ == buffer_.size()) return false;
+    }
+    for (;;) {
+        if (wake_[0] >= 0) {
+            // データか中断のどちらかが届くまで待つ（中断されたらEOFとして扱う）
+            pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "FdStream Error: poll failed. " << std::strerror(errno) << std::endl;
+                eof_ = true;
+                return false;
+            }
+            if (fds[1].revents != 0) {
+                eof_ = true;
+                return false;
+            }
+        }
+        const ssize_t n = ::read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+        if (n > 0) {
+            end_ += static_cast<size_t>(n);
+            return true;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) std::cerr << "FdStream Error: read failed. " << std::strerror(errno) << std::endl;
+        eof_ = true;
+        return false;
+    }
+}
+
+size_t FdStream::peek(uint8_t* data, size_t size) {
+    size = std::min(size, buffer_.size());
+    while (end_ - begin_ < size && fill()) {}
+    const size_t available = std::min(size, end_ - begin_);
+    std::memcpy(data, buffer_.data() + begin_, available);
+    return available;
+}
+
+size_t FdStream::read(void* data, size_t size) {
+    auto* out = static_cast<uint8_t*>(data);
+    size_t done = 0;
+    while (done < size) {
+        if (begin_ == end_ && !fill()) break;
+        const size_t n = std::min(size - done, end_ - begin_);
+        std::memcpy(out + done, buffer_.data() + begin_, n);
+        begin_ += n;
+        done += n;
+    }
+    position_ += done;
+    return done;
+}
+
+size_t FdStream::readSome(void* data, size_t size) {
+    if (begin_ == end_ && !fill()) return 0;
+    const size_t n = std::min(size, end_ - begin_);
+    std::memcpy(data, buffer_.data() + begin_, n);
+    begin_ += n;
+    position_ += n;
+    return n;
+}
+
+bool FdStream::skip(uint64_t size) {
+    while (size > 0) {
+        if (begin_ == end_ && !fill()) return false;
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(size, end_ - begin_));
+        begin_ += n;
+        position_ += n;
+        size -= n;
+    }
+    return true;
+}
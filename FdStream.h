@@ -0,0 +1,70 @@
+// ./FdStream.h
+// ファイルディスクリプタ（標準入力・パイプ・ソケット）からの読み込み（シーク不可のストリーム入力）
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class FdStream
+ * @brief 固定長のバッファを持つファイルディスクリプタの読み込み
+ *
+ * バッファの長さは構築時に決まり、ストリーム全体を溜め込むことはない。形式の判定のために
+ * 先頭を消費せずに覗ける peek() を持つ（覗ける長さはバッファの長さまで）。
+ * 読み込みはブロッキングで、EINTR は再試行する。待っている読み込みは別のスレッドから
+ * interrupt() で中断でき（poll(2) で自己パイプも待つ）、以降はEOFとして扱う。
+ */
+class FdStream {
+public:
+    static constexpr size_t kDefaultCapacity = 64 * 1024;
+
+    /**
+     * @brief 入力の指定からストリームを開く
+     * @param source "-"（標準入力）、"fd:<番号>"（親プロセスから受け継いだディスクリプタ）、
+     *               "tcp:<ホスト>:<ポート>"（接続する）、または名前付きパイプ / UNIXドメインソケットのパス
+     * @return 開けなければ nullptr（理由は標準エラーに出力する）
+     */
+    static std::unique_ptr<FdStream> open(const std::string& source, size_t capacity = kDefaultCapacity);
+
+    // source がストリーム入力の指定（またはパイプ・ソケットのパス）かどうか
+    static bool isStreamSource(const std::string& source);
+
+    FdStream(int fd, bool owns_fd, size_t capacity = kDefaultCapacity);
+    ~FdStream();
+    FdStream(const FdStream&) = delete;
+    FdStream& operator=(const FdStream&) = delete;
+
+    // 先頭の最大 size バイトを消費せずに返す（EOFまでに足りなければ短い）
+    size_t peek(uint8_t* data, size_t size);
+
+    // size バイトそろうか EOF になるまで読む
+    size_t read(void* data, size_t size);
+
+    // バッファにあるデータ、なければ1回の read(2) で届いた分だけを返す（フィード型デコーダ用）
+    size_t readSome(void* data, size_t size);
+
+    // size バイト読み捨てる。EOFまでに足りなければ false
+    bool skip(uint64_t size);
+
+    // 読み出した総バイト数
+    uint64_t position() const { return position_; }
+
+    // 待っている読み込み（と以降の読み込み）をEOFとして終わらせる。別のスレッドから呼べる
+    void interrupt();
+
+private:
+    int fd_ = -1;
+    bool owns_fd_ = false;
+    int wake_[2] = {-1, -1};    // interrupt() で書き込む自己パイプ（作れなければ中断できない）
+    bool eof_ = false;
+    std::vector<uint8_t> buffer_;
+    size_t begin_ = 0;      // 未消費のデータは [begin_, end_)
+    size_t end_ = 0;
+    uint64_t position_ = 0;
+
+    // バッファの空きに1回だけ read(2) する。EOFまたはエラーなら false
+    bool fill();
+};
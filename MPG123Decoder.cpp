@@ -69,6 +69,40 @@ bool MPG123Decoder::open(const std::string& filePath) {
     return true;
 }
 
+// openStream: フィードAPIで開き、フォーマットが分かるまでストリームを読み進める
+bool MPG123Decoder::openStream(std::unique_ptr<FdStream> stream) {
+    if (!stream || mpg123_open_feed(mh_) != MPG123_OK) {
+        std::cerr << "MPG123Decoder Error: Failed to open feed. " << mpg123_strerror(mh_) << std::endl;
+        return false;
+    }
+    stream_ = std::move(stream);
+    feed_buffer_.resize(16 * 1024);
+
+    long rate = 0;
+    int channels = 0;
+    int encoding = 0;
+    int err;
+    while ((err = mpg123_getformat(mh_, &rate, &channels, &encoding)) == MPG123_NEED_MORE) {
+        if (!feed()) break;
+    }
+    if (err != MPG123_OK) {
+        std::cerr << "MPG123Decoder Error: Stream ended before an MPEG frame header was found." << std::endl;
+        return false;
+    }
+
+    // 長さは分からない（EOFまで読む）
+    info_.sampleRate = rate;
+    info_.channels = channels;
+    info_.totalFrames = 0;
+    return true;
+}
+
+bool MPG123Decoder::feed() {
+    const size_t n = stream_->readSome(feed_buffer_.data(), feed_buffer_.size());
+    if (n == 0) return false;
+    return mpg123_feed(mh_, feed_buffer_.data(), n) == MPG123_OK;
+}
+
 // getInfo: 格納されているオーディオ情報を返す
 AudioInfo MPG123Decoder::getInfo() const {
     return info_;
@@ -82,6 +116,25 @@ size_t MPG123Decoder::read(float* buffer, size_t frames) {
 
     size_t bytes_to_read = frames * info_.channels * sizeof(float);
     size_t bytes_done = 0;
+
+    if (stream_) {
+        // フィード入力: 要求を満たすかストリームが終わるまで、足りなくなるたびに読み足す
+        unsigned char* out = reinterpret_cast<unsigned char*>(buffer);
+        while (bytes_done < bytes_to_read) {
+            size_t n = 0;
+            int err = mpg123_read(mh_, out + bytes_done, bytes_to_read - bytes_done, &n);
+            bytes_done += n;
+            if (err == MPG123_NEED_MORE) {
+                if (!feed()) break;
+            } else if (err != MPG123_OK && err != MPG123_NEW_FORMAT) {
+                break;
+            }
+        }
+        size_t frames_done = bytes_done / (info_.channels * sizeof(float));
+        stream_frames_ += static_cast<long long>(frames_done);
+        return frames_done;
+    }
+
     int err = mpg123_read(mh_, reinterpret_cast<unsigned char*>(buffer), bytes_to_read, &bytes_done);
 
     if (err != MPG123_OK && err != MPG123_DONE) {
@@ -107,6 +160,9 @@ bool MPG123Decoder::seek(long long frame) {
     if (!mh_) {
         return false;
     }
+    if (stream_) {
+        return frame == stream_frames_;
+    }
     // mpg123_seekは成功すると移動先のフレーム位置を、失敗すると負の値を返す
     return mpg123_seek(mh_, frame, SEEK_SET) >= 0;
 }
\ No newline at end of file
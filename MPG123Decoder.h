@@ -1,7 +1,9 @@
 // ./MPG123Decoder.h - Final Corrected and Verified Version
 #pragma once
 #include "AudioDecoder.h"
+#include "FdStream.h"
 #include <mpg123.h>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -14,8 +16,19 @@ public:
     AudioInfo getInfo() const override;
     size_t read(float* buffer, size_t frames) override;
     bool seek(long long frame) override;
+    bool isSeekable() const override { return !stream_; }
+    void interrupt() override { if (stream_) stream_->interrupt(); }
+
+    // パイプやソケットから mpg123 のフィードAPIでデコードする（シーク不可。現在位置へのシークだけが成功する）
+    bool openStream(std::unique_ptr<FdStream> stream);
 
 private:
     mpg123_handle *mh_;
     AudioInfo info_;
+    std::unique_ptr<FdStream> stream_;          // ストリーム入力のときだけ持つ
+    std::vector<unsigned char> feed_buffer_;
+    long long stream_frames_ = 0;               // ストリーム入力で読み出したフレーム数
+
+    // ストリームから届いた分を mpg123 に渡す。EOFなら false
+    bool feed();
 };
\ No newline at end of file
@@ -0,0 +1,176 @@
+// ./PcmStreamDecoder.cpp
+#include "PcmStreamDecoder.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+uint16_t readLe16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+uint32_t readLe32(const uint8_t* p) { return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+uint64_t readLe64(const uint8_t* p) { return static_cast<uint64_t>(readLe32(p)) | (static_cast<uint64_t>(readLe32(p + 4)) << 32); }
+
+constexpr uint16_t kWaveFormatPcm = 1;
+constexpr uint16_t kWaveFormatFloat = 3;
+constexpr uint16_t kWaveFormatExtensible = 0xFFFE;
+
+} // namespace
+
+size_t PcmFormat::bytesPerSample() const {
+    switch (encoding) {
+        case Encoding::U8: return 1;
+        case Encoding::S16: return 2;
+        case Encoding::S24: return 3;
+        case Encoding::S32: return 4;
+        case Encoding::F32: return 4;
+        case Encoding::F64: return 8;
+    }
+    return 0;
+}
+
+bool PcmFormat::parseEncoding(const std::string& name, Encoding& encoding) {
+    if (name == "u8") encoding = Encoding::U8;
+    else if (name == "s16le") encoding = Encoding::S16;
+    else if (name == "s24le") encoding = Encoding::S24;
+    else if (name == "s32le") encoding = Encoding::S32;
+    else if (name == "f32le") encoding = Encoding::F32;
+    else if (name == "f64le") encoding = Encoding::F64;
+    else return false;
+    return true;
+}
+
+bool PcmStreamDecoder::openRaw(std::unique_ptr<FdStream> stream, const PcmFormat& format) {
+    if (!stream || format.channels <= 0 || format.sampleRate <= 0) {
+        std::cerr << "PcmStreamDecoder Error: Raw PCM needs a positive sample rate and channel count." << std::endl;
+        return false;
+    }
+    stream_ = std::move(stream);
+    format_ = format;
+    info_.channels = format.channels;
+    info_.sampleRate = format.sampleRate;
+    info_.totalFrames = 0;
+    bytes_.resize(kChunkFrames * format_.bytesPerSample() * static_cast<size_t>(format_.channels));
+    return true;
+}
+
+bool PcmStreamDecoder::openWav(std::unique_ptr<FdStream> stream) {
+    if (!stream) return false;
+    uint8_t header[12];
+    if (stream->read(header, sizeof(header)) != sizeof(header) ||
+        (std::memcmp(header, "RIFF", 4) != 0 && std::memcmp(header, "RF64", 4) != 0) || std::memcmp(header + 8, "WAVE", 4) != 0) {
+        std::cerr << "PcmStreamDecoder Error: Stream does not start with a RIFF/RF64 WAVE header." << std::endl;
+        return false;
+    }
+
+    // fmt チャンクと data チャンクまで読み進める（他のチャンクは読み捨てる）
+    PcmFormat format;
+    bool has_format = false;
+    uint64_t ds64_data_size = UINT64_MAX;
+    for (;;) {
+        uint8_t chunk[8];
+        if (stream->read(chunk, sizeof(chunk)) != sizeof(chunk)) {
+            std::cerr << "PcmStreamDecoder Error: WAV stream ended before the data chunk." << std::endl;
+            return false;
+        }
+        const uint32_t size = readLe32(chunk + 4);
+        if (std::memcmp(chunk, "data", 4) == 0) {
+            if (!has_format) {
+                std::cerr << "PcmStreamDecoder Error: WAV data chunk precedes the fmt chunk." << std::endl;
+                return false;
+            }
+            // 0 / 0xFFFFFFFF はパイプ出力の長さ不明、RF64 では ds64 の長さを使う
+            if (size == 0xFFFFFFFFu) remaining_bytes_ = ds64_data_size;
+            else if (size != 0) remaining_bytes_ = size;
+            break;
+        }
+        const uint64_t padded = size + (size & 1u);
+        if (std::memcmp(chunk, "fmt ", 4) == 0 || std::memcmp(chunk, "ds64", 4) == 0) {
+            if (size < 16 || size > 1024) {
+                std::cerr << "PcmStreamDecoder Error: Malformed WAV header chunk." << std::endl;
+                return false;
+            }
+            std::vector<uint8_t> body(static_cast<size_t>(padded));
+            if (stream->read(body.data(), body.size()) != body.size()) return false;
+            if (chunk[0] == 'd') {
+                if (size >= 16) ds64_data_size = readLe64(body.data() + 8);
+                continue;
+            }
+            uint16_t tag = readLe16(body.data());
+            const uint16_t bits = readLe16(body.data() + 14);
+            if (tag == kWaveFormatExtensible && size >= 26) tag = readLe16(body.data() + 24);
+            format.channels = readLe16(body.data() + 2);
+            format.sampleRate = static_cast<int>(readLe32(body.data() + 4));
+            if (tag == kWaveFormatPcm && bits == 8) format.encoding = PcmFormat::Encoding::U8;
+            else if (tag == kWaveFormatPcm && bits == 16) format.encoding = PcmFormat::Encoding::S16;
+            else if (tag == kWaveFormatPcm && bits == 24) format.encoding = PcmFormat::Encoding::S24;
+            else if (tag == kWaveFormatPcm && bits == 32) format.encoding = PcmFormat::Encoding::S32;
+            else if (tag == kWaveFormatFloat && bits == 32) format.encoding = PcmFormat::Encoding::F32;
+            else if (tag == kWaveFormatFloat && bits == 64) format.encoding = PcmFormat::Encoding::F64;
+            else {
+                std::cerr << "PcmStreamDecoder Error: Unsupported WAV sample format (tag " << tag << ", " << bits << " bits)." << std::endl;
+                return false;
+            }
+            has_format = true;
+        } else if (!stream->skip(padded)) {
+            std::cerr << "PcmStreamDecoder Error: WAV stream ended before the data chunk." << std::endl;
+            return false;
+        }
+    }
+
+    if (!openRaw(std::move(stream), format)) return false;
+    const uint64_t frame_bytes = format_.bytesPerSample() * static_cast<uint64_t>(format_.channels);
+    if (remaining_bytes_ != UINT64_MAX) info_.totalFrames = static_cast<long long>(remaining_bytes_ / frame_bytes);
+    return true;
+}
+
+size_t PcmStreamDecoder::read(float* buffer, size_t frames) {
+    if (!stream_ || !buffer) return 0;
+    const size_t sample_bytes = format_.bytesPerSample();
+    const size_t channels = static_cast<size_t>(format_.channels);
+    const size_t frame_bytes = sample_bytes * channels;
+    size_t done = 0;
+    while (done < frames) {
+        size_t count = std::min(frames - done, kChunkFrames);
+        if (remaining_bytes_ != UINT64_MAX) count = static_cast<size_t>(std::min<uint64_t>(count, remaining_bytes_ / frame_bytes));
+        if (count == 0) break;
+        // 端数のフレーム（ストリームの途中で切れたもの）は捨てる
+        const size_t got = stream_->read(bytes_.data(), count * frame_bytes) / frame_bytes;
+        if (remaining_bytes_ != UINT64_MAX) remaining_bytes_ -= got * frame_bytes;
+
+        const uint8_t* in = bytes_.data();
+        float* out = buffer + done * channels;
+        const size_t samples = got * channels;
+        switch (format_.encoding) {
+            case PcmFormat::Encoding::U8:
+                for (size_t i = 0; i < samples; ++i) out[i] = (static_cast<float>(in[i]) - 128.0f) * (1.0f / 128.0f);
+                break;
+            case PcmFormat::Encoding::S16:
+                for (size_t i = 0; i < samples; ++i) out[i] = static_cast<float>(static_cast<int16_t>(readLe16(in + 2 * i))) * (1.0f / 32768.0f);
+                break;
+            case PcmFormat::Encoding::S24:
+                for (size_t i = 0; i < samples; ++i) {
+                    const uint8_t* p = in + 3 * i;
+                    const int32_t value = static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+                    out[i] = static_cast<float>(value) * (1.0f / 8388608.0f);
+                }
+                break;
+            case PcmFormat::Encoding::S32:
+                for (size_t i = 0; i < samples; ++i) out[i] = static_cast<float>(static_cast<int32_t>(readLe32(in + 4 * i))) * (1.0f / 2147483648.0f);
+                break;
+            case PcmFormat::Encoding::F32:
+                std::memcpy(out, in, samples * sizeof(float));
+                break;
+            case PcmFormat::Encoding::F64:
+                for (size_t i = 0; i < samples; ++i) {
+                    double value;
+                    std::memcpy(&value, in + 8 * i, sizeof(value));
+                    out[i] = static_cast<float>(value);
+                }
+                break;
+        }
+        done += got;
+        if (got < count) break;
+    }
+    frames_read_ += static_cast<long long>(done);
+    return done;
+}
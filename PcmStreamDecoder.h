@@ -0,0 +1,55 @@
+// ./PcmStreamDecoder.h
+// パイプやソケットから届くPCM（形式を指定した生のPCM、またはWAV / RF64）のデコーダー
+#pragma once
+
+#include "AudioDecoder.h"
+#include "FdStream.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// 生のPCMのサンプル形式（リトルエンディアン）
+struct PcmFormat {
+    enum class Encoding { U8, S16, S24, S32, F32, F64 };
+    Encoding encoding = Encoding::S16;
+    int channels = 0;
+    int sampleRate = 0;
+
+    size_t bytesPerSample() const;
+    // "s16le" / "s24le" / "s32le" / "f32le" / "f64le" / "u8" を読む。知らない名前なら false
+    static bool parseEncoding(const std::string& name, Encoding& encoding);
+};
+
+/**
+ * @class PcmStreamDecoder
+ * @brief シークできないストリームからPCMを読み、floatに変換する
+ *
+ * openRaw() は形式を指定した生のPCM、openWav() はストリームの先頭のRIFF/RF64ヘッダを読んでから
+ * dataチャンクを読む。パイプに書き出すエンコーダはヘッダの長さを 0 や 0xFFFFFFFF にするため、
+ * その場合は長さ不明（totalFrames = 0）としてEOFまで読む。
+ */
+class PcmStreamDecoder : public AudioDecoder {
+public:
+    bool openRaw(std::unique_ptr<FdStream> stream, const PcmFormat& format);
+    bool openWav(std::unique_ptr<FdStream> stream);
+
+    // パスから開くことはしない（AudioDecoderFactory がストリームを開いて openRaw / openWav を呼ぶ）
+    bool open(const std::string& filePath) override { (void)filePath; return false; }
+    AudioInfo getInfo() const override { return info_; }
+    size_t read(float* buffer, size_t frames) override;
+    // 現在位置へのシークだけが成功する
+    bool seek(long long frame) override { return frame == frames_read_; }
+    bool isSeekable() const override { return false; }
+    void interrupt() override { if (stream_) stream_->interrupt(); }
+
+private:
+    std::unique_ptr<FdStream> stream_;
+    PcmFormat format_;
+    AudioInfo info_;
+    uint64_t remaining_bytes_ = UINT64_MAX;     // dataチャンクの残り（長さ不明なら UINT64_MAX）
+    long long frames_read_ = 0;
+    std::vector<uint8_t> bytes_;                // 変換前のサンプル（上限 kChunkFrames フレーム分）
+
+    static constexpr size_t kChunkFrames = 4096;
+};
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <stdexcept>
 #include <nlohmann/json.hpp>
+#include "state_archive.h"
 
 // jsonエイリアスを追加
 using json = nlohmann::json;
@@ -16,11 +17,43 @@ inline double db_to_linear(double db) {
     return std::pow(10.0, db / 20.0);
 }
 
+// バイクアッドの係数（a0で正規化済み）
+struct BiquadCoefficients {
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+};
+
 // --- Simple Biquad Filter ---
 class SimpleBiquad {
 public:
-    SimpleBiquad(std::string name = "Unnamed") : filter_name_(name) { reset(); }
-    void reset() { a1 = 0.0; a2 = 0.0; b0 = 1.0; b1 = 0.0; b2 = 0.0; z1 = 0.0; z2 = 0.0; is_bypassed_ = false; }
+    SimpleBiquad(std::string name = "Unnamed") : filter_name_(name) {}
+    // フィルタの状態（遅延素子）だけを初期化する。係数は保持する
+    void reset() { z1 = 0.0; z2 = 0.0; }
+    void serializeState(StateArchive& ar) { ar(z1, z2); }
+
+    BiquadCoefficients coefficients() const { return {b0, b1, b2, a1, a2}; }
+
+    // インパルス応答が decay_db だけ減衰するまでのサンプル数（極の最大半径から求める）
+    size_t ring_down_samples(double decay_db = 144.0) const {
+        double radius;
+        const double discriminant = a1 * a1 - 4.0 * a2;
+        if (discriminant < 0.0) {
+            radius = std::sqrt(std::max(a2, 0.0));   // 複素共役極: |p|² = a2
+        } else {
+            const double root = std::sqrt(discriminant);
+            radius = std::max(std::fabs(-a1 + root), std::fabs(-a1 - root)) * 0.5;
+        }
+        if (radius <= 0.0) return 2;                 // FIRのみ（遅延素子2つ分）
+        if (radius >= 1.0) return static_cast<size_t>(-1);
+        return static_cast<size_t>(std::ceil(-decay_db / 20.0 * std::log(10.0) / std::log(radius))) + 2;
+    }
+    void set_coefficients(const BiquadCoefficients& c) {
+        reset();
+        b0 = c.b0; b1 = c.b1; b2 = c.b2; a1 = c.a1; a2 = c.a2;
+    }
+    // 状態を保ったまま係数だけを差し替える（オートメーションによる係数の更新用。set_* は状態もリセットする）
+    void update_coefficients(const BiquadCoefficients& c) {
+        b0 = c.b0; b1 = c.b1; b2 = c.b2; a1 = c.a1; a2 = c.a2;
+    }
     
     void set_lpf(double sr, double freq, double q) {
         reset();
@@ -77,6 +110,15 @@ public:
         a2 = ((A + 1.0) - (A - 1.0) * cos_w0 - two_sqrt_A_alpha) / a0;
     }
     // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↑修正終わり◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
+    // 2次オールパス（Q=0.707ではLR4クロスオーバーのLPF+HPF合成と同じ位相特性になる）
+    void set_allpass(double sr, double freq, double q) {
+        reset();
+        q = std::max(0.1, q); freq = std::max(10.0, std::min(freq, sr / 2.2));
+        double w0 = 2.0 * M_PI * freq / sr, cos_w0 = std::cos(w0), sin_w0 = std::sin(w0);
+        double alpha = sin_w0 / (2.0 * q), a0 = 1.0 + alpha;
+        b0 = (1.0 - alpha) / a0; b1 = -2.0 * cos_w0 / a0; b2 = (1.0 + alpha) / a0;
+        a1 = b1; a2 = b0;
+    }
     
     float process(float in) {
         if (is_bypassed_ || std::isnan(in) || std::isinf(in)) return in;
@@ -88,5 +130,5 @@ public:
     }
 private:
     std::string filter_name_; bool is_bypassed_ = false;
-    double a1, a2, b0, b1, b2, z1, z2;
+    double a1 = 0.0, a2 = 0.0, b0 = 1.0, b1 = 0.0, b2 = 0.0, z1 = 0.0, z2 = 0.0;
 };
\ No newline at end of file
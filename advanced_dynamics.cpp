@@ -1,9 +1,11 @@
 // ./advanced_dynamics.cpp
 #include "advanced_dynamics.h"
+#include "fast_math.h"
 #include <cmath>
 #include <nlohmann/json.hpp>
 #include <vector>
 #include <iostream> // For logging
+#include <algorithm>
 
 // --- AnalogSaturationクラスのメソッド実装 ---
 
@@ -17,69 +19,92 @@ void AnalogSaturation::setup(double sr, const json& params) {
         mix_ = params.value("mix", 0.3);
         type_ = params.value("type", "tube");
     }
-    dc_blocker_.set_hpf(sr, 15.0, 0.707);
-    anti_alias_.set_lpf(sr, sr / 2.1, 0.707);
-}
 
-void AnalogSaturation::reset() {
-    dc_blocker_.reset();
-    anti_alias_.reset();
+    // カーブはここで1回だけ選択する（drive <= 0 はシェイピングなし）
+    shaper_.reset();
+    if (drive_ > 0.0) {
+        shaper_ = waveshaper::createShaper(type_, drive_);
+        if (!shaper_) {
+            std::string names;
+            for (const auto& curve : waveshaper::availableCurves()) names += (names.empty() ? "" : ", ") + curve;
+            std::cerr << "[WARN] AnalogSaturation: Unknown type '" << type_ << "' (available: " << names
+                      << "). Saturation is bypassed." << std::endl;
+        }
+    }
+
+    channels_ = 0;
+    channel_states_.clear();
+
+    // テール: DCブロッカーとアンチエイリアスの残響 + ADAAの1サンプル遅延
+    ChannelState probe;
+    probe.dc_blocker.set_hpf(sample_rate_, 15.0, 0.707);
+    probe.anti_alias.set_lpf(sample_rate_, sample_rate_ / 2.1, 0.707);
+    tail_samples_ = addTails(addTails(probe.dc_blocker.ring_down_samples(), probe.anti_alias.ring_down_samples()), 1);
 }
 
-float AnalogSaturation::tubeSaturation(float x) {
-    if (drive_ == 0.0) return x;
-    float k = 2.0f * drive_;
-    float abs_x = std::abs(x);
-    return (x > 0 ? 1.0f : -1.0f) * (abs_x - (abs_x * abs_x / (1.0f + k * abs_x)));
+void AnalogSaturation::prepareChannels(int channels) {
+    channels_ = channels;
+    kernel_.select(channels, &AnalogSaturation::processKernel<1>, &AnalogSaturation::processKernel<2>,
+                   &AnalogSaturation::processKernel<0>);
+    channel_states_.assign(channels, ChannelState{});
+    for (auto& state : channel_states_) {
+        state.dc_blocker.set_hpf(sample_rate_, 15.0, 0.707);
+        state.anti_alias.set_lpf(sample_rate_, sample_rate_ / 2.1, 0.707);
+    }
 }
 
-float AnalogSaturation::tapeSaturation(float x) {
-    if (drive_ == 0.0) return x;
-    return std::tanh(drive_ * x);
+void AnalogSaturation::reset() {
+    // フィルタとADAAの状態をまとめて初期化する
+    if (channels_ > 0) prepareChannels(channels_);
 }
 
-float AnalogSaturation::transformerSaturation(float x) {
-    if (drive_ == 0.0) return x;
-    const float a = 0.8f;
-    const float b = 1.5f;
-    float x_driven = drive_ * x;
-    return std::tanh(x_driven) + a * std::tanh(b * x_driven);
+void AnalogSaturation::process(std::vector<float>& block, int channels) {
+    if (!enabled_ || channels <= 0) return;
+    if (channels != channels_) prepareChannels(channels);
+    kernel_.run(*this, block);
 }
 
-float AnalogSaturation::processSample(float input) {
-    float dry_signal = input;
-    input = dc_blocker_.process(input);
-
-    float wet_signal;
-    if (type_ == "tube") {
-        wet_signal = tubeSaturation(input);
-    } else if (type_ == "tape") {
-        wet_signal = tapeSaturation(input);
-    } else if (type_ == "transformer") {
-        wet_signal = transformerSaturation(input);
-    } else {
-        wet_signal = input; // Fallback or bypass
-    }
+template <int Channels>
+void AnalogSaturation::processKernel(float* block, size_t num_frames, int channels) {
+    const int ch = kernelChannels<Channels>(channels);
+    input_.resize(num_frames);
+    shaped_.resize(num_frames);
+    const float dry_gain = static_cast<float>(1.0 - mix_);
+    const float wet_gain = static_cast<float>(mix_);
 
-    wet_signal = anti_alias_.process(wet_signal);
-    return (1.0f - mix_) * dry_signal + mix_ * wet_signal;
-}
+    for (int c = 0; c < ch; ++c) {
+        ChannelState& state = channel_states_[c];
 
-void AnalogSaturation::process(std::vector<float>& block, int channels) {
-    if (!enabled_) return;
-    for (size_t i = 0; i < block.size(); ++i) {
-        block[i] = processSample(block[i]);
+        // 1. DCブロッカー
+        for (size_t i = 0; i < num_frames; ++i) {
+            input_[i] = state.dc_blocker.process(block[i * ch + c]);
+        }
+
+        // 2. ウェーブシェイパー（カーブの分岐はブロックごとの仮想呼び出し1回のみ）
+        if (shaper_) {
+            shaper_->process(state.adaa, input_.data(), shaped_.data(), num_frames);
+        } else {
+            shaped_ = input_;
+        }
+
+        // 3. アンチエイリアスとミックス
+        for (size_t i = 0; i < num_frames; ++i) {
+            float& sample = block[i * ch + c];
+            sample = dry_gain * sample + wet_gain * state.anti_alias.process(shaped_[i]);
+        }
     }
 }
 
 // --- MultibandCompressor の実装 ---
-// ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↓修正開始◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
 void MultibandCompressor::setup(double sr, const json& params) {
     sample_rate_ = sr;
     bands_.clear();
+    bool multirate = false;
 
     if (params.is_object() && !params.empty()) {
         enabled_ = params.value("enabled", false); // Default to disabled if not specified
+        sidechain_ = params.value("sidechain", "");
+        multirate = params.value("multirate", false);
         if (params.contains("bands") && params["bands"].is_array()) {
             for (const auto& band_params : params["bands"]) {
                 Band new_band;
@@ -118,136 +143,282 @@ void MultibandCompressor::setup(double sr, const json& params) {
         bands_.push_back(default_band);
     }
 
-    setupCrossoverFilters(); // Setup filters for all bands after they are defined
-    reset();
-}
+    // クロスオーバーツリーは低域から順に分割するので帯域を周波数順に並べる
+    std::sort(bands_.begin(), bands_.end(), [](const Band& a, const Band& b) { return a.freq_low < b.freq_low; });
+
+    // ゲイン計算用パラメータを帯域方向の配列に展開
+    // gain = makeup * (envelope / threshold)^slope  （envelope > threshold のとき）
+    const size_t num_bands = bands_.size();
+    attack_coeffs_.resize(num_bands);
+    release_coeffs_.resize(num_bands);
+    inv_thresholds_.resize(num_bands);
+    slopes_.resize(num_bands);
+    makeup_gains_.resize(num_bands);
+    for (size_t b = 0; b < num_bands; ++b) {
+        const Band& band = bands_[b];
+        attack_coeffs_[b] = static_cast<float>(band.attack_coeff);
+        release_coeffs_[b] = static_cast<float>(band.release_coeff);
+        inv_thresholds_[b] = static_cast<float>(1.0 / db_to_linear(band.threshold_db));
+        slopes_[b] = (band.enabled && band.ratio > 0.0) ? static_cast<float>(-(1.0 - 1.0 / band.ratio)) : 0.0f;
+        makeup_gains_[b] = band.enabled ? static_cast<float>(db_to_linear(band.makeup_gain_db)) : 1.0f;
+    }
 
-void MultibandCompressor::setupCrossoverFilters() {
-    // This function will set up the band-pass filters for each band.
-    // For simplicity, we're using simple LPF/HPF pairs for each band.
-    // A true multiband compressor would use more sophisticated Linkwitz-Riley crossovers
-    // to ensure a flat sum, but SimpleBiquad does not offer that directly.
-
-    if (bands_.empty()) return;
-
-    // Handle 1-band case (wideband)
-    if (bands_.size() == 1) {
-        bands_[0].lpf_l.set_lpf(sample_rate_, bands_[0].freq_high, 0.707); // Top of the band
-        bands_[0].hpf_l.set_hpf(sample_rate_, bands_[0].freq_low, 0.707);  // Bottom of the band
-        bands_[0].lpf_r.set_lpf(sample_rate_, bands_[0].freq_high, 0.707);
-        bands_[0].hpf_r.set_hpf(sample_rate_, bands_[0].freq_low, 0.707);
-        return;
+    setupCrossoverFilters(); // Setup filters for all bands after they are defined
+    channels_ = 0;
+    tail_samples_ = 0;
+    for (size_t i = 0; i < crossover_freqs_.size(); ++i) {
+        LinkwitzRiley4 lowpass, highpass;
+        lowpass.set_lpf(sample_rate_, crossover_freqs_[i]);
+        highpass.set_hpf(sample_rate_, crossover_freqs_[i]);
+        SimpleBiquad allpass;
+        allpass.set_allpass(sample_rate_, crossover_freqs_[i], M_SQRT1_2);
+        for (const SimpleBiquad* f : {&lowpass.first, &lowpass.second, &highpass.first, &highpass.second, &allpass}) {
+            tail_samples_ = addTails(tail_samples_, f->ring_down_samples());
+        }
     }
 
-    // For multiple bands, chain LPFs and HPFs to create band-pass filters
-    for (size_t i = 0; i < bands_.size(); ++i) {
-        Band& band = bands_[i];
+    // マルチレート: 帯域0の上限（クロスオーバー0）から間引き段数を決める
+    // サイドチェーン時は解析バスが元のレートで計算したエンベロープを使うため対象外
+    multirate_octaves_ = 0;
+    latency_samples_ = 0;
+    if (multirate && !crossover_freqs_.empty()) {
+        if (!sidechain_.empty()) {
+            std::cerr << "[WARN] MultibandCompressor: 'multirate' is ignored when 'sidechain' is set." << std::endl;
+        } else {
+            multirate_octaves_ = MultirateBand::octavesFor(sample_rate_, crossover_freqs_[0]);
+        }
+    }
+    if (multirate_octaves_ > 0) {
+        const double low_rate = sample_rate_ / static_cast<double>(1 << multirate_octaves_);
+        low_attack_coeff_ = static_cast<float>(std::exp(-1.0 / (low_rate * bands_[0].attack_ms / 1000.0)));
+        low_release_coeff_ = static_cast<float>(std::exp(-1.0 / (low_rate * bands_[0].release_ms / 1000.0)));
+        MultirateBand probe;
+        probe.configure(multirate_octaves_, kLowBandBlockFrames);
+        LinkwitzRiley4 lowpass;
+        lowpass.set_lpf(low_rate, crossover_freqs_[0]);
+        // 間引いたレートでの残響長を元のレートのサンプル数に換算し、往復の遅延と合わせて加える
+        const size_t low_tail = addTails(lowpass.first.ring_down_samples(), lowpass.second.ring_down_samples());
+        const size_t factor = static_cast<size_t>(probe.factor());
+        tail_samples_ = addTails(tail_samples_, probe.latency());
+        latency_samples_ = probe.latency();
+        tail_samples_ = addTails(tail_samples_, (low_tail > kInfiniteTail / factor) ? kInfiniteTail : low_tail * factor);
+    }
+    crossovers_.clear();
+    low_bands_.clear();
+    envelopes_.clear();
+    sidechain_handles_.clear();
+    bus_ = nullptr;
+}
 
-        // LPF for the upper bound of the current band
-        band.lpf_l.set_lpf(sample_rate_, band.freq_high, 0.707);
-        band.lpf_r.set_lpf(sample_rate_, band.freq_high, 0.707);
+void MultibandCompressor::declareAnalysis(AnalysisBus& bus) {
+    if (!enabled_ || sidechain_.empty()) return;
+    sidechain_handles_.clear();
+    for (const Band& band : bands_) {
+        AnalysisRequest request;
+        request.signal = AnalysisSignal::Channels;
+        request.low_freq = band.freq_low;
+        request.high_freq = band.freq_high;
+        request.attack_ms = band.attack_ms;
+        request.release_ms = band.release_ms;
+        request.source = sidechain_;
+        sidechain_handles_.push_back(bus.request(request));
+    }
+    bus_ = &bus;
+}
 
-        // HPF for the lower bound of the current band
-        band.hpf_l.set_hpf(sample_rate_, band.freq_low, 0.707);
-        band.hpf_r.set_hpf(sample_rate_, band.freq_low, 0.707);
+void MultibandCompressor::setupCrossoverFilters() {
+    // 隣接する帯域の境界（帯域iの上限）をクロスオーバー周波数とする
+    crossover_freqs_.clear();
+    for (size_t i = 0; i + 1 < bands_.size(); ++i) {
+        crossover_freqs_.push_back(bands_[i].freq_high);
     }
 }
 
+void MultibandCompressor::prepareChannels(int channels) {
+    channels_ = channels;
+    kernel_.select(channels, &MultibandCompressor::processKernel<1>, &MultibandCompressor::processKernel<2>,
+                   &MultibandCompressor::processKernel<0>);
+    const size_t num_xovers = crossover_freqs_.size();
+
+    CrossoverChannel xover;
+    xover.lowpass.resize(num_xovers);
+    xover.highpass.resize(num_xovers);
+    for (size_t i = 0; i < num_xovers; ++i) {
+        xover.lowpass[i].set_lpf(sample_rate_, crossover_freqs_[i]);
+        xover.highpass[i].set_hpf(sample_rate_, crossover_freqs_[i]);
+    }
+    // 帯域iには、自身より上のクロスオーバー j (> i) のオールパスを掛ける
+    for (size_t i = 0; i < num_xovers; ++i) {
+        for (size_t j = i + 1; j < num_xovers; ++j) {
+            SimpleBiquad ap;
+            ap.set_allpass(sample_rate_, crossover_freqs_[j], M_SQRT1_2);
+            xover.allpass.push_back(ap);
+        }
+    }
+    crossovers_.assign(channels, xover);
+
+    low_bands_.clear();
+    if (multirate_octaves_ > 0) {
+        LowBandChannel low;
+        low.resampler.configure(multirate_octaves_, kLowBandBlockFrames);
+        low.lowpass.set_lpf(sample_rate_ / static_cast<double>(low.resampler.factor()), crossover_freqs_[0]);
+        for (size_t j = 1; j < num_xovers; ++j) {
+            SimpleBiquad ap;
+            ap.set_allpass(sample_rate_, crossover_freqs_[j], M_SQRT1_2);
+            low.allpass.push_back(ap);
+        }
+        low.delay.assign(low.resampler.latency(), 0.0f);
+        low_bands_.assign(channels, low);
+    }
+    envelopes_.assign(static_cast<size_t>(channels) * bands_.size(), 0.0f);
+}
 
 void MultibandCompressor::reset() {
-    for (auto& band : bands_) {
-        band.envelope_l = 0.0;
-        band.envelope_r = 0.0;
-        band.lpf_l.reset();
-        band.hpf_l.reset();
-        band.lpf_r.reset();
-        band.hpf_r.reset();
-        band.bpf_l.reset(); // In case BPFs were used elsewhere or planned
-        band.bpf_r.reset(); // In case BPFs were used elsewhere or planned
+    for (auto& xover : crossovers_) {
+        for (auto& f : xover.lowpass) f.reset();
+        for (auto& f : xover.highpass) f.reset();
+        for (auto& f : xover.allpass) f.reset();
+    }
+    for (auto& low : low_bands_) {
+        low.resampler.reset();
+        low.lowpass.reset();
+        for (auto& f : low.allpass) f.reset();
+        std::fill(low.delay.begin(), low.delay.end(), 0.0f);
+        low.delay_pos = 0;
     }
+    std::fill(envelopes_.begin(), envelopes_.end(), 0.0f);
 }
 
-float MultibandCompressor::calculateGain(float envelope, float threshold_db, float ratio) {
-    float threshold_linear = db_to_linear(threshold_db);
-    float gain = 1.0f;
-    if (envelope > threshold_linear) {
-        // Calculate gain reduction in dB
-        float gain_reduction_db = (threshold_db - 20.0f * std::log10(envelope)) * (1.0f - (1.0f / ratio));
-        gain = db_to_linear(gain_reduction_db);
+void MultibandCompressor::splitBands(CrossoverChannel& xover, float input, float* bands, size_t stride, size_t first_band) {
+    const size_t num_xovers = crossover_freqs_.size();
+    float rest = input;
+    size_t ap_index = 0;
+    for (size_t i = 0; i < num_xovers; ++i) {
+        if (i < first_band) {
+            // 別に処理する帯域: 高域側だけを通し、その帯域の位相補償は飛ばす
+            rest = xover.highpass[i].process(rest);
+            ap_index += num_xovers - 1 - i;
+            continue;
+        }
+        float low = xover.lowpass[i].process(rest);
+        rest = xover.highpass[i].process(rest);
+        for (size_t j = i + 1; j < num_xovers; ++j) {
+            low = xover.allpass[ap_index++].process(low);
+        }
+        bands[i * stride] = low;
     }
-    return gain;
+    bands[num_xovers * stride] = rest;
 }
 
+void MultibandCompressor::processLowBand(LowBandChannel& low, float& envelope, float* samples, size_t count) {
+    // 帯域0の分割・検波・ゲイン計算を間引いたレートで行う（手順は元のレートの帯域と同じ）
+    // ゲインの作業領域には、マルチレート時に元のレートでは使わない帯域0の領域を使う
+    for (size_t i = 0; i < count; ++i) samples[i] = low.lowpass.process(samples[i]);
+    float* gain = gain_buffer_.data();
+    const float inv_threshold = inv_thresholds_[0];
+    float e = envelope;
+    for (size_t i = 0; i < count; ++i) {
+        float level = std::fabs(samples[i]);
+        float coeff = (level > e) ? low_attack_coeff_ : low_release_coeff_;
+        e = coeff * e + (1.0f - coeff) * level;
+        gain[i] = std::max(e * inv_threshold, 1.0f);
+    }
+    envelope = e;
+    fast_math::fast_log2_block(gain, gain, count);
+    const float slope = slopes_[0];
+    for (size_t i = 0; i < count; ++i) gain[i] *= slope;
+    fast_math::fast_exp2_block(gain, gain, count);
+    const float makeup = makeup_gains_[0];
+    for (size_t i = 0; i < count; ++i) samples[i] *= gain[i] * makeup;
+}
 
 void MultibandCompressor::process(std::vector<float>& block, int channels) {
-    if (!enabled_ || bands_.empty() || channels == 0) return;
-
-    size_t num_frames = block.size() / channels;
-
-    // Temporary storage for band-split and compressed signals
-    std::vector<std::vector<float>> band_samples_l(bands_.size(), std::vector<float>(num_frames));
-    std::vector<std::vector<float>> band_samples_r(bands_.size(), std::vector<float>(num_frames));
+    if (!enabled_ || bands_.empty() || channels <= 0) return;
+    if (channels != channels_) prepareChannels(channels);
+    kernel_.run(*this, block);
+}
 
+template <int Channels>
+void MultibandCompressor::processKernel(float* block, size_t num_frames, int channels) {
+    const int ch = kernelChannels<Channels>(channels);
+    const size_t num_bands = bands_.size();
+    band_buffer_.resize(num_bands * num_frames);
+    gain_buffer_.resize(num_bands * num_frames);
+    // マルチレート時は帯域0を低いレートで処理し、元のレートでは帯域1以降だけを扱う
+    const size_t first_band = (!low_bands_.empty() && !bus_) ? 1 : 0;
+    if (first_band > 0) {
+        input_buffer_.resize(num_frames);
+        low_output_.resize(num_frames);
+    }
 
-    for (size_t i = 0; i < num_frames; ++i) {
-        float input_l = block[i * channels];
-        float input_r = (channels > 1) ? block[i * channels + 1] : input_l;
-
-        // 1. Split into bands and apply compression
-        for (size_t b_idx = 0; b_idx < bands_.size(); ++b_idx) {
-            Band& band = bands_[b_idx];
-            if (!band.enabled) {
-                // If band is disabled, pass through original signal for this band (or silence)
-                band_samples_l[b_idx][i] = input_l;
-                band_samples_r[b_idx][i] = input_r;
-                continue;
+    for (int c = 0; c < ch; ++c) {
+        CrossoverChannel& xover = crossovers_[c];
+        float* env = envelopes_.data() + static_cast<size_t>(c) * num_bands;
+
+        // 0. マルチレート: 帯域0を間引いて分割・圧縮し、補間して戻す。位相補償は元のレートで掛ける
+        if (first_band > 0) {
+            LowBandChannel& low = low_bands_[c];
+            for (size_t i = 0; i < num_frames; ++i) input_buffer_[i] = block[i * ch + c];
+            low.resampler.process(input_buffer_.data(), low_output_.data(), num_frames,
+                                  [&](float* samples, size_t count) { processLowBand(low, env[0], samples, count); });
+            for (SimpleBiquad& allpass : low.allpass) {
+                for (size_t i = 0; i < num_frames; ++i) low_output_[i] = allpass.process(low_output_[i]);
             }
+        }
 
-            // Apply band-pass filtering (cascaded LPF and HPF)
-            float band_signal_l = band.lpf_l.process(band.hpf_l.process(input_l));
-            float band_signal_r = band.lpf_r.process(band.hpf_r.process(input_r));
+        // 1. クロスオーバーツリーで帯域分割（帯域ごとに連続した配列へ）
+        for (size_t i = 0; i < num_frames; ++i) {
+            splitBands(xover, block[i * ch + c], band_buffer_.data() + i, num_frames, first_band);
+        }
 
-            // Envelope follower for left channel
-            float current_level_l = std::abs(band_signal_l);
-            if (current_level_l > band.envelope_l) {
-                band.envelope_l = band.attack_coeff * band.envelope_l + (1.0f - band.attack_coeff) * current_level_l;
-            } else {
-                band.envelope_l = band.release_coeff * band.envelope_l + (1.0f - band.release_coeff) * current_level_l;
-            }
+        for (size_t b = first_band; b < num_bands; ++b) {
+            const float* signal = band_buffer_.data() + b * num_frames;
+            float* gain = gain_buffer_.data() + b * num_frames;
 
-            // Envelope follower for right channel
-            float current_level_r = std::abs(band_signal_r);
-            if (current_level_r > band.envelope_r) {
-                band.envelope_r = band.attack_coeff * band.envelope_r + (1.0f - band.attack_coeff) * current_level_r;
+            // 2. エンベロープ追従（漸化式なので逐次）。閾値で正規化した値を書き出す
+            //    サイドチェーン指定時は解析バスで計算済みのエンベロープを使う
+            const float inv_threshold = inv_thresholds_[b];
+            if (bus_) {
+                const float* key = bus_->read(sidechain_handles_[b], c);
+                for (size_t i = 0; i < num_frames; ++i) gain[i] = std::max(key[i] * inv_threshold, 1.0f);
             } else {
-                band.envelope_r = band.release_coeff * band.envelope_r + (1.0f - band.release_coeff) * current_level_r;
+                const float attack = attack_coeffs_[b];
+                const float release = release_coeffs_[b];
+                float e = env[b];
+                for (size_t i = 0; i < num_frames; ++i) {
+                    float level = std::fabs(signal[i]);
+                    float coeff = (level > e) ? attack : release;
+                    e = coeff * e + (1.0f - coeff) * level;
+                    gain[i] = std::max(e * inv_threshold, 1.0f);
+                }
+                env[b] = e;
             }
 
-            // Calculate gain for left and right channels
-            float gain_l = calculateGain(band.envelope_l, band.threshold_db, band.ratio);
-            float gain_r = calculateGain(band.envelope_r, band.threshold_db, band.ratio);
-
-            // Apply gain reduction and makeup gain
-            band_samples_l[b_idx][i] = band_signal_l * gain_l * db_to_linear(band.makeup_gain_db);
-            band_samples_r[b_idx][i] = band_signal_r * gain_r * db_to_linear(band.makeup_gain_db);
+            // 3. log2領域でゲイン計算: makeup * 2^(slope * log2(env / threshold))
+            fast_math::fast_log2_block(gain, gain, num_frames);
+            const float slope = slopes_[b];
+            for (size_t i = 0; i < num_frames; ++i) gain[i] *= slope;
+            fast_math::fast_exp2_block(gain, gain, num_frames);
         }
-    }
 
-    // 2. Sum the processed bands back together
-    for (size_t i = 0; i < num_frames; ++i) {
-        float summed_l = 0.0f;
-        float summed_r = 0.0f;
-        for (size_t b_idx = 0; b_idx < bands_.size(); ++b_idx) {
-            summed_l += band_samples_l[b_idx][i];
-            summed_r += band_samples_r[b_idx][i];
-        }
-        block[i * channels] = summed_l;
-        if (channels > 1) {
-            block[i * channels + 1] = summed_r;
+        // 4. 帯域を合成（メイクアップゲインはここでまとめて掛ける）
+        for (size_t i = 0; i < num_frames; ++i) {
+            float summed = 0.0f;
+            for (size_t b = first_band; b < num_bands; ++b) {
+                summed += band_buffer_[b * num_frames + i] * gain_buffer_[b * num_frames + i] * makeup_gains_[b];
+            }
+            if (first_band > 0) {
+                // 元のレートの帯域の和を帯域0の遅延に揃えて合成する
+                LowBandChannel& low = low_bands_[c];
+                const float delayed = low.delay[low.delay_pos];
+                low.delay[low.delay_pos] = summed;
+                low.delay_pos = (low.delay_pos + 1 == low.delay.size()) ? 0 : low.delay_pos + 1;
+                summed = delayed + low_output_[i];
+            }
+            block[i * ch + c] = summed;
         }
     }
 }
-// ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↑修正終わり◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
 
 
 // --- MasteringLimiterクラスのメソッド実装 ---
@@ -260,70 +431,192 @@ void MasteringLimiter::setup(double sr, const json& params) {
         attack_ms_ = params.value("attack_ms", 1.5);
         release_ms_ = params.value("release_ms", 50.0);
         lookahead_ms_ = params.value("lookahead_ms", 5.0);
+        true_peak_ = params.value("true_peak", false);
     }
 
-    threshold_linear_ = db_to_linear(threshold_db_);
-    attack_coeff_ = (attack_ms_ > 0) ? std::exp(-1.0 / (sample_rate_ * attack_ms_ / 1000.0)) : 0.0;
-    release_coeff_ = (release_ms_ > 0) ? std::exp(-1.0 / (sample_rate_ * release_ms_ / 1000.0)) : 0.0;
-    lookahead_samples_ = static_cast<int>(sample_rate_ * lookahead_ms_ / 1000.0);
+    threshold_linear_ = static_cast<float>(db_to_linear(threshold_db_));
+    release_coeff_ = (release_ms_ > 0) ? static_cast<float>(std::exp(-1.0 / (sample_rate_ * release_ms_ / 1000.0))) : 0.0f;
+    lookahead_samples_ = static_cast<size_t>(std::max(0.0, sample_rate_ * lookahead_ms_ / 1000.0));
+    // 箱形フィルタがルックアヘッドより長いとピークまでにゲインが下がりきらないため制限する
+    size_t attack = static_cast<size_t>(std::max(1.0, sample_rate_ * attack_ms_ / 1000.0));
+    if (attack > lookahead_samples_ + 1) {
+        std::cerr << "[WARN] MasteringLimiter: attack_ms (" << attack_ms_ << ") exceeds lookahead_ms (" << lookahead_ms_
+                  << "). Attack is shortened to the lookahead." << std::endl;
+        attack = lookahead_samples_ + 1;
+    }
+    attack_samples_ = attack;
+    detector_delay_ = true_peak_ ? kTruePeakHalfTaps : 0;
+
+    // 補間フィルタ: 時刻 n0 + p/4 の値を x[n0-5] .. x[n0+6] から Hann窓付きsincで推定する
+    for (int p = 1; p < kTruePeakOversampling; ++p) {
+        double frac = static_cast<double>(p) / kTruePeakOversampling;
+        for (int j = 0; j < kTruePeakTaps; ++j) {
+            double t = frac - (j - (kTruePeakHalfTaps - 1));
+            double sinc = (std::abs(t) < 1e-12) ? 1.0 : std::sin(M_PI * t) / (M_PI * t);
+            double window = 0.5 * (1.0 + std::cos(M_PI * t / (kTruePeakHalfTaps + 0.5)));
+            interp_weights_[p - 1][j] = static_cast<float>(sinc * window);
+        }
+    }
 
-    shelf_filter_l_.set_highshelf(sr, 8000.0, 0.7, -1.5);
-    shelf_filter_r_.set_highshelf(sr, 8000.0, 0.7, -1.5);
+    channels_ = 0;
+}
 
-    reset();
+void MasteringLimiter::prepareChannels(int channels) {
+    channels_ = channels;
+    kernel_.select(channels, &MasteringLimiter::processKernel<1>, &MasteringLimiter::processKernel<2>,
+                   &MasteringLimiter::processKernel<0>);
+
+    delay_frames_ = lookahead_samples_ + detector_delay_;
+    delay_line_.assign(delay_frames_ * channels, 0.0f);
+    delay_pos_ = 0;
+
+    required_gain_line_.assign(lookahead_samples_, 1.0f);
+    required_gain_pos_ = 0;
+
+    const size_t window = lookahead_samples_ + 1;
+    min_queue_values_.assign(window + 1, 1.0f);
+    min_queue_times_.assign(window + 1, 0);
+    min_queue_head_ = 0;
+    min_queue_size_ = 0;
+    detector_time_ = 0;
+
+    box_history_.assign(attack_samples_, 1.0f);
+    box_pos_ = 0;
+    box_sum_ = static_cast<double>(attack_samples_);
+    released_gain_ = 1.0f;
+
+    tp_history_.assign(static_cast<size_t>(channels) * 2 * kTruePeakTaps, 0.0f);
+    tp_pos_ = 0;
+    previous_intersample_peak_ = 0.0f;
 }
 
 void MasteringLimiter::reset() {
-    lookahead_buffer_l_.assign(lookahead_samples_, 0.0f);
-    lookahead_buffer_r_.assign(lookahead_samples_, 0.0f);
-    envelope_ = 0.0f;
-    shelf_filter_l_.reset();
-    shelf_filter_r_.reset();
+    if (channels_ > 0) prepareChannels(channels_);
 }
 
-void MasteringLimiter::process(std::vector<float>& block, int channels) {
-    if (!enabled_ || channels == 0) return;
+bool MasteringLimiter::serializeState(StateArchive& ar) {
+    ar(delay_line_, delay_pos_, required_gain_line_, required_gain_pos_);
+    ar(min_queue_values_, min_queue_times_, min_queue_head_, min_queue_size_, detector_time_);
+    ar(box_history_, box_pos_, box_sum_, released_gain_);
+    ar(tp_history_, tp_pos_, previous_intersample_peak_);
+    return true;
+}
 
-    size_t num_frames = block.size() / channels;
-    std::vector<float> processed_block(block.size());
+// 全チャンネルのピーク（リンク）を返す。kTruePeakHalfTaps サンプル前のフレームについて、サンプル間ピークも含めた値
+template <int Channels>
+float MasteringLimiter::detectTruePeak(const float* frame) {
+    const int ch = kernelChannels<Channels>(channels_);
+    float peak = 0.0f;
+    float intersample_peak = 0.0f;
+    for (int c = 0; c < ch; ++c) {
+        // 同じ値を2か所に書く二重リングなので、直近 kTruePeakTaps 個（x[n0-5] .. x[n0+6]）が常に連続して並ぶ
+        float* history = tp_history_.data() + static_cast<size_t>(c) * 2 * kTruePeakTaps;
+        history[tp_pos_] = frame[c];
+        history[tp_pos_ + kTruePeakTaps] = frame[c];
+        const float* ordered = history + tp_pos_ + 1;
+        peak = std::max(peak, std::abs(ordered[kTruePeakHalfTaps - 1]));
+        for (int p = 0; p < kTruePeakOversampling - 1; ++p) {
+            float value = 0.0f;
+            for (int j = 0; j < kTruePeakTaps; ++j) value += interp_weights_[p][j] * ordered[j];
+            intersample_peak = std::max(intersample_peak, std::abs(value));
+        }
+    }
+    if (++tp_pos_ == kTruePeakTaps) tp_pos_ = 0;
 
-    for (size_t i = 0; i < num_frames; ++i) {
-        size_t base_idx = i * channels;
-        float current_l = block[base_idx];
-        float current_r = (channels > 1) ? block[base_idx + 1] : current_l;
+    // x[n0] の前後のサンプル間区間 (n0-1, n0) と (n0, n0+1) を両方含める
+    peak = std::max(peak, std::max(previous_intersample_peak_, intersample_peak));
+    previous_intersample_peak_ = intersample_peak;
+    return peak;
+}
 
-        processed_block[base_idx] = lookahead_buffer_l_.front();
-        if (channels > 1) processed_block[base_idx + 1] = lookahead_buffer_r_.front();
+void MasteringLimiter::process(std::vector<float>& block, int channels) {
+    if (!enabled_ || channels <= 0) return;
+    if (channels != channels_) prepareChannels(channels);
+    kernel_.run(*this, block);
+}
 
-        lookahead_buffer_l_.pop_front();
-        lookahead_buffer_r_.pop_front();
-        lookahead_buffer_l_.push_back(current_l);
-        lookahead_buffer_r_.push_back(current_r);
+template <int Channels>
+void MasteringLimiter::processKernel(float* block, size_t num_frames, int channels) {
+    const int ch = kernelChannels<Channels>(channels);
+    gain_buffer_.resize(num_frames);
+    float* gain = gain_buffer_.data();
+
+    // 1. チャンネルをリンクしたピーク
+    if (true_peak_) {
+        for (size_t i = 0; i < num_frames; ++i) gain[i] = detectTruePeak<Channels>(block + i * ch);
+    } else {
+        for (size_t i = 0; i < num_frames; ++i) {
+            const float* frame = block + i * ch;
+            float peak = 0.0f;
+            for (int c = 0; c < ch; ++c) peak = std::max(peak, std::abs(frame[c]));
+            gain[i] = peak;
+        }
     }
 
+    // 2. 天井に収めるための必要ゲイン（分岐なしでベクトル化される）
+    const float threshold = threshold_linear_;
     for (size_t i = 0; i < num_frames; ++i) {
-        size_t base_idx = i * channels;
-        float sample_l = processed_block[base_idx];
-        float sample_r = (channels > 1) ? processed_block[base_idx + 1] : sample_l;
-
-        float sidechain_l = shelf_filter_l_.process(sample_l);
-        float sidechain_r = (channels > 1) ? shelf_filter_r_.process(sample_r) : sidechain_l;
-        float peak_level = std::max(std::abs(sidechain_l), std::abs(sidechain_r));
+        gain[i] = std::min(1.0f, threshold / std::max(gain[i], 1e-30f));
+    }
 
-        if (peak_level > envelope_) {
-            envelope_ = attack_coeff_ * envelope_ + (1.0f - attack_coeff_) * peak_level;
-        } else {
-            envelope_ = release_coeff_ * envelope_ + (1.0f - release_coeff_) * peak_level;
+    // 3. 区間最小値の保持 → リリース → 箱形フィルタ（漸化式なので逐次）
+    const long long window = static_cast<long long>(lookahead_samples_) + 1;
+    const size_t capacity = min_queue_values_.size();
+    const float inv_attack = 1.0f / static_cast<float>(attack_samples_);
+    for (size_t i = 0; i < num_frames; ++i) {
+        float required = gain[i];
+
+        // 単調キュー（償却O(1)）: 末尾から required 以上の値を捨てて追加し、窓から出た先頭を捨てる
+        while (min_queue_size_ > 0) {
+            size_t back = min_queue_head_ + min_queue_size_ - 1;
+            if (back >= capacity) back -= capacity;
+            if (min_queue_values_[back] < required) break;
+            --min_queue_size_;
         }
-
-        float gain = 1.0f;
-        if (envelope_ > threshold_linear_) {
-            gain = threshold_linear_ / envelope_;
+        size_t slot = min_queue_head_ + min_queue_size_;
+        if (slot >= capacity) slot -= capacity;
+        min_queue_values_[slot] = required;
+        min_queue_times_[slot] = detector_time_;
+        ++min_queue_size_;
+        while (min_queue_times_[min_queue_head_] <= detector_time_ - window) {
+            if (++min_queue_head_ == capacity) min_queue_head_ = 0;
+            --min_queue_size_;
         }
+        ++detector_time_;
+        float held = min_queue_values_[min_queue_head_];
+
+        // リリースは上昇だけを遅くする（保持値を超えないので天井は守られる）
+        released_gain_ = std::min(held, release_coeff_ * released_gain_ + (1.0f - release_coeff_) * held);
+        box_sum_ += static_cast<double>(released_gain_) - static_cast<double>(box_history_[box_pos_]);
+        box_history_[box_pos_] = released_gain_;
+        if (++box_pos_ == attack_samples_) box_pos_ = 0;
+        float smoothed = static_cast<float>(box_sum_) * inv_attack;
+
+        // 平滑化の丸め誤差で天井を超えないよう、出力サンプル自身の必要ゲインでも制限する
+        if (lookahead_samples_ > 0) {
+            float delayed_required = required_gain_line_[required_gain_pos_];
+            required_gain_line_[required_gain_pos_] = required;
+            if (++required_gain_pos_ == lookahead_samples_) required_gain_pos_ = 0;
+            required = delayed_required;
+        }
+        gain[i] = std::min(smoothed, required);
+    }
 
-        block[base_idx] = sample_l * gain;
-        if (channels > 1) {
-            block[base_idx + 1] = sample_r * gain;
+    // 4. 遅延線を通したオーディオにゲインを適用
+    if (delay_frames_ == 0) {
+        for (size_t i = 0; i < num_frames; ++i) {
+            for (int c = 0; c < ch; ++c) block[i * ch + c] *= gain[i];
         }
+        return;
     }
-}
\ No newline at end of file
+    for (size_t i = 0; i < num_frames; ++i) {
+        float* frame = block + i * ch;
+        float* delayed = delay_line_.data() + delay_pos_ * ch;
+        for (int c = 0; c < ch; ++c) {
+            float input = frame[c];
+            frame[c] = delayed[c] * gain[i];
+            delayed[c] = input;
+        }
+        if (++delay_pos_ == delay_frames_) delay_pos_ = 0;
+    }
+}
@@ -3,16 +3,37 @@
 #pragma once
 #include "SimpleBiquad.h"
 #include "AudioEffect.h"
+#include "waveshaper.h"
+#include "analysis_bus.h"
+#include "channel_kernel.h"
+#include "multirate.h"
 #include <vector>
 #include <cmath>
 #include <algorithm>
 #include <string>
-#include <deque>
+#include <memory>
 #include <nlohmann/json.hpp>
 
 // jsonエイリアスは基底クラスヘッダで定義済み
 
-// マルチバンドコンプレッサー（スタブ）
+// 4次Linkwitz-Rileyフィルタ（Q=0.707のButterworth 2次を2段カスケード）
+// 同じ周波数のLPFとHPFの和は2次オールパスとなり、振幅特性はフラットになる
+struct LinkwitzRiley4 {
+    SimpleBiquad first, second;
+    void set_lpf(double sr, double freq) { first.set_lpf(sr, freq, M_SQRT1_2); second.set_lpf(sr, freq, M_SQRT1_2); }
+    void set_hpf(double sr, double freq) { first.set_hpf(sr, freq, M_SQRT1_2); second.set_hpf(sr, freq, M_SQRT1_2); }
+    void reset() { first.reset(); second.reset(); }
+    void serializeState(StateArchive& ar) { ar(first, second); }
+    float process(float x) { return second.process(first.process(x)); }
+};
+
+// マルチバンドコンプレッサー
+// LR4クロスオーバーのツリーで帯域分割し、下位帯域は上位クロスオーバーと同じ
+// オールパスで位相を揃えるため、圧縮していない状態では帯域の和がフラットになる
+// "sidechain" にチェーン上の位置（"input" または前段のエフェクト名）を指定すると、その信号の
+// 帯域エンベロープ（2次のバンドパス）を解析バスから受け取って検波に使う
+// "multirate": true のときは最低域の帯域を間引いたレートで分割・検波・ゲイン適用し、補間して戻す
+// （他の帯域はその遅延 MultirateBand::latency() だけ遅らせて合成する）
 class MultibandCompressor : public AudioEffect {
 public:
     struct Band {
@@ -20,68 +41,146 @@ public:
         double threshold_db, ratio, attack_ms, release_ms;
         double makeup_gain_db;
         bool enabled;
-        double envelope_l = 0.0; // Left channel envelope
-        double envelope_r = 0.0; // Right channel envelope
         double attack_coeff = 0.0;
         double release_coeff = 0.0;
-        SimpleBiquad lpf_l, hpf_l, bpf_l; // Filters for Left Channel
-        SimpleBiquad lpf_r, hpf_r, bpf_r; // Filters for Right Channel
     };
 
     void setup(double sr, const json& params) override;
     void process(std::vector<float>& block, int channels) override;
     void reset() override;
+    void setChannelCount(int channels) override { prepareChannels(channels); }
+    bool isFusable() const override { return true; }
+    bool isActive() const override { return enabled_ && !bands_.empty(); }
+    size_t getTailSamples() const override { return tail_samples_; }
+    size_t getLatencySamples() const override { return latency_samples_; }
     const std::string& getName() const override { return name_; }
+    void declareAnalysis(AnalysisBus& bus) override;
+    bool serializeState(StateArchive& ar) override { ar(crossovers_, low_bands_, envelopes_); return true; }
 
 private:
+    // チャンネルごとのクロスオーバーツリー
+    struct CrossoverChannel {
+        std::vector<LinkwitzRiley4> lowpass;   // クロスオーバーiの低域側
+        std::vector<LinkwitzRiley4> highpass;  // クロスオーバーiの高域側
+        std::vector<SimpleBiquad> allpass;     // 帯域iに掛ける上位クロスオーバーの位相補償（帯域順に連結）
+        void serializeState(StateArchive& ar) { ar(lowpass, highpass, allpass); }
+    };
+
+    // マルチレート処理する最低域の帯域（チャンネルごと）
+    struct LowBandChannel {
+        MultirateBand resampler;
+        LinkwitzRiley4 lowpass;                // 間引いたレートで設計したクロスオーバー0の低域側
+        std::vector<SimpleBiquad> allpass;     // 上位クロスオーバーの位相補償（元のレートで補間後に掛ける）
+        std::vector<float> delay;              // 他の帯域の和を resampler の遅延だけ遅らせるリングバッファ
+        size_t delay_pos = 0;
+        void serializeState(StateArchive& ar) { ar(resampler, lowpass, allpass, delay, delay_pos); }
+    };
+
     std::string name_ = "multiband_compressor"; // Changed name for consistency
     // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↓修正開始◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
     bool enabled_ = false; // デフォルトは無効
     // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↑修正終わり◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
     double sample_rate_ = 44100.0;
     std::vector<Band> bands_;
-    // Crossover filters can be handled within the setup method of each band or
-    // within a centralized crossover network. For simplicity, I'll manage it
-    // within the process function directly or set up band-specific filters.
-    // std::vector<SimpleBiquad> crossover_filters_; // This can be removed or re-purposed
-
-    // Helper functions
-    float calculateGain(float envelope, float threshold_db, float ratio);
-    void setupCrossoverFilters(); // Renamed and re-purposed from setupCrossoverNetwork
+    std::vector<double> crossover_freqs_;
+    std::vector<CrossoverChannel> crossovers_;
+    int channels_ = 0;
+    size_t tail_samples_ = 0;             // クロスオーバーツリーの残響長（全フィルタの和で上から抑える）
+    size_t latency_samples_ = 0;          // multirate のときの間引き・補間の遅延（全帯域をこれに揃える）
+
+    // 帯域ごとのゲイン計算用パラメータ（SoAで保持し、ゲインはフレーム方向にSIMDで計算する）
+    std::vector<float> attack_coeffs_, release_coeffs_;
+    std::vector<float> inv_thresholds_;   // 1 / threshold (linear)
+    std::vector<float> slopes_;           // -(1 - 1/ratio)、無効な帯域は0
+    std::vector<float> makeup_gains_;     // dB -> linear 変換済み
+    std::vector<float> envelopes_;        // channels * bands
+    std::vector<float> band_buffer_;      // bands * frames の帯域信号
+    std::vector<float> gain_buffer_;      // bands * frames のゲイン
+
+    // サイドチェーン（"sidechain" を指定したときのみ。帯域ごとのエンベロープを解析バスから読む）
+    std::string sidechain_;
+    std::vector<AnalysisBus::Handle> sidechain_handles_;
+    const AnalysisBus* bus_ = nullptr;
+    ChannelKernel<MultibandCompressor> kernel_;
+
+    // マルチレート処理（"multirate": true でサイドチェーンなしのとき、帯域0を 2^octaves 分の1のレートで処理）
+    int multirate_octaves_ = 0;
+    static constexpr size_t kLowBandBlockFrames = 1024;          // resampler の作業バッファの長さ（長いブロックは分けて処理する）
+    float low_attack_coeff_ = 0.0f, low_release_coeff_ = 0.0f;   // 間引いたレートでの係数
+    std::vector<LowBandChannel> low_bands_;
+    std::vector<float> input_buffer_;     // 1チャンネル分の入力
+    std::vector<float> low_output_;       // 補間して戻した帯域0
+
+    void setupCrossoverFilters();
+    void prepareChannels(int channels);
+    template <int Channels> void processKernel(float* block, size_t frames, int channels);
+    // first_band 未満の帯域は分割しない（マルチレート時は帯域0を別に処理する）
+    void splitBands(CrossoverChannel& xover, float input, float* bands, size_t stride, size_t first_band);
+    void processLowBand(LowBandChannel& low, float& envelope, float* samples, size_t count);
 };
 
 // アナログ風サチュレーション
+// カーブ（tube / tape / transformer）はセットアップ時に1回だけ選択し、
+// チャンネルごとのDCブロッカー・ADAAウェーブシェイパー・アンチエイリアスフィルタで処理する
 class AnalogSaturation : public AudioEffect {
 public:
     void setup(double sr, const json& params) override;
     void process(std::vector<float>& block, int channels) override;
     void reset() override;
+    void setChannelCount(int channels) override { prepareChannels(channels); }
+    bool isFusable() const override { return true; }
+    bool isActive() const override { return enabled_ && mix_ != 0.0; }
+    size_t getTailSamples() const override { return tail_samples_; }
     const std::string& getName() const override { return name_; }
+    bool serializeState(StateArchive& ar) override { ar(channel_states_); return true; }
 
 private:
+    struct ChannelState {
+        SimpleBiquad dc_blocker, anti_alias;
+        waveshaper::AdaaState adaa;
+        void serializeState(StateArchive& ar) { ar(dc_blocker, anti_alias, adaa); }
+    };
+
     std::string name_ = "analog_saturation";
     bool enabled_ = true;
     double sample_rate_ = 44100.0;
     double drive_ = 1.0;
     double mix_ = 0.3;
     std::string type_ = "tube";
-    SimpleBiquad dc_blocker_, anti_alias_;
+    std::unique_ptr<waveshaper::Shaper> shaper_;  // nullptr のときはシェイピングをバイパス
+    std::vector<ChannelState> channel_states_;
+    int channels_ = 0;
+    size_t tail_samples_ = 0;
+    std::vector<float> input_, shaped_;           // 1チャンネル分の作業バッファ
+    ChannelKernel<AnalogSaturation> kernel_;
 
-    float tubeSaturation(float x);
-    float tapeSaturation(float x);
-    float transformerSaturation(float x);
-    float processSample(float sample);
+    void prepareChannels(int channels);
+    template <int Channels> void processKernel(float* block, size_t frames, int channels);
 };
 
 // マスタリング・リミッター
+// ルックアヘッド区間の必要ゲインの最小値を保持（単調キューでO(1)）し、箱形フィルタで平滑化する。
+// 平滑化の窓はルックアヘッド内に収まるため、ピークが遅延線から出る時点で必ずゲインが目標値に達する。
+// true_peak を有効にすると、4倍オーバーサンプリング相当の補間でサンプル間ピークも検出する。
 class MasteringLimiter : public AudioEffect {
 public:
     void setup(double sr, const json& params) override;
     void process(std::vector<float>& block, int channels) override;
     void reset() override;
+    void setChannelCount(int channels) override { prepareChannels(channels); }
+    bool isActive() const override { return enabled_; }
+    // 無音が遅延線を通り抜ければ出力は0（ゲイン状態は出力に影響しない）
+    size_t getTailSamples() const override { return lookahead_samples_ + detector_delay_; }
+    size_t getLatencySamples() const override { return lookahead_samples_ + detector_delay_; }
     const std::string& getName() const override { return name_; }
+    bool serializeState(StateArchive& ar) override;
 
 private:
+    // サンプル間ピーク推定用の補間フィルタ（窓付きsinc、片側 kTruePeakHalfTaps タップ）
+    static constexpr int kTruePeakOversampling = 4;
+    static constexpr int kTruePeakHalfTaps = 6;
+    static constexpr int kTruePeakTaps = 2 * kTruePeakHalfTaps;
+
     std::string name_ = "mastering_limiter";
     bool enabled_ = true;
     double sample_rate_ = 48000.0;
@@ -89,15 +188,47 @@ private:
     double attack_ms_ = 1.5;
     double release_ms_ = 50.0;
     double lookahead_ms_ = 5.0;
+    bool true_peak_ = false;
+
+    float threshold_linear_ = 1.0f;
+    float release_coeff_ = 0.0f;
+    size_t lookahead_samples_ = 0;   // 必要ゲインの計算からゲイン適用までの遅延
+    size_t attack_samples_ = 1;      // 箱形フィルタの長さ（<= lookahead_samples_ + 1）
+    size_t detector_delay_ = 0;      // true peak 検出の補間による遅延
+    int channels_ = 0;
+
+    // オーディオの遅延線（フレーム単位のリング、channels * delay_frames_）
+    std::vector<float> delay_line_;
+    size_t delay_frames_ = 0;
+    size_t delay_pos_ = 0;
+
+    // 必要ゲインの遅延線（ドリフト対策の最終クリップに使う）
+    std::vector<float> required_gain_line_;
+    size_t required_gain_pos_ = 0;
+
+    // 区間最小値の単調キュー（固定容量のリング。値は先頭から単調増加）
+    std::vector<float> min_queue_values_;
+    std::vector<long long> min_queue_times_;
+    size_t min_queue_head_ = 0;
+    size_t min_queue_size_ = 0;
+    long long detector_time_ = 0;
+
+    // 箱形フィルタ（保持ゲインの移動平均）
+    std::vector<float> box_history_;
+    size_t box_pos_ = 0;
+    double box_sum_ = 0.0;
+    float released_gain_ = 1.0f;
+
+    // true peak 検出
+    float interp_weights_[kTruePeakOversampling - 1][kTruePeakTaps] = {};
+    std::vector<float> tp_history_;          // channels * 2 * kTruePeakTaps（チャンネルごとの二重リング）
+    size_t tp_pos_ = 0;
+    float previous_intersample_peak_ = 0.0f;
 
-    double threshold_linear_ = 1.0;
-    double attack_coeff_ = 0.0;
-    double release_coeff_ = 0.0;
-    int lookahead_samples_ = 0;
+    std::vector<float> gain_buffer_;         // 1ブロック分のピーク → 必要ゲイン → 適用ゲイン
+    ChannelKernel<MasteringLimiter> kernel_;
 
-    // 2チャンネル対応
-    std::deque<float> lookahead_buffer_l_;
-    std::deque<float> lookahead_buffer_r_;
-    float envelope_ = 0.0f;
-    SimpleBiquad shelf_filter_l_, shelf_filter_r_;
+    void prepareChannels(int channels);
+    template <int Channels> void processKernel(float* block, size_t frames, int channels);
+    template <int Channels> float detectTruePeak(const float* frame);
 };
\ No newline at end of file
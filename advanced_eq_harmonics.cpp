@@ -1,77 +1,207 @@
 // ./advanced_eq_harmonics.cpp
 // Full and Corrected Implementation of Audio Effects with Memory-Safe FFT and Stable Overlap-Save
 #include "advanced_eq_harmonics.h"
+#include "fast_math.h"
 #include <cmath>
 #include <algorithm>
 #include <stdexcept>
 #include <numeric>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+// STFTの設定を検証し、無効なら有効な値に丸めて警告する（StftEngine::configure() は無効な値で例外を投げるため）
+void warnIfInvalidStft(const char* effect, size_t& fft_size, size_t& hop_size) {
+    const size_t requested_fft = fft_size, requested_hop = hop_size;
+    if (StftEngine::sanitizeConfig(fft_size, hop_size)) return;
+    std::cerr << "[WARN] " << effect << ": fft_size " << requested_fft << " / hop_size " << requested_hop
+              << " is invalid (fft_size must be a power of two >= 16, hop_size must divide it and be <= fft_size / 2). Using "
+              << fft_size << " / " << hop_size << "." << std::endl;
+}
+
+} // namespace
 
 // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↓修正開始◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
 // --- ParametricEQクラスのメソッド実装 ---
 void ParametricEQ::setup(double sr, const json& params) {
     sample_rate_ = sr;
-    filters_l_.clear();
-    filters_r_.clear();
+    sections_.clear();
+    bands_.clear();
+    ramping_ = 0;
 
     if (params.is_object() && !params.empty()) {
         enabled_ = params.value("enabled", true);
         if (params.contains("bands") && params["bands"].is_array()) {
             for (const auto& band_params : params["bands"]) {
-                std::string type = band_params.value("type", "peaking");
-                double freq = band_params.value("freq", 1000.0);
-                double q = band_params.value("q", 1.0);
-                double gain_db = band_params.value("gain_db", 0.0);
-
-                SimpleBiquad filter_l, filter_r;
-                if (type == "peaking") {
-                    filter_l.set_peaking(sr, freq, q, gain_db);
-                    filter_r.set_peaking(sr, freq, q, gain_db);
-                } else if (type == "lowshelf") {
-                    filter_l.set_lowshelf(sr, freq, q, gain_db);
-                    filter_r.set_lowshelf(sr, freq, q, gain_db);
-                } else if (type == "highshelf") {
-                    filter_l.set_highshelf(sr, freq, q, gain_db);
-                    filter_r.set_highshelf(sr, freq, q, gain_db);
-                } else if (type == "hpf") {
-                    filter_l.set_hpf(sr, freq, q);
-                    filter_r.set_hpf(sr, freq, q);
-                } else if (type == "lpf") {
-                    filter_l.set_lpf(sr, freq, q);
-                    filter_r.set_lpf(sr, freq, q);
+                Band band;
+                band.type = band_params.value("type", "peaking");
+                band.freq = band_params.value("freq", 1000.0);
+                band.q = band_params.value("q", 1.0);
+                band.gain_db = band_params.value("gain_db", 0.0);
+
+                // 0dBのピーキング/シェルフも恒等変換の段として確保しておく（オートメーションで処理中に段を増やさない）。
+                // 恒等変換の段は getBiquadCascade() とテール長には含めない。未知のタイプは段を作らない
+                if (isKnownType(band.type)) {
+                    BiquadCoefficients coefficients;    // 既定値は恒等変換
+                    designBand(band, coefficients);
+                    band.section = static_cast<int>(sections_.size());
+                    sections_.push_back(coefficients);
                 }
-                filters_l_.push_back(filter_l);
-                filters_r_.push_back(filter_r);
+                bands_.push_back(band);
             }
         }
     }
-    reset();
+    cascade_.configure(sections_, active_channels_);
+}
+
+bool ParametricEQ::isKnownType(const std::string& type) {
+    return type == "peaking" || type == "lowshelf" || type == "highshelf" || type == "hpf" || type == "lpf";
+}
+
+bool ParametricEQ::isIdentity(const BiquadCoefficients& c) {
+    return c.b0 == 1.0 && c.b1 == 0.0 && c.b2 == 0.0 && c.a1 == 0.0 && c.a2 == 0.0;
+}
+
+bool ParametricEQ::isActive() const {
+    return enabled_ && std::any_of(sections_.begin(), sections_.end(), [](const BiquadCoefficients& c) { return !isIdentity(c); });
+}
+
+bool ParametricEQ::designBand(const Band& band, BiquadCoefficients& coefficients) const {
+    const bool has_gain = (band.type == "peaking" || band.type == "lowshelf" || band.type == "highshelf");
+    if ((has_gain && band.gain_db == 0.0) || !isKnownType(band.type)) {
+        coefficients = BiquadCoefficients();
+        return false;
+    }
+
+    SimpleBiquad filter;
+    if (band.type == "peaking") {
+        filter.set_peaking(sample_rate_, band.freq, band.q, band.gain_db);
+    } else if (band.type == "lowshelf") {
+        filter.set_lowshelf(sample_rate_, band.freq, band.q, band.gain_db);
+    } else if (band.type == "highshelf") {
+        filter.set_highshelf(sample_rate_, band.freq, band.q, band.gain_db);
+    } else if (band.type == "hpf") {
+        filter.set_hpf(sample_rate_, band.freq, band.q);
+    } else {
+        filter.set_lpf(sample_rate_, band.freq, band.q);
+    }
+    coefficients = filter.coefficients();
+    return true;
+}
+
+void ParametricEQ::updateSection(const Band& band) {
+    BiquadCoefficients coefficients;
+    designBand(band, coefficients);
+    sections_[static_cast<size_t>(band.section)] = coefficients;
+    cascade_.setSection(static_cast<size_t>(band.section), coefficients);
+}
+
+bool ParametricEQ::setParameter(const std::string& name, double value, size_t ramp_samples) {
+    const std::string prefix = "bands.";
+    const size_t dot = name.find('.', prefix.size());
+    if (!enabled_ || name.compare(0, prefix.size(), prefix) != 0 || dot == std::string::npos) return false;
+    char* end = nullptr;
+    const unsigned long index = std::strtoul(name.c_str() + prefix.size(), &end, 10);
+    if (end != name.c_str() + dot || index >= bands_.size()) return false;
+
+    Band& band = bands_[index];
+    const std::string field = name.substr(dot + 1);
+    const int slot = (field == "freq") ? 0 : (field == "q") ? 1 : (field == "gain_db") ? 2 : -1;
+    if (slot < 0 || band.section < 0) return false;
+
+    // ランプ中でなければ目標値は現在の値。ランプ中に別の値が来たら、現在の値から新しい目標へランプし直す
+    const std::array<double, 3> current = {band.freq, band.q, band.gain_db};
+    if (band.ramp_position >= band.ramp_length) band.to = current;
+    if (band.to[static_cast<size_t>(slot)] == value) return true;
+    band.to[static_cast<size_t>(slot)] = value;
+
+    const bool was_ramping = band.ramp_position < band.ramp_length;
+    if (ramp_samples == 0) {
+        band.freq = band.to[0];
+        band.q = band.to[1];
+        band.gain_db = band.to[2];
+        band.ramp_length = band.ramp_position = 0;
+        if (was_ramping) --ramping_;
+        updateSection(band);
+        return true;
+    }
+    band.from = current;
+    band.ramp_length = ramp_samples;
+    band.ramp_position = 0;
+    if (!was_ramping) ++ramping_;
+    return true;
+}
+
+void ParametricEQ::advanceRamps(size_t frames) {
+    for (auto& band : bands_) {
+        if (band.ramp_position >= band.ramp_length) continue;
+        band.ramp_position = std::min(band.ramp_position + frames, band.ramp_length);
+        // サブブロック末尾の値で設計する（ランプの最後のサブブロックで目標値に一致する）
+        const double t = static_cast<double>(band.ramp_position) / static_cast<double>(band.ramp_length);
+        band.freq = band.from[0] + (band.to[0] - band.from[0]) * t;
+        band.q = band.from[1] + (band.to[1] - band.from[1]) * t;
+        band.gain_db = band.from[2] + (band.to[2] - band.from[2]) * t;
+        updateSection(band);
+        if (band.ramp_position == band.ramp_length) --ramping_;
+    }
 }
 
 void ParametricEQ::reset() {
-    for(auto& f : filters_l_) f.reset();
-    for(auto& f : filters_r_) f.reset();
+    cascade_.reset();
+    // ランプは目標値で終える（休止中のステージは process() が呼ばれずランプが進まないため）
+    if (ramping_ > 0) advanceRamps(static_cast<size_t>(-1) / 2);
 }
 
-void ParametricEQ::process(std::vector<float>& block, int channels) {
-    if (!enabled_) return;
+size_t ParametricEQ::getTailSamples() const {
+    size_t tail = 0;
+    for (const auto& c : sections_) {
+        if (isIdentity(c)) continue;
+        SimpleBiquad probe;
+        probe.set_coefficients(c);
+        tail = addTails(tail, probe.ring_down_samples());
+    }
+    return tail;
+}
 
-    for (size_t i = 0; i < block.size(); i += channels) {
-        float sample_l = block[i];
-        float sample_r = (channels > 1) ? block[i+1] : sample_l;
+bool ParametricEQ::getBiquadCascade(std::vector<BiquadCoefficients>& sections) const {
+    // LFEを素通しするレイアウトでは全チャンネル共通の縦続にならない
+    if (static_cast<int>(active_channels_.size()) != kernel_.channels()) return false;
+    for (const auto& c : sections_) {
+        if (!isIdentity(c)) sections.push_back(c);
+    }
+    return true;
+}
 
-        for (auto& filter : filters_l_) {
-            sample_l = filter.process(sample_l);
-        }
-        if (channels > 1) {
-            for (auto& filter : filters_r_) {
-                sample_r = filter.process(sample_r);
-            }
-        }
-        
-        block[i] = sample_l;
-        if (channels > 1) {
-            block[i+1] = sample_r;
-        }
+void ParametricEQ::setChannelLayout(const ChannelLayout& layout) {
+    active_channels_ = layout.fullRangeChannels();
+    cascade_.configure(sections_, active_channels_);
+    // 全チャンネルを処理するモノラル/ステレオだけを特殊化し、それ以外（LFEを含むレイアウトなど）は汎用版
+    const bool all = static_cast<int>(active_channels_.size()) == layout.channels();
+    kernel_.select(layout.channels(), all ? &ParametricEQ::processKernel<1> : &ParametricEQ::processKernel<0>,
+                   all ? &ParametricEQ::processKernel<2> : &ParametricEQ::processKernel<0>, &ParametricEQ::processKernel<0>);
+}
+
+template <int Channels>
+void ParametricEQ::processKernel(float* block, size_t frames, int channels) {
+    // フレーム順に全段を通すと、段どうし・チャンネル間の漸化式が独立に進むため並列化される
+    cascade_.process<Channels>(block, frames, kernelChannels<Channels>(channels));
+}
+
+void ParametricEQ::process(std::vector<float>& block, int channels) {
+    if (!enabled_ || channels <= 0) return;
+    if (channels != kernel_.channels()) setChannelCount(channels);
+    if (ramping_ == 0) {
+        kernel_.run(*this, block);
+        return;
+    }
+    // ランプ中は kRampStepFrames ごとに補間した値で係数を設計し直す（状態は保つため、係数の段差は
+    // サブブロックの間隔でしか生じず、ブロック単位の段差によるジッパーノイズにならない）
+    const size_t frames = block.size() / static_cast<size_t>(channels);
+    for (size_t start = 0; start < frames; start += kRampStepFrames) {
+        const size_t step = std::min(kRampStepFrames, frames - start);
+        advanceRamps(step);
+        kernel_.run(*this, block.data() + start * static_cast<size_t>(channels), step);
     }
 }
 // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↑修正終わり◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
@@ -96,145 +226,94 @@ void HarmonicEnhancer::reset() {
     lowpass_.reset();
 }
 
-float HarmonicEnhancer::generateHarmonics(float input) {
-    float processed = 0.0f;
-    float abs_input = std::fabs(input);
-    if (even_harmonics_ > 0) processed += (input * input - abs_input) * even_harmonics_;
-    if (odd_harmonics_ > 0) processed += (std::tanh(input * 1.5f) - input) * odd_harmonics_;
-    return input + processed * drive_;
-}
-
-float HarmonicEnhancer::processSample(float input) {
-    if (!enabled_) return input;
-    float dry_signal = input;
-    input = dc_blocker_.process(input);
-    float wet_signal = generateHarmonics(input);
-    wet_signal = lowpass_.process(wet_signal);
-    return (1.0f - mix_) * dry_signal + mix_ * wet_signal;
+void HarmonicEnhancer::generateHarmonics(float* samples, size_t count) {
+    const float even = static_cast<float>(even_harmonics_);
+    const float odd = static_cast<float>(odd_harmonics_);
+    const float drive = static_cast<float>(drive_);
+    if (odd > 0) {
+        odd_.resize(count);
+        fast_math::fast_tanh_scaled_block(samples, odd_.data(), count, 1.5f);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        float input = samples[i];
+        float processed = 0.0f;
+        if (even > 0) processed += (input * input - std::fabs(input)) * even;
+        if (odd > 0) processed += (odd_[i] - input) * odd;
+        samples[i] = input + processed * drive;
+    }
 }
 
 void HarmonicEnhancer::process(std::vector<float>& block, int channels) {
     if (!enabled_) return;
-    for (size_t i = 0; i < block.size(); ++i) {
-        block[i] = processSample(block[i]);
+    // フィルタ状態はインターリーブされたサンプル列全体で共有する（従来の処理順を維持）
+    const size_t count = block.size();
+    work_.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        work_[i] = dc_blocker_.process(block[i]);
+    }
+    generateHarmonics(work_.data(), count);
+    const float dry_gain = static_cast<float>(1.0 - mix_);
+    const float wet_gain = static_cast<float>(mix_);
+    for (size_t i = 0; i < count; ++i) {
+        float wet_signal = lowpass_.process(work_[i]);
+        block[i] = dry_gain * block[i] + wet_gain * wet_signal;
     }
 }
 
 // --- LinearPhaseEQの実装 ---
 
-LinearPhaseEQ::LinearPhaseEQ()
-    : fft_plan_fwd_L_(nullptr), fft_plan_fwd_R_(nullptr),
-      fft_plan_bwd_L_(nullptr), fft_plan_bwd_R_(nullptr) {}
-
-LinearPhaseEQ::~LinearPhaseEQ() {
-    if (fft_plan_fwd_L_) fftwf_destroy_plan(fft_plan_fwd_L_);
-    if (fft_plan_fwd_R_) fftwf_destroy_plan(fft_plan_fwd_R_);
-    if (fft_plan_bwd_L_) fftwf_destroy_plan(fft_plan_bwd_L_);
-    if (fft_plan_bwd_R_) fftwf_destroy_plan(fft_plan_bwd_R_);
-}
-
 void LinearPhaseEQ::setup(double sr, const json& params) {
     sample_rate_ = sr;
     if (params.is_object()) {
         enabled_ = params.value("enabled", true);
-        fft_size_ = params.value("fft_size", 2048);
-        hop_size_ = params.value("hop_size", fft_size_ / 4);
+        fft_size_ = static_cast<size_t>(std::max(0LL, params.value("fft_size", 2048LL)));
+        hop_size_ = static_cast<size_t>(std::max(0LL, params.value("hop_size", static_cast<long long>(fft_size_ / 4))));
     }
     if (!enabled_) return;
+    warnIfInvalidStft("LinearPhaseEQ", fft_size_, hop_size_);
 
-    if (fft_size_ == 0 || hop_size_ == 0 || fft_size_ < hop_size_) {
-        throw std::runtime_error("Invalid FFT/hop size for LinearPhaseEQ.");
-    }
-
-    // バッファを確保
-    time_domain_buffer_L_.assign(fft_size_, 0.0f);
-    time_domain_buffer_R_.assign(fft_size_, 0.0f);
-    freq_domain_buffer_L_.assign(fft_size_ / 2 + 1, {0.0f, 0.0f});
-    freq_domain_buffer_R_.assign(fft_size_ / 2 + 1, {0.0f, 0.0f});
-    input_buffer_L_.assign(fft_size_, 0.0f);
-    input_buffer_R_.assign(fft_size_, 0.0f);
-    eq_curve_.assign(fft_size_ / 2 + 1, {1.0f, 0.0f});
-    
-    // FFTW plans
-    fft_plan_fwd_L_ = fftwf_plan_dft_r2c_1d(fft_size_, time_domain_buffer_L_.data(), reinterpret_cast<fftwf_complex*>(freq_domain_buffer_L_.data()), FFTW_ESTIMATE);
-    fft_plan_bwd_L_ = fftwf_plan_dft_c2r_1d(fft_size_, reinterpret_cast<fftwf_complex*>(freq_domain_buffer_L_.data()), time_domain_buffer_L_.data(), FFTW_ESTIMATE);
-    fft_plan_fwd_R_ = fftwf_plan_dft_r2c_1d(fft_size_, time_domain_buffer_R_.data(), reinterpret_cast<fftwf_complex*>(freq_domain_buffer_R_.data()), FFTW_ESTIMATE);
-    fft_plan_bwd_R_ = fftwf_plan_dft_c2r_1d(fft_size_, reinterpret_cast<fftwf_complex*>(freq_domain_buffer_R_.data()), time_domain_buffer_R_.data(), FFTW_ESTIMATE);
-
+    eq_curve_.assign(fft_size_ / 2 + 1, 1.0f);
     if (params.contains("bands")) {
         setupEQCurve(params["bands"]);
     }
-    reset();
+    flat_curve_ = std::all_of(eq_curve_.begin(), eq_curve_.end(), [](float g) { return g == 1.0f; });
 }
 
-void LinearPhaseEQ::reset() {
-    channels_ = 0;
-    std::fill(input_buffer_L_.begin(), input_buffer_L_.end(), 0.0f);
-    std::fill(input_buffer_R_.begin(), input_buffer_R_.end(), 0.0f);
+void LinearPhaseEQ::setChannelLayout(const ChannelLayout& layout) {
+    layout_ = layout;
+    // 単独実行用のSTFTはここで確保する（process() では確保しない）
+    if (enabled_) stft_.configure(fft_size_, hop_size_, layout.channels(), sample_rate_);
 }
 
-void LinearPhaseEQ::process(std::vector<float>& block, int channels) {
-    if (!enabled_ || block.empty()) return;
-
-    if (channels_ != channels) {
-        channels_ = channels;
-        reset();
-    }
-
-    size_t num_frames_in = block.size() / channels;
-    size_t frames_processed = 0;
-
-    while (frames_processed < num_frames_in) {
-        size_t frames_to_process_now = std::min(num_frames_in - frames_processed, hop_size_);
-
-        // 1. 入力バッファをシフトし、新しいデータを追加
-        std::move(input_buffer_L_.begin() + frames_to_process_now, input_buffer_L_.end(), input_buffer_L_.begin());
-        if (channels > 1) {
-            std::move(input_buffer_R_.begin() + frames_to_process_now, input_buffer_R_.end(), input_buffer_R_.begin());
-        }
-
-        size_t copy_start_index = fft_size_ - frames_to_process_now;
-        for (size_t i = 0; i < frames_to_process_now; ++i) {
-            input_buffer_L_[copy_start_index + i] = block[(frames_processed + i) * channels];
-            if (channels > 1) {
-                input_buffer_R_[copy_start_index + i] = block[(frames_processed + i) * channels + 1];
-            }
-        }
-        
-        // 2. 入力データを時間領域バッファにコピー（窓関数は適用しない）
-        time_domain_buffer_L_ = input_buffer_L_;
-        if (channels > 1) {
-            time_domain_buffer_R_ = input_buffer_R_;
-        }
-
-        // 3. FFT -> EQ適用 -> IFFT
-        fftwf_execute(fft_plan_fwd_L_);
-        for(size_t i = 0; i < eq_curve_.size(); ++i) freq_domain_buffer_L_[i] *= eq_curve_[i];
-        fftwf_execute(fft_plan_bwd_L_);
+void LinearPhaseEQ::reset() {
+    if (stft_.getChannels() > 0) stft_.reset();
+}
 
-        if(channels > 1) {
-            fftwf_execute(fft_plan_fwd_R_);
-            for(size_t i = 0; i < eq_curve_.size(); ++i) freq_domain_buffer_R_[i] *= eq_curve_[i];
-            fftwf_execute(fft_plan_bwd_R_);
-        }
+StftConfig LinearPhaseEQ::getStftConfig() const {
+    return enabled_ ? StftConfig{fft_size_, hop_size_} : StftConfig{};
+}
 
-        // 4. 結果の有効な部分を出力ブロックに書き戻す (Overlap-Save)
-        float norm_factor = 1.0f / fft_size_; // FFTWのIFFTは正規化されないため、手動で正規化
-        size_t result_start_index = fft_size_ - hop_size_;
-        for (size_t i = 0; i < frames_to_process_now; ++i) {
-            block[(frames_processed + i) * channels] = time_domain_buffer_L_[result_start_index + i] * norm_factor;
-            if (channels > 1) {
-                block[(frames_processed + i) * channels + 1] = time_domain_buffer_R_[result_start_index + i] * norm_factor;
-            }
+void LinearPhaseEQ::processSpectrum(SpectralFrame* frames, size_t count) {
+    if (!enabled_) return;
+    const float* curve = eq_curve_.data();
+    for (size_t f = 0; f < count; ++f) {
+        SpectralFrame& frame = frames[f];
+        for (int c = 0; c < frame.channels; ++c) {
+            if (c < layout_.channels() && layout_.role(c) == ChannelRole::Lfe) continue;
+            std::complex<float>* bins = frame.channel(c);
+            for (size_t k = 0; k < frame.num_bins; ++k) bins[k] *= curve[k];
         }
-
-        frames_processed += frames_to_process_now;
     }
 }
 
+void LinearPhaseEQ::process(std::vector<float>& block, int channels) {
+    // setChannelLayout() で準備していないチャンネル数のブロックは素通しする
+    if (!enabled_ || block.empty() || stft_.getChannels() != channels) return;
+    stft_.process(block, channels, [this](SpectralFrame* frames, size_t count) { processSpectrum(frames, count); });
+}
 
 void LinearPhaseEQ::setupEQCurve(const json& bands) {
-    std::fill(eq_curve_.begin(), eq_curve_.end(), std::complex<float>(1.0f, 0.0f));
+    std::fill(eq_curve_.begin(), eq_curve_.end(), 1.0f);
     if (!bands.is_array()) return;
 
     for (const auto& band_params : bands) {
@@ -277,39 +356,145 @@ void SpectralGate::setup(double sr, const json& params) {
         threshold_db_ = params.value("threshold_db", -60.0);
         attack_ms_ = params.value("attack_ms", 5.0);
         release_ms_ = params.value("release_ms", 100.0);
+        fft_size_ = static_cast<size_t>(std::max(0LL, params.value("fft_size", 2048LL)));
+        hop_size_ = static_cast<size_t>(std::max(0LL, params.value("hop_size", static_cast<long long>(fft_size_ / 4))));
+        noise_margin_db_ = params.value("noise_margin_db", 6.0);
+        reduction_db_ = params.value("reduction_db", -24.0);
+        noise_rise_db_per_sec_ = params.value("noise_rise_db_per_sec", 6.0);
+        smoothing_bins_ = std::max(0, params.value("smoothing_bins", 2));
     }
     if (!enabled_) return;
+    warnIfInvalidStft("SpectralGate", fft_size_, hop_size_);
+
+    // 時定数はフレーム（ホップ）単位の係数に変換する
+    const double frames_per_sec = sr / static_cast<double>(hop_size_);
+    auto frame_coeff = [&](double ms) {
+        double frames = frames_per_sec * ms / 1000.0;
+        return (frames > 0) ? static_cast<float>(std::exp(-1.0 / frames)) : 0.0f;
+    };
+    attack_coeff_ = frame_coeff(attack_ms_);
+    release_coeff_ = frame_coeff(release_ms_);
+    power_smoothing_ = frame_coeff(20.0);
+    noise_smoothing_ = frame_coeff(200.0);
+    noise_rise_ = static_cast<float>(std::pow(10.0, noise_rise_db_per_sec_ / 10.0 / frames_per_sec));
+    margin_power_ = static_cast<float>(std::pow(10.0, noise_margin_db_ / 10.0));
+    threshold_power_ = static_cast<float>(std::pow(10.0, threshold_db_ / 10.0));
+    floor_gain_ = static_cast<float>(db_to_linear(reduction_db_));
+    channels_ = 0;
+}
 
-    double attack_samples = sr * (attack_ms_ / 1000.0);
-    double release_samples = sr * (release_ms_ / 1000.0);
-    attack_coeff_ = (attack_samples > 0) ? std::exp(-1.0 / attack_samples) : 0.0;
-    release_coeff_ = (release_samples > 0) ? std::exp(-1.0 / release_samples) : 0.0;
-    reset();
+bool SpectralGate::setParameter(const std::string& name, double value, size_t ramp_samples) {
+    (void)ramp_samples;
+    if (!enabled_ || name != "threshold_db") return false;
+    threshold_db_ = value;
+    threshold_power_ = static_cast<float>(std::pow(10.0, threshold_db_ / 10.0));
+    return true;
 }
 
-void SpectralGate::reset() {
-    current_gain_ = 0.0f;
+bool SpectralGate::serializeState(StateArchive& ar) {
+    // 状態の大きさは setChannelLayout()（またはフレームのチャンネル数）で決まるため、先に大きさを揃えてから読み込む
+    int channels = channels_;
+    size_t num_bins = num_bins_;
+    ar(channels, num_bins);
+    if (!ar.saving() && ar.ok() && (channels != channels_ || num_bins != num_bins_)) prepareState(channels, num_bins);
+    ar(smoothed_power_, noise_power_, noise_floor_, gains_, smoothed_gain_, stft_);
+    return true;
 }
 
-float SpectralGate::processSample(float input) {
-    if (!enabled_) return input;
+void SpectralGate::prepareState(int channels, size_t num_bins) {
+    channels_ = channels;
+    num_bins_ = num_bins;
+    const size_t state_size = static_cast<size_t>(channels) * num_bins;
+    // フロアは threshold_db から上昇させて実際のノイズ水準に追いつかせる（先頭の音楽をノイズと誤認しないため）
+    const float initial_floor = std::max(threshold_power_, kMinNoisePower);
+    smoothed_power_.assign(state_size, initial_floor);
+    noise_power_.assign(state_size, initial_floor);
+    noise_floor_.assign(state_size, initial_floor);
+    gains_.assign(state_size, 1.0f);
+    target_.assign(num_bins, 1.0f);
+    smoothed_gain_.assign(num_bins, 1.0f);
+}
 
-    float input_level_db = 20.0f * std::log10(std::abs(input) + 1e-12f);
-    float target_gain = (input_level_db > threshold_db_) ? 1.0f : 0.0f;
+void SpectralGate::setChannelLayout(const ChannelLayout& layout) {
+    // 単独実行用のSTFTとビンごとの状態はここで確保する（process() では確保しない）
+    if (!enabled_) return;
+    stft_.configure(fft_size_, hop_size_, layout.channels(), sample_rate_);
+    prepareState(layout.channels(), fft_size_ / 2 + 1);
+}
 
-    if (target_gain > current_gain_) {
-        current_gain_ = attack_coeff_ * current_gain_ + (1.0f - attack_coeff_) * target_gain;
-    } else {
-        current_gain_ = release_coeff_ * current_gain_ + (1.0f - release_coeff_) * target_gain;
-    }
+void SpectralGate::reset() {
+    if (channels_ > 0) prepareState(channels_, num_bins_);
+    if (stft_.getChannels() > 0) stft_.reset();
+}
 
-    current_gain_ = std::max(0.0f, std::min(1.0f, current_gain_));
-    return input * current_gain_;
+StftConfig SpectralGate::getStftConfig() const {
+    return enabled_ ? StftConfig{fft_size_, hop_size_} : StftConfig{};
 }
 
-void SpectralGate::process(std::vector<float>& block, int channels) {
+void SpectralGate::processSpectrum(SpectralFrame* frames, size_t count) {
     if (!enabled_) return;
-    for (size_t i = 0; i < block.size(); ++i) {
-        block[i] = processSample(block[i]);
+    for (size_t f = 0; f < count; ++f) processFrame(frames[f]);
+}
+
+void SpectralGate::processFrame(SpectralFrame& frame) {
+    if (frame.channels != channels_ || frame.num_bins != num_bins_) prepareState(frame.channels, frame.num_bins);
+    const size_t num_bins = frame.num_bins;
+    const float smoothing = power_smoothing_;
+    const float noise_smoothing = noise_smoothing_;
+    const float rise = noise_rise_;
+    const float margin = margin_power_;
+    const float threshold = threshold_power_;
+    const float floor_gain = floor_gain_;
+    const int radius = smoothing_bins_;
+
+    for (int c = 0; c < frame.channels; ++c) {
+        std::complex<float>* bins = frame.channel(c);
+        float* power = smoothed_power_.data() + static_cast<size_t>(c) * num_bins;
+        float* slow_power = noise_power_.data() + static_cast<size_t>(c) * num_bins;
+        float* noise = noise_floor_.data() + static_cast<size_t>(c) * num_bins;
+        float* gain = gains_.data() + static_cast<size_t>(c) * num_bins;
+        float* target = target_.data();
+
+        // 1. パワーの平滑化、最小値追従によるノイズフロア推定、ゲートの開閉判定（分岐なしでベクトル化される）
+        //    フロアは長時間平滑化したパワーの最小値を追う（短時間パワーの揺らぎの谷を拾って過小評価しないため）
+        for (size_t k = 0; k < num_bins; ++k) {
+            float p = bins[k].real() * bins[k].real() + bins[k].imag() * bins[k].imag();
+            float s = smoothing * power[k] + (1.0f - smoothing) * p;
+            power[k] = s;
+            slow_power[k] = noise_smoothing * slow_power[k] + (1.0f - noise_smoothing) * p;
+            noise[k] = std::max(std::min(slow_power[k], noise[k] * rise), kMinNoisePower);
+            bool open = (s > noise[k] * margin) & (s > threshold);
+            target[k] = open ? 1.0f : floor_gain;
+        }
+
+        // 2. ビンごとのアタック（開く方向）/ リリース（閉じる方向）
+        for (size_t k = 0; k < num_bins; ++k) {
+            float coeff = (target[k] > gain[k]) ? attack_coeff_ : release_coeff_;
+            gain[k] = coeff * gain[k] + (1.0f - coeff) * target[k];
+        }
+
+        // 3. 周波数方向の平滑化（半径 radius の移動平均）と適用
+        const float* applied = gain;
+        if (radius > 0) {
+            const int n = static_cast<int>(num_bins);
+            float sum = 0.0f;
+            int count = 0;
+            for (int k = 0; k < std::min(radius, n); ++k) { sum += gain[k]; ++count; }
+            for (int k = 0; k < n; ++k) {
+                int enter = k + radius;
+                int leave = k - radius - 1;
+                if (enter < n) { sum += gain[enter]; ++count; }
+                if (leave >= 0) { sum -= gain[leave]; --count; }
+                smoothed_gain_[k] = sum / static_cast<float>(count);
+            }
+            applied = smoothed_gain_.data();
+        }
+        for (size_t k = 0; k < num_bins; ++k) bins[k] *= applied[k];
     }
-}
\ No newline at end of file
+}
+
+void SpectralGate::process(std::vector<float>& block, int channels) {
+    // setChannelLayout() で準備していないチャンネル数のブロックは素通しする
+    if (!enabled_ || channels == 0 || stft_.getChannels() != channels) return;
+    stft_.process(block, channels, [this](SpectralFrame* frames, size_t count) { processSpectrum(frames, count); });
+}
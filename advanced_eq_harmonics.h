@@ -3,12 +3,15 @@
 #pragma once
 #include "SimpleBiquad.h"
 #include "AudioEffect.h"
+#include "stft_engine.h"
+#include "channel_kernel.h"
+#include "channel_biquad.h"
 #include <vector>
 #include <cmath>
 #include <complex>
 #include <string>
+#include <array>
 #include <nlohmann/json.hpp>
-#include <fftw3.h>
 
 // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↓修正開始◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
 // パラメトリックEQ (IIRフィルタベース)
@@ -17,28 +20,70 @@ public:
     void setup(double sr, const json& params) override;
     void process(std::vector<float>& block, int channels) override;
     void reset() override;
+    void setChannelCount(int channels) override { setChannelLayout(ChannelLayout::defaultFor(channels)); }
+    void setChannelLayout(const ChannelLayout& layout) override;
+    bool isFusable() const override { return true; }
+    bool isActive() const override;
+    size_t getTailSamples() const override;
+    bool getBiquadCascade(std::vector<BiquadCoefficients>& sections) const override;
+    // "bands.<番号>.freq" / "q" / "gain_db"。値は ramp_samples をかけて直線で移し、変わった帯域の段だけを
+    // kRampStepFrames ごとに状態を保ったまま設計し直す
+    bool setParameter(const std::string& name, double value, size_t ramp_samples) override;
+    bool serializeState(StateArchive& ar) override { ar(cascade_); return true; }
     const std::string& getName() const override { return name_; }
 
 private:
     std::string name_ = "parametric_eq";
     bool enabled_ = true;
     double sample_rate_ = 48000.0;
-    
-    // 2チャンネル分のフィルターを保持
-    std::vector<SimpleBiquad> filters_l_;
-    std::vector<SimpleBiquad> filters_r_;
+
+    struct Band {
+        std::string type;
+        double freq = 1000.0, q = 1.0, gain_db = 0.0;   // 現在の値（ランプ中はサブブロックごとに進む）
+        int section = -1;       // sections_ 内の位置（未知のタイプは -1）
+        // オートメーションのランプ（freq, q, gain_db を from から to へ ramp_length サンプルで直線補間する）
+        std::array<double, 3> from{}, to{};
+        size_t ramp_length = 0, ramp_position = 0;     // ramp_position == ramp_length ならランプしていない
+    };
+    std::vector<Band> bands_;
+    size_t ramping_ = 0;        // ランプ中の帯域の数
+    static constexpr size_t kRampStepFrames = 16;   // ランプ中に係数を設計し直す間隔
+
+    // 全帯域チャンネル（LFE以外）に共通の係数と、チャンネルごとの状態
+    std::vector<BiquadCoefficients> sections_;
+    std::vector<int> active_channels_;
+    ChannelBiquadCascade cascade_;
+
+    ChannelKernel<ParametricEQ> kernel_;
+    template <int Channels> void processKernel(float* block, size_t frames, int channels);
+    // 帯域の係数を求める。恒等変換（0dBのピーキング/シェルフ、未知のタイプ）なら恒等変換の係数にして false
+    bool designBand(const Band& band, BiquadCoefficients& coefficients) const;
+    void updateSection(const Band& band);
+    void advanceRamps(size_t frames);
+    static bool isKnownType(const std::string& type);
+    static bool isIdentity(const BiquadCoefficients& c);
 };
 // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↑修正終わり◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
 
 // 線形位相EQ（FFTベース）
+// STFTの各ビンに実数（ゼロ位相）のゲインカーブを掛けるため、位相はSTFTの遅延分だけ一様にずれる
 class LinearPhaseEQ : public AudioEffect {
 public:
-    LinearPhaseEQ();
-    ~LinearPhaseEQ() override;
     void setup(double sr, const json& params) override;
     void process(std::vector<float>& block, int channels) override;
     void reset() override;
+    bool isActive() const override { return enabled_ && !flat_curve_; }
+    // LFEのスペクトルにはカーブを掛けない。単独実行用のSTFTもここで準備する
+    void setChannelLayout(const ChannelLayout& layout) override;
+    void setChannelCount(int channels) override { setChannelLayout(ChannelLayout::defaultFor(channels)); }
+    // 最後の入力サンプルを含むフレームが合成し終わるまで（遅延 fft_size + フレーム長 fft_size）
+    size_t getTailSamples() const override { return 2 * fft_size_; }
+    size_t getLatencySamples() const override { return fft_size_; }
+    // チェーンのスペクトルセグメントで実行する場合、STFTの状態はチェーン側にある
+    bool serializeState(StateArchive& ar) override { ar(stft_); return true; }
     const std::string& getName() const override { return name_; }
+    StftConfig getStftConfig() const override;
+    void processSpectrum(SpectralFrame* frames, size_t count) override;
 
 private:
     // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↓修正開始◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
@@ -48,25 +93,14 @@ private:
     size_t fft_size_ = 2048;
     size_t hop_size_ = 512;
     bool enabled_ = true;
-    int channels_ = 0;
-
-    // 左右チャンネル用のFFTプランとバッファ
-    fftwf_plan fft_plan_fwd_L_, fft_plan_fwd_R_;
-    fftwf_plan fft_plan_bwd_L_, fft_plan_bwd_R_;
-
-    std::vector<float> window_;
-
-    // 処理に使用するバッファ
-    std::vector<float> time_domain_buffer_L_, time_domain_buffer_R_;
-    std::vector<std::complex<float>> freq_domain_buffer_L_, freq_domain_buffer_R_;
 
-    // EQカーブ
-    std::vector<std::complex<float>> eq_curve_;
+    // EQカーブ（ビンごとの実数ゲイン）
+    std::vector<float> eq_curve_;
+    bool flat_curve_ = false;          // すべてのビンのゲインが1（恒等変換）
+    ChannelLayout layout_;             // 未設定（単独実行）のときは全チャンネルに掛ける
 
-    // Overlap-Add法のための入出力バッファ
-    std::vector<float> input_buffer_L_, input_buffer_R_;
-    std::vector<float> output_buffer_L_, output_buffer_R_;
-    size_t input_buffer_write_pos_ = 0;
+    // チェーンのスペクトルセグメント外で単独実行するときのSTFT
+    StftEngine stft_;
 
     void setupEQCurve(const json& bands);
     void applyEQBand(double freq, double gain_db, double q, const std::string& type);
@@ -78,6 +112,10 @@ public:
     void setup(double sr, const json& params) override;
     void process(std::vector<float>& block, int channels) override;
     void reset() override;
+    bool isFusable() const override { return true; }
+    bool isActive() const override { return enabled_ && mix_ != 0.0; }
+    size_t getTailSamples() const override { return addTails(dc_blocker_.ring_down_samples(), lowpass_.ring_down_samples()); }
+    bool serializeState(StateArchive& ar) override { ar(dc_blocker_, lowpass_); return true; }
     const std::string& getName() const override { return name_; }
 
 private:
@@ -92,18 +130,32 @@ private:
     double mix_ = 0.25;
 
     SimpleBiquad dc_blocker_, lowpass_;
+    std::vector<float> work_, odd_;  // ブロック処理用の作業バッファ
 
-    float generateHarmonics(float input);
-    float processSample(float sample);
+    void generateHarmonics(float* samples, size_t count);
 };
 
 // スペクトラルゲート（ノイズ除去）
+// STFTのビンごとにノイズフロアを推定し、フロア + noise_margin_db を下回るビン
+// （または threshold_db を下回るビン）を reduction_db まで減衰させる。
+// ゲインはビンごとのアタック/リリースで時間方向に、近傍ビンの平均で周波数方向に平滑化する。
 class SpectralGate : public AudioEffect {
 public:
     void setup(double sr, const json& params) override;
     void process(std::vector<float>& block, int channels) override;
     void reset() override;
+    bool isActive() const override { return enabled_; }
+    // 単独実行用のSTFTとビンごとの状態を準備する
+    void setChannelLayout(const ChannelLayout& layout) override;
+    void setChannelCount(int channels) override { setChannelLayout(ChannelLayout::defaultFor(channels)); }
+    size_t getTailSamples() const override { return 2 * fft_size_; }
+    size_t getLatencySamples() const override { return fft_size_; }
+    // "threshold_db"（次のSTFTフレームから反映する）
+    bool setParameter(const std::string& name, double value, size_t ramp_samples) override;
+    bool serializeState(StateArchive& ar) override;
     const std::string& getName() const override { return name_; }
+    StftConfig getStftConfig() const override;
+    void processSpectrum(SpectralFrame* frames, size_t count) override;
 
 private:
     // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↓修正開始◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
@@ -111,13 +163,40 @@ private:
     // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↑修正終わり◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
     double sample_rate_ = 44100.0;
     bool enabled_ = false;
-    double threshold_db_ = -60.0;
+    double threshold_db_ = -60.0;      // これより小さいビンは常にゲートを閉じる（ビンの振幅はdBFS換算）
     double attack_ms_ = 5.0;
     double release_ms_ = 100.0;
-
-    float current_gain_ = 0.0f;
-    double attack_coeff_ = 0.0;
-    double release_coeff_ = 0.0;
-
-    float processSample(float sample);
+    size_t fft_size_ = 2048;
+    size_t hop_size_ = 512;
+    double noise_margin_db_ = 6.0;     // ノイズフロアからこれだけ上回ればゲートを開く
+    double reduction_db_ = -24.0;      // ゲートを閉じたときのゲイン
+    double noise_rise_db_per_sec_ = 6.0; // ノイズフロア推定の上昇速度（定常音はこの速度でノイズと見なされていく）
+    int smoothing_bins_ = 2;           // 周波数方向の平滑化半径（ビン数）
+
+    static constexpr float kMinNoisePower = 1e-20f;  // フロアが0に張り付くと上昇できなくなるための下限
+
+    // フレーム単位の係数
+    float attack_coeff_ = 0.0f;
+    float release_coeff_ = 0.0f;
+    float power_smoothing_ = 0.0f;     // ゲート判定用のパワー平滑化（20ms）
+    float noise_smoothing_ = 0.0f;     // ノイズフロア推定用のパワー平滑化（200ms）
+    float noise_rise_ = 1.0f;
+    float margin_power_ = 1.0f;
+    float threshold_power_ = 0.0f;
+    float floor_gain_ = 0.0f;
+
+    StftEngine stft_;                  // チェーンのスペクトルセグメント外で単独実行するときのSTFT
+    int channels_ = 0;
+    size_t num_bins_ = 0;
+
+    // チャンネルごとの状態（channels * bins）
+    std::vector<float> smoothed_power_;
+    std::vector<float> noise_power_;
+    std::vector<float> noise_floor_;
+    std::vector<float> gains_;
+    std::vector<float> target_;         // 1チャンネル分の作業バッファ
+    std::vector<float> smoothed_gain_;
+
+    void prepareState(int channels, size_t num_bins);
+    void processFrame(SpectralFrame& frame);
 };
\ No newline at end of file
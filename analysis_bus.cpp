@@ -0,0 +1,182 @@
+// ./analysis_bus.cpp
+#include "analysis_bus.h"
+#include <algorithm>
+#include <iostream>
+
+bool AnalysisRequest::sameFeature(const AnalysisRequest& other) const {
+    return detector == other.detector && signal == other.signal && low_freq == other.low_freq &&
+           high_freq == other.high_freq && q == other.q && attack_ms == other.attack_ms && release_ms == other.release_ms;
+}
+
+// --- EnvelopeDetectorの実装 ---
+
+void EnvelopeDetector::setup(double sr, const AnalysisRequest& request, const ChannelLayout& layout) {
+    request_ = request;
+    sample_rate_ = sr;
+    use_highpass_ = request.low_freq > 0.0;
+    use_lowpass_ = request.high_freq > 0.0 && request.high_freq < sr * 0.45;
+    auto coeff = [sr](double ms) { return (ms > 0.0) ? static_cast<float>(std::exp(-1.0 / (sr * ms / 1000.0))) : 0.0f; };
+    attack_coeff_ = coeff(request.attack_ms);
+    release_coeff_ = coeff(request.release_ms);
+    front_ = layout.frontPair();
+    lanes_.assign((request.signal == AnalysisSignal::Channels) ? static_cast<size_t>(layout.channels()) : 1, Lane{});
+    configureFilters();
+}
+
+void EnvelopeDetector::configureFilters() {
+    for (auto& lane : lanes_) {
+        if (use_highpass_) lane.highpass.set_hpf(sample_rate_, request_.low_freq, request_.q);
+        if (use_lowpass_) lane.lowpass.set_lpf(sample_rate_, request_.high_freq, request_.q);
+    }
+}
+
+void EnvelopeDetector::reset() {
+    for (auto& lane : lanes_) {
+        lane.highpass.reset();
+        lane.lowpass.reset();
+        lane.envelope = 0.0f;
+    }
+}
+
+void EnvelopeDetector::process(const float* input, int channels, size_t frames, float* out, size_t out_stride) {
+    const bool rms = request_.detector == AnalysisDetector::Rms;
+    const bool has_front = front_.first >= 0 && front_.second < channels;
+    const int front_l = front_.first, front_r = front_.second;
+    for (size_t l = 0; l < lanes_.size(); ++l) {
+        Lane& lane = lanes_[l];
+        float* lane_out = out + l * out_stride;
+
+        // 1. 検波する信号を取り出す（分岐なしの連続アクセスでベクトル化される）
+        switch (request_.signal) {
+        case AnalysisSignal::Channels:
+            for (size_t i = 0; i < frames; ++i) lane_out[i] = input[i * channels + l];
+            break;
+        case AnalysisSignal::Mid: {
+            if (has_front) {
+                for (size_t i = 0; i < frames; ++i) {
+                    lane_out[i] = (input[i * channels + front_l] + input[i * channels + front_r]) * 0.5f;
+                }
+                break;
+            }
+            const float scale = 1.0f / static_cast<float>(channels);
+            for (size_t i = 0; i < frames; ++i) {
+                float sum = 0.0f;
+                for (int c = 0; c < channels; ++c) sum += input[i * channels + c];
+                lane_out[i] = sum * scale;
+            }
+            break;
+        }
+        case AnalysisSignal::Side:
+            if (!has_front) {
+                std::fill(lane_out, lane_out + frames, 0.0f);
+            } else {
+                for (size_t i = 0; i < frames; ++i) {
+                    lane_out[i] = (input[i * channels + front_l] - input[i * channels + front_r]) * 0.5f;
+                }
+            }
+            break;
+        }
+
+        // 2. 帯域制限（漸化式なので逐次）
+        if (use_highpass_) {
+            for (size_t i = 0; i < frames; ++i) lane_out[i] = lane.highpass.process(lane_out[i]);
+        }
+        if (use_lowpass_) {
+            for (size_t i = 0; i < frames; ++i) lane_out[i] = lane.lowpass.process(lane_out[i]);
+        }
+
+        // 3. 整流（ベクトル化される）
+        if (rms) {
+            for (size_t i = 0; i < frames; ++i) lane_out[i] *= lane_out[i];
+        } else {
+            for (size_t i = 0; i < frames; ++i) lane_out[i] = std::fabs(lane_out[i]);
+        }
+
+        // 4. アタック/リリース追従（漸化式なので逐次。係数の選択は分岐なし）
+        float e = lane.envelope;
+        for (size_t i = 0; i < frames; ++i) {
+            float level = lane_out[i];
+            float coeff = (level > e) ? attack_coeff_ : release_coeff_;
+            e = coeff * e + (1.0f - coeff) * level;
+            lane_out[i] = e;
+        }
+        lane.envelope = e;
+
+        if (rms) {
+            for (size_t i = 0; i < frames; ++i) lane_out[i] = std::sqrt(lane_out[i]);
+        }
+    }
+}
+
+// --- AnalysisBusの実装 ---
+
+void AnalysisBus::configure(const ChannelLayout& layout, double sr, size_t max_block_frames) {
+    layout_ = layout;
+    channels_ = layout.channels();
+    sample_rate_ = sr;
+    max_block_frames_ = max_block_frames;
+    current_position_ = 0;
+    read_offset_ = 0;
+    num_requests_ = 0;
+    effect_names_.clear();
+    features_.clear();
+}
+
+void AnalysisBus::beginEffect(size_t position, const std::string& name) {
+    current_position_ = position;
+    if (effect_names_.size() <= position) effect_names_.resize(position + 1);
+    effect_names_[position] = name;
+}
+
+size_t AnalysisBus::resolveTap(const std::string& source) const {
+    if (source.empty()) return current_position_;
+    if (source == "input") return 0;
+    // 自分より前にある最も近い同名エフェクトの出力
+    for (size_t p = current_position_; p-- > 0;) {
+        if (effect_names_[p] == source) return p + 1;
+    }
+    std::cerr << "[WARN] AnalysisBus: sidechain source '" << source << "' is not an effect before '"
+              << effect_names_[current_position_] << "'. Using its own input." << std::endl;
+    return current_position_;
+}
+
+AnalysisBus::Handle AnalysisBus::request(const AnalysisRequest& request) {
+    ++num_requests_;
+    const size_t tap = resolveTap(request.source);
+    for (size_t i = 0; i < features_.size(); ++i) {
+        if (features_[i].tap == tap && features_[i].request.sameFeature(request)) return static_cast<Handle>(i);
+    }
+
+    Feature feature;
+    feature.tap = tap;
+    feature.request = request;
+    feature.detector.setup(sample_rate_, request, layout_);
+    feature.stride = max_block_frames_;
+    feature.data.assign(static_cast<size_t>(feature.detector.outputChannels()) * feature.stride, 0.0f);
+    features_.push_back(std::move(feature));
+    return static_cast<Handle>(features_.size() - 1);
+}
+
+bool AnalysisBus::hasTap(size_t position) const {
+    return std::any_of(features_.begin(), features_.end(), [position](const Feature& f) { return f.tap == position; });
+}
+
+void AnalysisBus::compute(size_t position, const std::vector<float>& block) {
+    if (channels_ <= 0) return;
+    // 特徴量のバッファは configure() の最大ブロック長で確保済み（処理中に拡張しない）。
+    // EffectChain はそれより長いブロックを分けて渡す
+    const size_t frames = std::min(block.size() / static_cast<size_t>(channels_), max_block_frames_);
+    read_offset_ = 0;
+    for (auto& feature : features_) {
+        if (feature.tap != position) continue;
+        feature.detector.process(block.data(), channels_, frames, feature.data.data(), feature.stride);
+    }
+}
+
+void AnalysisBus::reset() {
+    for (auto& feature : features_) {
+        feature.detector.reset();
+        std::fill(feature.data.begin(), feature.data.end(), 0.0f);
+    }
+    read_offset_ = 0;
+}
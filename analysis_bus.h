@@ -0,0 +1,137 @@
+// ./analysis_bus.h
+// エフェクトチェーンで共有するサイドチェーン解析バス（帯域エンベロープ・ピーク・RMS・M/Sレベル）
+#pragma once
+
+#include "SimpleBiquad.h"
+#include "channel_layout.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// 検波方式
+enum class AnalysisDetector {
+    Peak,   // |x| のアタック/リリース追従
+    Rms     // x² のアタック/リリース追従の平方根
+};
+
+// 検波する信号
+enum class AnalysisSignal {
+    Channels,   // チャンネルごと（出力はチャンネル数分）
+    Mid,        // フロントL/Rの平均（L/Rがないレイアウトでは全チャンネルの平均。出力は1系統）
+    Side        // フロントの (L - R) / 2（出力は1系統、L/Rがないレイアウトでは0）
+};
+
+/**
+ * @brief エフェクトが要求する解析特徴量
+ *
+ * source 以外のフィールドがすべて等しく、同じ位置（タップ）を参照する要求は1つの特徴量にまとめられる。
+ */
+struct AnalysisRequest {
+    AnalysisDetector detector = AnalysisDetector::Peak;
+    AnalysisSignal signal = AnalysisSignal::Channels;
+    double low_freq = 0.0;      // > 0 のとき2次HPFで帯域を制限
+    double high_freq = 0.0;     // > 0 かつナイキストの0.45倍未満のとき2次LPFで帯域を制限
+    double q = 0.707;           // 帯域制限フィルタのQ
+    double attack_ms = 10.0;
+    double release_ms = 100.0;
+    std::string source;         // "" = 要求したエフェクトの入力, "input" = チェーンの入力, エフェクト名 = そのエフェクトの出力
+
+    bool sameFeature(const AnalysisRequest& other) const;
+};
+
+/**
+ * @brief 1つの解析特徴量をブロック単位で計算する検波器
+ *
+ * アナリシスバスと、バスに接続されずに単独で実行されるエフェクトの両方で使うため、
+ * どちらで実行しても同じ値になる。
+ */
+class EnvelopeDetector {
+public:
+    void setup(double sr, const AnalysisRequest& request, const ChannelLayout& layout);
+    void reset();
+    void serializeState(StateArchive& ar) { ar(lanes_); }
+    int outputChannels() const { return static_cast<int>(lanes_.size()); }
+
+    /**
+     * @brief インターリーブ形式の入力から特徴量を計算する
+     * @param out 出力系統 l のフレーム i を out[l * out_stride + i] に書き込む
+     */
+    void process(const float* input, int channels, size_t frames, float* out, size_t out_stride);
+
+private:
+    struct Lane {
+        SimpleBiquad highpass, lowpass;
+        float envelope = 0.0f;
+        void serializeState(StateArchive& ar) { ar(highpass, lowpass, envelope); }
+    };
+
+    AnalysisRequest request_;
+    double sample_rate_ = 44100.0;
+    bool use_highpass_ = false, use_lowpass_ = false;
+    float attack_coeff_ = 0.0f, release_coeff_ = 0.0f;
+    std::pair<int, int> front_{-1, -1};     // Mid/Side を作るフロントの L/R
+    std::vector<Lane> lanes_;
+
+    void configureFilters();
+};
+
+/**
+ * @brief エフェクトチェーンの解析バス
+ *
+ * 各エフェクトが declareAnalysis() で要求した特徴量を、チェーン上の位置（タップ）ごとに
+ * ブロックあたり1回だけ計算し、読み取り専用で公開する。タップ i はチェーンの i 番目の
+ * エフェクトの入力（タップ 0 はチェーンの入力）を表す。同じ特徴量を要求したエフェクトは
+ * 1つの計算結果を共有し、source を指定すれば前段の信号をサイドチェーンとして使える。
+ * 途中にスペクトルセグメントを挟むタップを参照した場合、その遅延分は補償されない。
+ */
+class AnalysisBus {
+public:
+    typedef int Handle;
+    static constexpr Handle kInvalidHandle = -1;
+
+    // 登録済みの特徴量をすべて破棄し、チャンネルのレイアウトと最大ブロック長を設定する
+    void configure(const ChannelLayout& layout, double sr, size_t max_block_frames);
+    // チェーンが position 番目のエフェクトの declareAnalysis() を呼ぶ前に呼ぶ
+    void beginEffect(size_t position, const std::string& name);
+    // 現在のエフェクトの要求を登録する（同じ特徴量が登録済みならそのハンドルを返す）
+    Handle request(const AnalysisRequest& request);
+
+    bool hasTap(size_t position) const;
+    // タップ position の特徴量をブロック全体について計算する（ブロックは configure() の最大ブロック長以下）
+    void compute(size_t position, const std::vector<float>& block);
+    void reset();
+    // 検波器の状態（特徴量の値はブロックごとに計算し直すので含めない）
+    void serializeState(StateArchive& ar) { ar(features_); }
+
+    // 融合ループのタイル処理中は、読み出し位置をタイル先頭のフレームに合わせる
+    void setReadOffset(size_t frames) { read_offset_ = frames; }
+    // 現在のブロック（タイル）の特徴量。channel は Channels 信号のときのみ意味を持つ
+    const float* read(Handle handle, int channel = 0) const {
+        const Feature& feature = features_[static_cast<size_t>(handle)];
+        return feature.data.data() + static_cast<size_t>(channel) * feature.stride + read_offset_;
+    }
+    size_t numFeatures() const { return features_.size(); }
+    size_t numRequests() const { return num_requests_; }
+
+private:
+    struct Feature {
+        size_t tap = 0;
+        AnalysisRequest request;
+        EnvelopeDetector detector;
+        std::vector<float> data;    // 出力系統ごとに stride フレーム
+        size_t stride = 0;
+        void serializeState(StateArchive& ar) { ar(detector); }
+    };
+
+    ChannelLayout layout_;
+    int channels_ = 0;
+    double sample_rate_ = 44100.0;
+    size_t max_block_frames_ = 0;
+    size_t current_position_ = 0;
+    size_t read_offset_ = 0;
+    size_t num_requests_ = 0;
+    std::vector<std::string> effect_names_;     // position 番目のエフェクト名（source の解決用）
+    std::vector<Feature> features_;
+
+    size_t resolveTap(const std::string& source) const;
+};
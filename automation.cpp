@@ -0,0 +1,110 @@
+// ./automation.cpp
+#include "automation.h"
+#include <iostream>
+#include <algorithm>
+
+bool AutomationEnvelope::parse(const json& points) {
+    points_.clear();
+    if (!points.is_array() || points.empty()) return false;
+    for (const auto& point : points) {
+        if (!point.is_array() || point.size() != 2 || !point[0].is_number() || !point[1].is_number()) return false;
+        points_.emplace_back(point[0].get<double>(), point[1].get<double>());
+    }
+    std::stable_sort(points_.begin(), points_.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    return true;
+}
+
+double AutomationEnvelope::valueAt(double seconds) const {
+    if (points_.empty()) return 0.0;
+    if (seconds <= points_.front().first) return points_.front().second;
+    if (seconds >= points_.back().first) return points_.back().second;
+    // seconds より後の最初の点と、その直前の点の間を補間する
+    const auto next = std::upper_bound(points_.begin(), points_.end(), seconds,
+                                       [](double t, const auto& point) { return t < point.first; });
+    const auto prev = next - 1;
+    const double span = next->first - prev->first;
+    if (span <= 0.0) return next->second;
+    const double ratio = (seconds - prev->first) / span;
+    return prev->second + (next->second - prev->second) * ratio;
+}
+
+void AutomationLanes::load(const json& automation) {
+    lanes_.clear();
+    if (automation.is_null()) return;
+    if (!automation.is_object()) {
+        std::cerr << "[WARN] AutomationLanes: 'automation' must be an object of \"<effect>.<param>\" lanes." << std::endl;
+        return;
+    }
+    for (auto it = automation.begin(); it != automation.end(); ++it) {
+        Lane lane;
+        lane.key = it.key();
+        const size_t dot = lane.key.find('.');
+        if (dot == std::string::npos || dot == 0 || dot + 1 == lane.key.size() || !lane.envelope.parse(it.value())) {
+            std::cerr << "[WARN] AutomationLanes: Lane '" << lane.key << "' needs a \"<effect>.<param>\" key and [[seconds, value], ...] breakpoints. Skipping." << std::endl;
+            continue;
+        }
+        lane.effect_name = lane.key.substr(0, dot);
+        lane.parameter = lane.key.substr(dot + 1);
+        lanes_.push_back(std::move(lane));
+    }
+}
+
+void AutomationLanes::bind(const std::vector<std::unique_ptr<AudioEffect>>& effects, double sr) {
+    std::vector<std::pair<std::string, AudioEffect*>> targets;
+    for (const auto& effect : effects) targets.emplace_back(effect->getName(), effect.get());
+    bind(targets, sr);
+}
+
+void AutomationLanes::bind(const std::vector<std::pair<std::string, AudioEffect*>>& targets, double sr) {
+    sample_rate_ = sr;
+    std::vector<Lane> bound;
+    for (auto& lane : lanes_) {
+        for (const auto& target : targets) {
+            if (target.first == lane.effect_name) {
+                lane.effect = target.second;
+                break;
+            }
+        }
+        if (!lane.effect) {
+            std::cerr << "[WARN] AutomationLanes: No effect '" << lane.effect_name << "' in the chain for lane '" << lane.key << "'. Skipping." << std::endl;
+            continue;
+        }
+        lane.value = lane.envelope.valueAt(0.0);
+        if (!lane.effect->setParameter(lane.parameter, lane.value, 0)) {
+            std::cerr << "[WARN] AutomationLanes: '" << lane.key << "' cannot be automated (unknown parameter or disabled effect). Skipping." << std::endl;
+            continue;
+        }
+        bound.push_back(std::move(lane));
+    }
+    lanes_.swap(bound);
+}
+
+bool AutomationLanes::automates(const AudioEffect* effect) const {
+    for (const auto& lane : lanes_) {
+        if (lane.effect == effect) return true;
+    }
+    return false;
+}
+
+bool AutomationLanes::apply(uint64_t start_frame, size_t frames) {
+    if (lanes_.empty() || frames == 0) return false;
+    const double end_time = static_cast<double>(start_frame + frames) / sample_rate_;
+    bool changed = false;
+    for (auto& lane : lanes_) {
+        const double value = lane.envelope.valueAt(end_time);
+        if (value == lane.value) continue;
+        lane.value = value;
+        lane.effect->setParameter(lane.parameter, value, frames);
+        changed = true;
+    }
+    return changed;
+}
+
+void AutomationLanes::jump(uint64_t frame) {
+    if (lanes_.empty()) return;
+    const double time = static_cast<double>(frame) / sample_rate_;
+    for (auto& lane : lanes_) {
+        lane.value = lane.envelope.valueAt(time);
+        lane.effect->setParameter(lane.parameter, lane.value, 0);
+    }
+}
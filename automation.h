@@ -0,0 +1,81 @@
+// ./automation.h
+// 曲の時刻に合わせてエフェクトのパラメータを動かすオートメーション・レーン
+#pragma once
+
+#include "AudioEffect.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+/**
+ * @class AutomationEnvelope
+ * @brief ブレークポイント（時刻[秒], 値）を直線で結んだエンベロープ
+ *
+ * 最初の点より前は最初の値、最後の点より後は最後の値を保つ。
+ */
+class AutomationEnvelope {
+public:
+    // [[秒, 値], ...] を読み込む（時刻順に並べ替える）。形式が誤っていれば false
+    bool parse(const json& points);
+    double valueAt(double seconds) const;
+    size_t size() const { return points_.size(); }
+
+private:
+    std::vector<std::pair<double, double>> points_;
+};
+
+/**
+ * @class AutomationLanes
+ * @brief params.json の "automation" に書いたレーンを、チェーンのエフェクトに適用する
+ *
+ *   "automation": {
+ *     "exciter.mix": [[0, 0.18], [32.0, 0.18], [34.0, 0.3]],
+ *     "parametric_eq.bands.3.gain_db": [[0, 1.5], [60, 3.0]]
+ *   }
+ *
+ * キーは "<エフェクト名>.<パラメータ名>"（パラメータ名は AudioEffect::setParameter() の名前）。
+ * effect_graph では "<ノードの id>.<パラメータ名>" と書く（id にない名前はエフェクト名で探す）。
+ * "automation" にはJSONファイル（サイドカー）のパスも書ける（RealtimeAudioEngine が読み込む）。
+ *
+ * レーンはブロック（制御レート）ごとにブロック末尾の時刻で評価し、値が変わったときだけ
+ * setParameter() を呼んでブロックの長さでランプさせる。ブレークポイントの間は直線なので、
+ * ブロック境界での値は正確に一致し、ブロック内はエフェクトがサンプルごとに補間する。
+ */
+class AutomationLanes {
+public:
+    // "automation" のオブジェクトを読み込む（誤ったレーンは警告して外す）
+    void load(const json& automation);
+
+    /**
+     * @brief レーンをエフェクト名で結び付け、時刻0の値を設定する
+     *
+     * 対応するエフェクトがない、またはパラメータを変更できないレーンは警告して外す。
+     */
+    void bind(const std::vector<std::unique_ptr<AudioEffect>>& effects, double sr);
+    // 名前を指定して結び付ける（effect_graph ではノードの id。先に並んだものを優先する）
+    void bind(const std::vector<std::pair<std::string, AudioEffect*>>& targets, double sr);
+
+    bool empty() const { return lanes_.empty(); }
+    size_t numLanes() const { return lanes_.size(); }
+    bool automates(const AudioEffect* effect) const;
+
+    // start_frame から frames フレームのブロックを処理する前に呼ぶ。いずれかの値が変われば true
+    bool apply(uint64_t start_frame, size_t frames);
+
+    // 再生位置を移したときに、その時刻の値へランプなしで移る
+    void jump(uint64_t frame);
+
+private:
+    struct Lane {
+        std::string key;                // "<エフェクト名>.<パラメータ名>"
+        std::string effect_name;
+        std::string parameter;
+        AutomationEnvelope envelope;
+        AudioEffect* effect = nullptr;
+        double value = 0.0;             // 最後に設定した値
+    };
+    std::vector<Lane> lanes_;
+    double sample_rate_ = 0.0;
+};
@@ -0,0 +1,291 @@
+// ./benchmark.cpp
+#include "benchmark.h"
+#include "fast_math.h"
+#include "advanced_eq_harmonics.h"
+#include "advanced_dynamics.h"
+#include "stft_engine.h"
+#include "vocal_instrument_separator.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <algorithm>
+
+namespace {
+
+// 最適化で計算が消されないように結果を畳み込んでおく
+volatile float g_sink = 0.0f;
+
+struct AccuracyResult {
+    double max_error = 0.0;
+    double worst_input = 0.0;
+};
+
+// [lo, hi] を等間隔に走査して誤差の最大値を求める（relative=true なら相対誤差）
+AccuracyResult scanError(const std::function<float(float)>& approx, const std::function<double(double)>& reference,
+                         double lo, double hi, bool relative, size_t steps = 2000000) {
+    AccuracyResult result;
+    for (size_t i = 0; i <= steps; ++i) {
+        double x = lo + (hi - lo) * static_cast<double>(i) / static_cast<double>(steps);
+        float xf = static_cast<float>(x);
+        double expected = reference(xf);
+        double error = std::fabs(static_cast<double>(approx(xf)) - expected);
+        if (relative) error /= std::max(std::fabs(expected), 1e-30);
+        if (error > result.max_error) {
+            result.max_error = error;
+            result.worst_input = xf;
+        }
+    }
+    return result;
+}
+
+// 1要素あたりのナノ秒を測定する
+double measureNsPerElement(const std::function<void(const float*, float*, size_t)>& kernel,
+                           const std::vector<float>& input, int repeats) {
+    std::vector<float> output(input.size());
+    kernel(input.data(), output.data(), input.size()); // ウォームアップ
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        kernel(input.data(), output.data(), input.size());
+        g_sink = g_sink + output[r % output.size()];
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return elapsed / (static_cast<double>(input.size()) * repeats);
+}
+
+bool reportAccuracy(const std::string& label, const AccuracyResult& result, double bound, bool relative) {
+    bool ok = result.max_error <= bound;
+    std::cout << "  " << std::left << std::setw(22) << label
+              << (relative ? "rel " : "abs ") << std::scientific << std::setprecision(2) << result.max_error
+              << " (bound " << bound << ", worst x=" << std::defaultfloat << std::setprecision(6) << result.worst_input << ")"
+              << (ok ? "" : "  ** EXCEEDS BOUND **") << std::endl;
+    return ok;
+}
+
+bool benchmarkFastMathAccuracy() {
+    std::cout << "[fast_math accuracy vs libm (double)]" << std::endl;
+    bool ok = true;
+    ok &= reportAccuracy("fast_exp2", scanError([](float x) { return fast_math::fast_exp2(x); },
+                                                [](double x) { return std::exp2(x); }, -126.0, 126.0, true), 2.5e-7, true);
+    // log2 の上限は |log2 x| に比例する丸め項を含むため、仮数の1周期と広い範囲を分けて確認する
+    ok &= reportAccuracy("fast_log2 [0.5,2]", scanError([](float x) { return fast_math::fast_log2(x); },
+                                                        [](double x) { return std::log2(x); }, 0.5, 2.0, false), 1.5e-7 + 2.0 / 16777216.0, false);
+    ok &= reportAccuracy("fast_log2 [1e-6,1e6]", scanError([](float x) { return fast_math::fast_log2(x); },
+                                                           [](double x) { return std::log2(x); }, 1e-6, 1e6, false), 1.5e-7 + 20.0 / 16777216.0, false);
+    ok &= reportAccuracy("fast_tanh", scanError([](float x) { return fast_math::fast_tanh(x); },
+                                                [](double x) { return std::tanh(x); }, -12.0, 12.0, false), 2e-7, false);
+    ok &= reportAccuracy("fast_db_to_linear", scanError([](float x) { return fast_math::fast_db_to_linear(x); },
+                                                        [](double x) { return std::pow(10.0, x / 20.0); }, -120.0, 24.0, true), 2.5e-7 + 120.0 * 4e-8, true);
+    ok &= reportAccuracy("fast_linear_to_db", scanError([](float x) { return fast_math::fast_linear_to_db(x); },
+                                                        [](double x) { return 20.0 * std::log10(x); }, 1e-6, 16.0, false), 1e-6 + 120.0 * 6e-8, false);
+
+    // SIMD版がスカラー版と一致することも確認する
+    std::vector<float> in(4099), scalar(in.size()), simd(in.size());
+    for (size_t i = 0; i < in.size(); ++i) in[i] = -10.0f + 20.0f * static_cast<float>(i) / static_cast<float>(in.size());
+    fast_math::fast_tanh_block(in.data(), simd.data(), in.size());
+    double max_diff = 0.0;
+    for (size_t i = 0; i < in.size(); ++i) {
+        max_diff = std::max(max_diff, static_cast<double>(std::fabs(simd[i] - fast_math::fast_tanh(in[i]))));
+    }
+    std::cout << "  SIMD vs scalar tanh  max diff " << std::scientific << max_diff << std::defaultfloat << std::endl;
+    ok &= max_diff < 1e-6;
+    return ok;
+}
+
+void benchmarkFastMathThroughput() {
+    std::cout << "[fast_math throughput, ns/sample (block of 4096, lower is better)]" << std::endl;
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> audio_dist(-1.5f, 1.5f);
+    std::uniform_real_distribution<float> db_dist(-60.0f, 6.0f);
+    std::vector<float> audio(4096), db(4096), positive(4096);
+    for (size_t i = 0; i < audio.size(); ++i) {
+        audio[i] = audio_dist(rng);
+        db[i] = db_dist(rng);
+        positive[i] = std::fabs(audio[i]) + 1e-3f;
+    }
+    const int repeats = 2000;
+
+    auto row = [&](const std::string& label, double libm_ns, double fast_ns) {
+        std::cout << "  " << std::left << std::setw(18) << label << std::fixed << std::setprecision(3)
+                  << "libm " << libm_ns << "  fast " << fast_ns << "  speedup x" << std::setprecision(1)
+                  << (libm_ns / fast_ns) << std::defaultfloat << std::endl;
+    };
+
+    row("tanh",
+        measureNsPerElement([](const float* in, float* out, size_t n) { for (size_t i = 0; i < n; ++i) out[i] = std::tanh(in[i]); }, audio, repeats),
+        measureNsPerElement(fast_math::fast_tanh_block, audio, repeats));
+    row("exp2",
+        measureNsPerElement([](const float* in, float* out, size_t n) { for (size_t i = 0; i < n; ++i) out[i] = std::exp2(in[i]); }, audio, repeats),
+        measureNsPerElement(fast_math::fast_exp2_block, audio, repeats));
+    row("log2",
+        measureNsPerElement([](const float* in, float* out, size_t n) { for (size_t i = 0; i < n; ++i) out[i] = std::log2(in[i]); }, positive, repeats),
+        measureNsPerElement(fast_math::fast_log2_block, positive, repeats));
+    row("db_to_linear",
+        measureNsPerElement([](const float* in, float* out, size_t n) { for (size_t i = 0; i < n; ++i) out[i] = std::pow(10.0f, in[i] / 20.0f); }, db, repeats),
+        measureNsPerElement(fast_math::fast_db_to_linear_block, db, repeats));
+    row("linear_to_db",
+        measureNsPerElement([](const float* in, float* out, size_t n) { for (size_t i = 0; i < n; ++i) out[i] = 20.0f * std::log10(in[i]); }, positive, repeats),
+        measureNsPerElement(fast_math::fast_linear_to_db_block, positive, repeats));
+}
+
+// 1ブロックあたりの処理時間を測り、ブロック長（実時間）に対する割合を予算と比較する
+void benchmarkBlockBudget(const std::string& label, const std::function<void(std::vector<float>&)>& process_block,
+                          double sample_rate, size_t block_frames, int channels, double budget_fraction) {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    const size_t num_blocks = std::max<size_t>(64, static_cast<size_t>(sample_rate * 5.0) / block_frames);
+    std::vector<std::vector<float>> blocks(num_blocks, std::vector<float>(block_frames * channels));
+    for (auto& block : blocks) {
+        for (auto& sample : block) sample = noise(rng);
+    }
+
+    double total_us = 0.0;
+    double worst_us = 0.0;
+    for (auto& block : blocks) {
+        auto start = std::chrono::steady_clock::now();
+        process_block(block);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        total_us += us;
+        worst_us = std::max(worst_us, us);
+    }
+    const double block_us = 1e6 * static_cast<double>(block_frames) / sample_rate;
+    const double budget_us = block_us * budget_fraction;
+    const double average_us = total_us / static_cast<double>(num_blocks);
+    std::cout << "  " << std::left << std::setw(34) << label << std::fixed << std::setprecision(1)
+              << "avg " << average_us << " us  worst " << worst_us << " us  budget " << budget_us << " us ("
+              << std::setprecision(0) << budget_fraction * 100.0 << "% of " << std::setprecision(1) << block_us << " us block)"
+              << (worst_us <= budget_us ? "" : "  ** OVER BUDGET **") << std::defaultfloat << std::endl;
+}
+
+void benchmarkEffects(double sample_rate, size_t block_frames) {
+    std::cout << "[effect processing time per block (" << block_frames << " frames, stereo, " << sample_rate << " Hz)]" << std::endl;
+    const int channels = 2;
+    const json gate_params = {{"enabled", true}};
+    const json eq_params = {{"enabled", true}, {"bands", json::array({json{{"type", "peaking"}, {"freq", 500.0}, {"q", 1.0}, {"gain_db", -2.0}}})}};
+
+    SpectralGate gate;
+    gate.setup(sample_rate, gate_params);
+    gate.setChannelCount(channels);
+    benchmarkBlockBudget("spectral_gate", [&](std::vector<float>& block) { gate.process(block, channels); },
+                         sample_rate, block_frames, channels, 0.10);
+
+    MSVocalInstrumentSeparator separator;
+    separator.setup(sample_rate, json{{"enabled", true}, {"mode", "spectral"}});
+    separator.setChannelCount(channels);
+    benchmarkBlockBudget("ms_separator (spectral)", [&](std::vector<float>& block) { separator.process(block, channels); },
+                         sample_rate, block_frames, channels, 0.05);
+
+    // 同じSTFT設定の2エフェクト: 個別実行（FFT/IFFTが2組）とスペクトルセグメント（1組）の比較
+    SpectralGate gate_a, gate_b;
+    LinearPhaseEQ eq_a, eq_b;
+    gate_a.setup(sample_rate, gate_params);
+    gate_b.setup(sample_rate, gate_params);
+    eq_a.setup(sample_rate, eq_params);
+    eq_b.setup(sample_rate, eq_params);
+    gate_a.setChannelCount(channels);
+    eq_a.setChannelCount(channels);
+    benchmarkBlockBudget("gate + linear_phase_eq (separate)", [&](std::vector<float>& block) {
+        gate_a.process(block, channels);
+        eq_a.process(block, channels);
+    }, sample_rate, block_frames, channels, 0.20);
+
+    StftEngine segment;
+    const StftConfig config = gate_b.getStftConfig();
+    segment.configure(config.fft_size, config.hop_size, channels, sample_rate, block_frames);
+    benchmarkBlockBudget("gate + linear_phase_eq (segment)", [&](std::vector<float>& block) {
+        segment.process(block, channels, [&](SpectralFrame* frames, size_t count) {
+            gate_b.processSpectrum(frames, count);
+            eq_b.processSpectrum(frames, count);
+        });
+    }, sample_rate, block_frames, channels, 0.20);
+
+    // params.json の既定の3帯域: 元のレートで処理した場合と、帯域0をマルチレート処理した場合の比較
+    const json mbc_bands = json::array({
+        json{{"freq_low", 20.0}, {"freq_high", 250.0}, {"threshold_db", -12.0}, {"ratio", 1.8}, {"attack_ms", 15.0}, {"release_ms", 80.0}, {"makeup_gain_db", 1.0}},
+        json{{"freq_low", 250.0}, {"freq_high", 2500.0}, {"threshold_db", -10.0}, {"ratio", 2.5}, {"attack_ms", 8.0}, {"release_ms", 120.0}, {"makeup_gain_db", 0.5}},
+        json{{"freq_low", 2500.0}, {"freq_high", 20000.0}, {"threshold_db", -15.0}, {"ratio", 3.0}, {"attack_ms", 5.0}, {"release_ms", 150.0}, {"makeup_gain_db", 1.5}}});
+    for (bool multirate : {false, true}) {
+        MultibandCompressor compressor;
+        compressor.setup(sample_rate, json{{"enabled", true}, {"multirate", multirate}, {"bands", mbc_bands}});
+        compressor.setChannelCount(channels);
+        benchmarkBlockBudget(multirate ? "multiband_compressor (multirate)" : "multiband_compressor (full rate)",
+                             [&](std::vector<float>& block) { compressor.process(block, channels); },
+                             sample_rate, block_frames, channels, 0.10);
+    }
+}
+
+// チェーン全体の処理時間と、1つ目のチェーンに対する処理時間の差・出力の差（遅延を揃えて比較する）
+void benchmarkChains(const std::vector<BenchmarkChain>& chains, double sample_rate, size_t block_frames) {
+    if (chains.empty()) return;
+    const int channels = 2;
+    std::cout << "[full chain processing time per block (params.json, " << block_frames << " frames, stereo, " << sample_rate << " Hz)]" << std::endl;
+    for (const auto& chain : chains) {
+        benchmarkBlockBudget(chain.label, chain.process, sample_rate, block_frames, channels, 0.50);
+    }
+    if (chains.size() < 2) return;
+
+    // 同じ信号（低域の強い雑音と80Hzの正弦波）を各チェーンにブロックごとに交互に通し、処理時間と出力を比べる。
+    // 交互に測るのは、CPUのクロックや他のプロセスによる変動を両方のチェーンに等しく掛けるため
+    const size_t num_blocks = std::max<size_t>(64, static_cast<size_t>(sample_rate * 5.0) / block_frames);
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    std::vector<std::vector<float>> inputs(num_blocks, std::vector<float>(block_frames * channels));
+    float low = 0.0f;
+    size_t frame = 0;
+    for (auto& block : inputs) {
+        for (size_t i = 0; i < block_frames; ++i, ++frame) {
+            low = 0.995f * low + 0.1f * noise(rng);
+            const float tone = 0.1f * static_cast<float>(std::sin(2.0 * M_PI * 80.0 * static_cast<double>(frame) / sample_rate));
+            for (int c = 0; c < channels; ++c) block[i * channels + c] = low + tone + noise(rng);
+        }
+    }
+    std::vector<std::vector<float>> outputs(chains.size());
+    std::vector<double> total_us(chains.size(), 0.0);
+    std::vector<float> block;
+    for (size_t b = 0; b < num_blocks; ++b) {
+        for (size_t j = 0; j < chains.size(); ++j) {
+            const size_t k = (b + j) % chains.size();   // 先に処理するチェーンをブロックごとに入れ替える
+            block = inputs[b];
+            auto start = std::chrono::steady_clock::now();
+            chains[k].process(block);
+            total_us[k] += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            outputs[k].insert(outputs[k].end(), block.begin(), block.end());
+        }
+    }
+    const size_t skip = static_cast<size_t>(sample_rate * 0.5) * channels;   // 状態の違いが消えるまで
+    const double reference_us = total_us[0] / static_cast<double>(num_blocks);
+    for (size_t k = 1; k < chains.size(); ++k) {
+        const std::vector<float>& reference = outputs[0];
+        const std::vector<float>& output = outputs[k];
+        // output[n + shift] が reference[n] に対応する（shift は遅延の差）
+        const long long shift = (static_cast<long long>(chains[k].latency_samples) - static_cast<long long>(chains[0].latency_samples)) * channels;
+        double max_deviation = 0.0, peak = 0.0;
+        for (size_t n = skip; n < reference.size(); ++n) {
+            const long long m = static_cast<long long>(n) + shift;
+            if (m < 0 || m >= static_cast<long long>(output.size())) continue;
+            max_deviation = std::max(max_deviation, std::fabs(static_cast<double>(output[static_cast<size_t>(m)]) - reference[n]));
+            peak = std::max(peak, std::fabs(static_cast<double>(reference[n])));
+        }
+        const double average_us = total_us[k] / static_cast<double>(num_blocks);
+        std::cout << "  " << chains[k].label << " vs " << chains[0].label << " (interleaved): " << std::fixed << std::setprecision(1)
+                  << average_us << " us vs " << reference_us << " us per block, saving " << reference_us - average_us << " us ("
+                  << 100.0 * (reference_us - average_us) / reference_us << "%); max deviation "
+                  << (max_deviation > 0.0 ? 20.0 * std::log10(max_deviation) : -INFINITY) << " dBFS (output peak "
+                  << (peak > 0.0 ? 20.0 * std::log10(peak) : -INFINITY) << " dBFS)" << std::defaultfloat << std::endl;
+    }
+}
+
+} // namespace
+
+int runBenchmarks(double sample_rate, size_t block_frames, const std::vector<BenchmarkChain>& chains) {
+    bool ok = benchmarkFastMathAccuracy();
+    benchmarkFastMathThroughput();
+    benchmarkEffects(sample_rate, block_frames);
+    benchmarkChains(chains, sample_rate, block_frames);
+    std::cout << (ok ? "[INFO] All accuracy checks passed." : "[ERROR] Some accuracy checks exceeded their bounds.") << std::endl;
+    return ok ? 0 : 1;
+}
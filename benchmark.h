@@ -0,0 +1,26 @@
+// ./benchmark.h
+// 性能測定モード（realtime_enhancer --bench）
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief ベンチマークで測るチェーン（main.cpp で params.json から構築した EffectChain を渡す）
+ */
+struct BenchmarkChain {
+    std::string label;
+    std::function<void(std::vector<float>&)> process;  // インターリーブのブロックをその場で処理する
+    size_t latency_samples = 0;                          // 出力の比較で遅延を揃えるため
+};
+
+/**
+ * @brief ベンチマークを実行して結果を標準出力に表示する
+ * @param sample_rate エフェクトの処理時間を測るときのサンプリングレート
+ * @param block_frames 1ブロックのフレーム数（リアルタイム処理の予算の単位）
+ * @param chains ステレオのチェーン。処理時間を測り、2つ目以降は1つ目との出力の差も表示する
+ * @return 終了コード（精度が文書化した誤差上限を超えた場合は 1）
+ */
+int runBenchmarks(double sample_rate, size_t block_frames, const std::vector<BenchmarkChain>& chains = {});
@@ -0,0 +1,101 @@
+// ./channel_biquad.h
+// 全チャンネル共通の係数を持つバイクアッドの縦続を、チャンネル方向にSIMD化して処理する
+#pragma once
+#include "SimpleBiquad.h"
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+
+/**
+ * @class ChannelBiquadCascade
+ * @brief 複数のチャンネルを同じ係数のバイクアッド縦続に通す（5.1/7.1を含む任意のチャンネル数）
+ *
+ * 状態を段ごとにチャンネル方向の連続配列（SoA）で持ち、フレームごとに全チャンネルを1本の
+ * ループで更新する。チャンネル間の漸化式は独立なのでSIMDレーンに並び、CPU負荷はチャンネル数に
+ * 対して線形（レーン数までは一定）になる。各段の演算と非有限値の扱いは SimpleBiquad::process と
+ * 同じ（double で計算し、段ごとに float へ丸める）ため、チャンネルごとに SimpleBiquad を通した
+ * 場合と同じ結果になる。
+ */
+class ChannelBiquadCascade {
+public:
+    // sections を channels に並んだチャンネル（インターリーブ内の位置）に掛ける
+    void configure(const std::vector<BiquadCoefficients>& sections, const std::vector<int>& channels) {
+        sections_ = sections;
+        channels_ = channels;
+        z1_.assign(sections_.size() * channels_.size(), 0.0);
+        z2_.assign(sections_.size() * channels_.size(), 0.0);
+        lanes_.assign(channels_.size(), 0.0f);
+    }
+
+    void reset() {
+        std::fill(z1_.begin(), z1_.end(), 0.0);
+        std::fill(z2_.begin(), z2_.end(), 0.0);
+    }
+
+    // 段 s の係数だけを差し替える（状態は保つ）
+    void setSection(size_t s, const BiquadCoefficients& c) { sections_[s] = c; }
+
+    // 段を position の位置に挿入する（新しい段の状態は0、他の段の状態は保つ）
+    void insertSection(size_t position, const BiquadCoefficients& c) {
+        const auto offset = static_cast<std::ptrdiff_t>(position * channels_.size());
+        sections_.insert(sections_.begin() + static_cast<std::ptrdiff_t>(position), c);
+        z1_.insert(z1_.begin() + offset, channels_.size(), 0.0);
+        z2_.insert(z2_.begin() + offset, channels_.size(), 0.0);
+    }
+
+    size_t numSections() const { return sections_.size(); }
+    void serializeState(StateArchive& ar) { ar(z1_, z2_); }
+    size_t numChannels() const { return channels_.size(); }
+
+    /**
+     * @brief インターリーブ形式のブロックをインプレースで処理する
+     * @tparam Lanes > 0 のときはチャンネル数をコンパイル時定数とし、チャンネル k をレーン k とする
+     *               （全チャンネルを処理する構成でのみ使う）。0 は configure() のチャンネル並びを使う
+     * @param stride インターリーブのチャンネル数
+     */
+    template <int Lanes = 0>
+    void process(float* block, size_t frames, int stride) {
+        const size_t lanes = (Lanes > 0) ? static_cast<size_t>(Lanes) : channels_.size();
+        if (lanes == 0 || sections_.empty()) return;
+        float local[(Lanes > 0) ? Lanes : 1];
+        float* x = (Lanes > 0) ? local : lanes_.data();
+        const int* map = channels_.data();
+
+        for (size_t i = 0; i < frames; ++i) {
+            float* frame = block + i * static_cast<size_t>(stride);
+            for (size_t k = 0; k < lanes; ++k) x[k] = frame[(Lanes > 0) ? static_cast<int>(k) : map[k]];
+
+            for (size_t s = 0; s < sections_.size(); ++s) {
+                const double b0 = sections_[s].b0, b1 = sections_[s].b1, b2 = sections_[s].b2;
+                const double a1 = sections_[s].a1, a2 = sections_[s].a2;
+                double* z1 = z1_.data() + s * lanes;
+                double* z2 = z2_.data() + s * lanes;
+                // 非有限の入力は素通しして状態を保ち、非有限の状態は0に戻してから計算する（分岐なしの選択）
+                for (size_t k = 0; k < lanes; ++k) {
+                    const float input = x[k];
+                    const bool input_ok = std::fabs(input) <= FLT_MAX;
+                    const bool state_ok = std::fabs(z1[k]) <= DBL_MAX && std::fabs(z2[k]) <= DBL_MAX;
+                    const double in = input_ok ? static_cast<double>(input) : 0.0;
+                    const double s1 = state_ok ? z1[k] : 0.0;
+                    const double s2 = state_ok ? z2[k] : 0.0;
+                    const double out = b0 * in + s1;
+                    const double n1 = b1 * in - a1 * out + s2;
+                    const double n2 = b2 * in - a2 * out;
+                    z1[k] = input_ok ? n1 : z1[k];
+                    z2[k] = input_ok ? n2 : z2[k];
+                    x[k] = input_ok ? static_cast<float>(out) : input;
+                }
+            }
+
+            for (size_t k = 0; k < lanes; ++k) frame[(Lanes > 0) ? static_cast<int>(k) : map[k]] = x[k];
+        }
+    }
+
+private:
+    std::vector<BiquadCoefficients> sections_;
+    std::vector<int> channels_;         // レーン k が処理するチャンネル
+    std::vector<double> z1_, z2_;       // 段 s・レーン k の状態を [s * レーン数 + k] に置く
+    std::vector<float> lanes_;          // 1フレーム分のレーン（汎用版の作業領域）
+};
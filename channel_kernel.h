@@ -0,0 +1,45 @@
+// ./channel_kernel.h
+// チャンネル数で特殊化したエフェクトカーネルの選択
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @brief カーネル内で使うチャンネル数
+ *
+ * カーネルは template <int Channels> のメンバ関数として書く。Channels が 1（モノラル）または
+ * 2（ステレオ）のときはコンパイル時定数になり、内側ループのチャンネル分岐とストライド計算が
+ * 畳み込まれて分岐なしでベクトル化される。Channels == 0 は実行時のチャンネル数を使う汎用版。
+ */
+template <int Channels>
+constexpr int kernelChannels(int runtime_channels) { return (Channels > 0) ? Channels : runtime_channels; }
+
+/**
+ * @brief チャンネル数ごとに特殊化したカーネルを1回だけ選び、保持する
+ *
+ * エフェクトは setChannelCount() で select() を呼び、process() では run() で呼び出す。
+ * process() はチャンネル数が変わったときだけ選び直すので、単独で実行しても動作する。
+ */
+template <class Effect>
+class ChannelKernel {
+public:
+    typedef void (Effect::*Function)(float* block, size_t frames, int channels);
+
+    void select(int channels, Function mono, Function stereo, Function generic) {
+        channels_ = channels;
+        function_ = (channels == 1) ? mono : (channels == 2) ? stereo : generic;
+    }
+
+    int channels() const { return channels_; }
+
+    void run(Effect& effect, std::vector<float>& block) const {
+        (effect.*function_)(block.data(), block.size() / static_cast<size_t>(channels_), channels_);
+    }
+    // ブロックの一部（frames フレーム）だけを処理する
+    void run(Effect& effect, float* block, size_t frames) const { (effect.*function_)(block, frames, channels_); }
+
+private:
+    Function function_ = nullptr;
+    int channels_ = 0;
+};
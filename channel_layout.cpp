@@ -0,0 +1,105 @@
+// ./channel_layout.cpp
+#include "channel_layout.h"
+#include <iostream>
+#include <algorithm>
+
+namespace {
+
+const std::pair<ChannelRole, const char*> kRoleNames[] = {
+    {ChannelRole::Mono, "M"},
+    {ChannelRole::Left, "L"},
+    {ChannelRole::Right, "R"},
+    {ChannelRole::Center, "C"},
+    {ChannelRole::Lfe, "LFE"},
+    {ChannelRole::SurroundLeft, "Ls"},
+    {ChannelRole::SurroundRight, "Rs"},
+    {ChannelRole::BackLeft, "Lb"},
+    {ChannelRole::BackRight, "Rb"},
+    {ChannelRole::Other, "X"},
+};
+
+int findRole(const std::vector<ChannelRole>& roles, ChannelRole role) {
+    for (size_t c = 0; c < roles.size(); ++c) {
+        if (roles[c] == role) return static_cast<int>(c);
+    }
+    return -1;
+}
+
+} // namespace
+
+ChannelLayout::ChannelLayout(std::vector<ChannelRole> roles) : roles_(std::move(roles)) {
+    for (int c = 0; c < channels(); ++c) {
+        if (roles_[static_cast<size_t>(c)] != ChannelRole::Lfe) full_range_.push_back(c);
+    }
+    const std::pair<ChannelRole, ChannelRole> pair_roles[] = {
+        {ChannelRole::Left, ChannelRole::Right},
+        {ChannelRole::SurroundLeft, ChannelRole::SurroundRight},
+        {ChannelRole::BackLeft, ChannelRole::BackRight},
+    };
+    for (const auto& roles : pair_roles) {
+        int left = findRole(roles_, roles.first);
+        int right = findRole(roles_, roles.second);
+        if (left >= 0 && right >= 0) pairs_.emplace_back(left, right);
+    }
+    if (!pairs_.empty() && roles_[static_cast<size_t>(pairs_.front().first)] == ChannelRole::Left) front_ = pairs_.front();
+}
+
+ChannelLayout ChannelLayout::defaultFor(int channels) {
+    using R = ChannelRole;
+    switch (channels) {
+    case 1: return ChannelLayout({R::Mono});
+    case 2: return ChannelLayout({R::Left, R::Right});
+    case 3: return ChannelLayout({R::Left, R::Right, R::Center});
+    case 4: return ChannelLayout({R::Left, R::Right, R::SurroundLeft, R::SurroundRight});
+    case 5: return ChannelLayout({R::Left, R::Right, R::Center, R::SurroundLeft, R::SurroundRight});
+    case 6: return ChannelLayout({R::Left, R::Right, R::Center, R::Lfe, R::SurroundLeft, R::SurroundRight});
+    case 8: return ChannelLayout({R::Left, R::Right, R::Center, R::Lfe, R::BackLeft, R::BackRight, R::SurroundLeft, R::SurroundRight});
+    default: break;
+    }
+    std::vector<ChannelRole> roles(static_cast<size_t>(std::max(channels, 0)), R::Other);
+    if (channels >= 2) {
+        roles[0] = R::Left;
+        roles[1] = R::Right;
+    }
+    return ChannelLayout(std::move(roles));
+}
+
+ChannelLayout ChannelLayout::fromJson(const json& value, int channels) {
+    if (value.is_null() || (value.is_string() && value.get<std::string>() == "auto")) return defaultFor(channels);
+    if (!value.is_array() || static_cast<int>(value.size()) != channels) {
+        std::cerr << "[WARN] ChannelLayout: 'channel_layout' must be \"auto\" or an array of " << channels
+                  << " role names. Using the default layout." << std::endl;
+        return defaultFor(channels);
+    }
+    std::vector<ChannelRole> roles;
+    for (const auto& entry : value) {
+        const std::string name = entry.is_string() ? entry.get<std::string>() : std::string();
+        bool found = false;
+        for (const auto& role : kRoleNames) {
+            if (name == role.second) {
+                roles.push_back(role.first);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            std::cerr << "[WARN] ChannelLayout: Unknown channel role '" << name
+                      << "' (available: M, L, R, C, LFE, Ls, Rs, Lb, Rb, X). Using the default layout." << std::endl;
+            return defaultFor(channels);
+        }
+    }
+    return ChannelLayout(std::move(roles));
+}
+
+const char* ChannelLayout::roleName(ChannelRole role) {
+    for (const auto& entry : kRoleNames) {
+        if (entry.first == role) return entry.second;
+    }
+    return "X";
+}
+
+std::string ChannelLayout::describe() const {
+    std::string text;
+    for (ChannelRole role : roles_) text += (text.empty() ? "" : " ") + std::string(roleName(role));
+    return text;
+}
@@ -0,0 +1,62 @@
+// ./channel_layout.h
+// チャンネルの役割（L/R/C/LFE/サラウンド）とマルチチャンネルのレイアウト
+#pragma once
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// チャンネルの役割
+enum class ChannelRole {
+    Mono,           // "M"   モノラル
+    Left,           // "L"   フロント左
+    Right,          // "R"   フロント右
+    Center,         // "C"   センター
+    Lfe,            // "LFE" 低域効果（全帯域チャンネルではない）
+    SurroundLeft,   // "Ls"  サイド（サラウンド）左
+    SurroundRight,  // "Rs"  サイド（サラウンド）右
+    BackLeft,       // "Lb"  バック左
+    BackRight,      // "Rb"  バック右
+    Other           // "X"   その他（全帯域として扱う）
+};
+
+/**
+ * @brief チャンネルごとの役割と、エフェクトが使う派生情報（全帯域チャンネル、左右の組）
+ *
+ * 既定のレイアウトはWAVのチャンネル順に従う:
+ *   1ch: M / 2ch: L R / 3ch: L R C / 4ch: L R Ls Rs / 5ch: L R C Ls Rs /
+ *   6ch (5.1): L R C LFE Ls Rs / 8ch (7.1): L R C LFE Lb Rb Ls Rs / それ以外: L R X ...
+ * params.json の "channel_layout" に役割名の配列を指定すると、ファイルごとの並びに合わせられる。
+ */
+class ChannelLayout {
+public:
+    ChannelLayout() = default;
+    explicit ChannelLayout(std::vector<ChannelRole> roles);
+
+    static ChannelLayout defaultFor(int channels);
+    // "auto" または役割名の配列。チャンネル数が合わない・未知の名前がある場合は警告して既定のレイアウトを使う
+    static ChannelLayout fromJson(const json& value, int channels);
+
+    int channels() const { return static_cast<int>(roles_.size()); }
+    ChannelRole role(int channel) const { return roles_[static_cast<size_t>(channel)]; }
+    // LFE以外のチャンネル（音色系のエフェクトが処理する）
+    const std::vector<int>& fullRangeChannels() const { return full_range_; }
+    // 左右の組（L/R, Ls/Rs, Lb/Rb の順）。ステレオ幅やM/S処理は組ごとに行う
+    const std::vector<std::pair<int, int>>& stereoPairs() const { return pairs_; }
+    // フロントの L/R（なければ {-1, -1}）
+    std::pair<int, int> frontPair() const { return front_; }
+    bool hasLfe() const { return static_cast<int>(full_range_.size()) != channels(); }
+
+    // "L R C LFE Ls Rs" のような表記
+    std::string describe() const;
+    static const char* roleName(ChannelRole role);
+
+private:
+    std::vector<ChannelRole> roles_;
+    std::vector<int> full_range_;
+    std::vector<std::pair<int, int>> pairs_;
+    std::pair<int, int> front_{-1, -1};
+};
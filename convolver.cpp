@@ -0,0 +1,494 @@
+// ./convolver.cpp
+// 非一様分割畳み込みコンボルバーの実装
+#include "convolver.h"
+#include "AudioDecoderFactory.h"
+#include "SimpleBiquad.h"
+#include "realtime_scheduling.h"
+#include <samplerate.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+
+namespace {
+// 2のべき乗に切り上げる
+size_t nextPowerOfTwo(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+// ブロック長は min_block〜max_block の2のべき乗に切り上げる（変えた場合は警告する）
+size_t sanitizeBlock(const char* key, long long requested, size_t min_block, size_t max_block) {
+    const size_t clamped = std::min(max_block, std::max(min_block, static_cast<size_t>(std::max(0LL, requested))));
+    const size_t block = nextPowerOfTwo(clamped);
+    if (requested < 0 || static_cast<size_t>(requested) != block) {
+        std::cerr << "[WARN] Convolver: " << key << " " << requested << " must be a power of two in [" << min_block << ", "
+                  << max_block << "]. Using " << block << "." << std::endl;
+    }
+    return block;
+}
+
+constexpr size_t kMinBlock = 64;
+constexpr size_t kMaxBlock = 65536;
+constexpr int kMaxWorkerThreads = 16;
+}
+
+// --- UniformPartitionedConvolutionの実装 ---
+
+void UniformPartitionedConvolution::init(size_t block_size, const std::vector<std::vector<float>>& ir, size_t offset, size_t num_partitions) {
+    block_size_ = block_size;
+    fft_size_ = block_size * 2;
+    num_bins_ = block_size + 1;
+    num_partitions_ = num_partitions;
+    ir_channels_ = static_cast<int>(ir.size());
+
+    time_buffer_.assign(fft_size_, 0.0f);
+    freq_buffer_.assign(num_bins_, {0.0f, 0.0f});
+    accumulator_.assign(num_bins_, {0.0f, 0.0f});
+
+    fwd_plan_ = FFTPlanRegistry::getInstance().getForward(fft_size_);
+    bwd_plan_ = FFTPlanRegistry::getInstance().getInverse(fft_size_);
+    auto* freq = reinterpret_cast<fftwf_complex*>(freq_buffer_.data());
+
+    // 各分割をゼロパディングしてFFTし、IFFTの正規化係数 1/(2N) を含めて保持する
+    const float norm = 1.0f / static_cast<float>(fft_size_);
+    ir_spectra_.assign(ir_channels_, std::vector<std::complex<float>>(num_partitions_ * num_bins_));
+    for (int ch = 0; ch < ir_channels_; ++ch) {
+        const std::vector<float>& taps = ir[ch];
+        for (size_t p = 0; p < num_partitions_; ++p) {
+            std::fill(time_buffer_.begin(), time_buffer_.end(), 0.0f);
+            size_t start = offset + p * block_size_;
+            for (size_t i = 0; i < block_size_ && start + i < taps.size(); ++i) {
+                time_buffer_[i] = taps[start + i] * norm;
+            }
+            fftwf_execute_dft_r2c(fwd_plan_, time_buffer_.data(), freq);
+            std::copy(freq_buffer_.begin(), freq_buffer_.end(), ir_spectra_[ch].begin() + p * num_bins_);
+        }
+    }
+    channel_states_.clear();
+}
+
+void UniformPartitionedConvolution::prepareChannels(int channels) {
+    channel_states_.resize(channels);
+    for (auto& state : channel_states_) {
+        state.input_window.assign(fft_size_, 0.0f);
+        state.fdl.assign(num_partitions_ * num_bins_, {0.0f, 0.0f});
+        state.fdl_pos = 0;
+    }
+}
+
+void UniformPartitionedConvolution::reset() {
+    for (auto& state : channel_states_) {
+        std::fill(state.input_window.begin(), state.input_window.end(), 0.0f);
+        std::fill(state.fdl.begin(), state.fdl.end(), std::complex<float>(0.0f, 0.0f));
+        state.fdl_pos = 0;
+    }
+}
+
+void UniformPartitionedConvolution::processBlock(const float* input, float* output) {
+    for (size_t c = 0; c < channel_states_.size(); ++c) {
+        ChannelState& state = channel_states_[c];
+        const float* in = input + c * block_size_;
+        float* out = output + c * block_size_;
+
+        // 1. 入力窓を1ブロック進めて順方向FFT、結果をFDLの現在位置へ格納
+        std::copy(state.input_window.begin() + block_size_, state.input_window.end(), state.input_window.begin());
+        std::copy(in, in + block_size_, state.input_window.begin() + block_size_);
+        fftwf_execute_dft_r2c(fwd_plan_, state.input_window.data(), reinterpret_cast<fftwf_complex*>(freq_buffer_.data()));
+        std::copy(freq_buffer_.begin(), freq_buffer_.end(), state.fdl.begin() + state.fdl_pos * num_bins_);
+
+        // 2. 周波数領域で各分割との積和を取る（std::complexの乗算は遅いので実部・虚部を展開）
+        std::fill(accumulator_.begin(), accumulator_.end(), std::complex<float>(0.0f, 0.0f));
+        float* acc = reinterpret_cast<float*>(accumulator_.data());
+        const std::vector<std::complex<float>>& spectra = ir_spectra_[c % ir_channels_];
+        for (size_t p = 0; p < num_partitions_; ++p) {
+            size_t slot = (state.fdl_pos + num_partitions_ - p) % num_partitions_;
+            const float* x = reinterpret_cast<const float*>(state.fdl.data() + slot * num_bins_);
+            const float* h = reinterpret_cast<const float*>(spectra.data() + p * num_bins_);
+            for (size_t k = 0; k < num_bins_ * 2; k += 2) {
+                acc[k] += x[k] * h[k] - x[k + 1] * h[k + 1];
+                acc[k + 1] += x[k] * h[k + 1] + x[k + 1] * h[k];
+            }
+        }
+        state.fdl_pos = (state.fdl_pos + 1) % num_partitions_;
+
+        // 3. 逆FFTし、後半Nサンプルが有効な出力（Overlap-Save）。c2r はアキュムレータを破壊するが毎回クリアするので問題ない
+        fftwf_execute_dft_c2r(bwd_plan_, reinterpret_cast<fftwf_complex*>(accumulator_.data()), time_buffer_.data());
+        std::copy(time_buffer_.begin() + block_size_, time_buffer_.end(), out);
+    }
+}
+
+// --- Convolverクラスのメソッド実装 ---
+
+Convolver::~Convolver() {
+    stopWorkers();
+}
+
+void Convolver::setup(double sr, const json& params) {
+    stopWorkers();
+    sample_rate_ = sr;
+    if (params.is_object() && !params.empty()) {
+        enabled_ = params.value("enabled", true);
+        ir_file_ = params.value("ir_file", "");
+        mix_ = params.value("mix", 1.0);
+        gain_db_ = params.value("gain_db", 0.0);
+        normalize_ = params.value("normalize", true);
+        head_block_ = sanitizeBlock("head_block", params.value("head_block", 128LL), kMinBlock, kMaxBlock);
+        max_block_ = sanitizeBlock("max_block", params.value("max_block", 8192LL), head_block_, kMaxBlock);
+        const int requested_threads = params.value("worker_threads", 1);
+        worker_threads_ = std::clamp(requested_threads, 0, kMaxWorkerThreads);
+        if (worker_threads_ != requested_threads) {
+            std::cerr << "[WARN] Convolver: worker_threads " << requested_threads << " must be in [0, " << kMaxWorkerThreads
+                      << "]. Using " << worker_threads_ << "." << std::endl;
+        }
+    }
+    channels_ = 0;
+    ir_.clear();
+    tail_stages_.clear();
+    if (!enabled_) return;
+
+    if (ir_file_.empty()) {
+        std::cerr << "[WARN] Convolver: 'ir_file' is not specified. Effect disabled." << std::endl;
+        enabled_ = false;
+        return;
+    }
+    if (!loadImpulseResponse()) {
+        std::cerr << "[WARN] Convolver: Failed to load impulse response '" << ir_file_ << "'. Effect disabled." << std::endl;
+        enabled_ = false;
+        return;
+    }
+
+    mix_ = std::max(0.0, std::min(1.0, mix_));
+    wet_gain_ = static_cast<float>(db_to_linear(gain_db_) * mix_);
+    dry_gain_ = static_cast<float>(1.0 - mix_);
+
+    buildPartitionLayout();
+    startWorkers();
+}
+
+bool Convolver::loadImpulseResponse() {
+    auto decoder = AudioDecoderFactory::createDecoder(ir_file_);
+    if (!decoder) return false;
+
+    const AudioInfo info = decoder->getInfo();
+    if (info.channels <= 0 || info.sampleRate <= 0) return false;
+
+    // 全フレームをインターリーブのまま読み込む
+    std::vector<float> interleaved;
+    std::vector<float> chunk(4096 * info.channels);
+    size_t frames_read = 0;
+    while ((frames_read = decoder->read(chunk.data(), 4096)) > 0) {
+        interleaved.insert(interleaved.end(), chunk.begin(), chunk.begin() + frames_read * info.channels);
+    }
+    size_t total_frames = interleaved.size() / info.channels;
+    if (total_frames == 0) return false;
+
+    // 処理サンプルレートと異なる場合はリサンプリング
+    if (static_cast<double>(info.sampleRate) != sample_rate_) {
+        double ratio = sample_rate_ / info.sampleRate;
+        std::vector<float> resampled(static_cast<size_t>(std::ceil(total_frames * ratio) + 16) * info.channels);
+        SRC_DATA src_data;
+        src_data.data_in = interleaved.data();
+        src_data.input_frames = static_cast<long>(total_frames);
+        src_data.data_out = resampled.data();
+        src_data.output_frames = static_cast<long>(resampled.size() / info.channels);
+        src_data.src_ratio = ratio;
+        src_data.end_of_input = 1;
+        int error = src_simple(&src_data, SRC_SINC_BEST_QUALITY, info.channels);
+        if (error != 0) {
+            std::cerr << "[WARN] Convolver: IR resampling failed: " << src_strerror(error) << std::endl;
+            return false;
+        }
+        total_frames = static_cast<size_t>(src_data.output_frames_gen);
+        resampled.resize(total_frames * info.channels);
+        interleaved.swap(resampled);
+    }
+
+    ir_.assign(info.channels, std::vector<float>(total_frames));
+    for (size_t i = 0; i < total_frames; ++i) {
+        for (int ch = 0; ch < info.channels; ++ch) {
+            ir_[ch][i] = interleaved[i * info.channels + ch];
+        }
+    }
+
+    // 振幅特性のピークが0dBになるよう正規化（全チャンネル共通の係数）
+    if (normalize_) {
+        size_t n = nextPowerOfTwo(total_frames);
+        FFTWVector<float> time(n, 0.0f);
+        FFTWVector<std::complex<float>> freq(n / 2 + 1);
+        float peak = 0.0f;
+        for (const auto& taps : ir_) {
+            std::fill(time.begin(), time.end(), 0.0f);
+            std::copy(taps.begin(), taps.end(), time.begin());
+            FFTPlanRegistry::getInstance().executeForwardOnce(n, time.data(), freq.data());
+            for (const auto& bin : freq) peak = std::max(peak, std::abs(bin));
+        }
+        if (peak > 1e-9f) {
+            for (auto& taps : ir_) {
+                for (auto& t : taps) t /= peak;
+            }
+        }
+    }
+
+    std::cout << "[INFO] Convolver: Loaded IR '" << ir_file_ << "' (" << info.channels << " ch, "
+              << total_frames << " taps at " << sample_rate_ << " Hz)" << std::endl;
+    return true;
+}
+
+void Convolver::buildPartitionLayout() {
+    const size_t total = ir_.empty() ? 0 : ir_[0].size();
+
+    // ブロック長を4倍ずつ大きくする。段Lの開始位置D_Lは、結果が必要になるまでに
+    // 1ブロック分の計算時間を確保するため D_L + head_block >= 2 * N_L を満たすようにする。
+    size_t offset = 0;
+    size_t block = head_block_;
+    bool is_head = true;
+    std::cout << "[INFO] Convolver: Partition layout:";
+    while (offset < total) {
+        size_t next_block = std::min(block * 4, max_block_);
+        size_t partitions = (total - offset + block - 1) / block;
+        if (next_block > block) {
+            size_t next_start = 2 * next_block - head_block_;
+            size_t until_next = (next_start - offset + block - 1) / block;
+            partitions = std::max<size_t>(1, std::min(partitions, until_next));
+        }
+
+        if (is_head) {
+            head_.init(block, ir_, offset, partitions);
+            is_head = false;
+        } else {
+            auto stage = std::make_unique<TailStage>();
+            stage->conv.init(block, ir_, offset, partitions);
+            stage->block_size = block;
+            stage->offset = offset;
+            stage->num_slots = (offset + head_block_) / block + 2;
+            tail_stages_.push_back(std::move(stage));
+        }
+        std::cout << " " << partitions << "x" << block;
+        offset += partitions * block;
+        block = next_block;
+    }
+    std::cout << " (latency " << head_block_ << " samples)" << std::endl;
+
+    size_t largest = head_block_;
+    for (const auto& stage : tail_stages_) largest = std::max(largest, stage->block_size);
+    size_t accumulator_size = nextPowerOfTwo(largest + head_block_ * 2);
+    accumulator_mask_ = accumulator_size - 1;
+    job_queue_.clear();
+    job_queue_.reserve(tail_stages_.size() * 8);
+}
+
+void Convolver::prepareChannels(int channels) {
+    if (!isActive() || channels <= 0) return;
+    waitForIdle();
+    channels_ = channels;
+
+    head_.prepareChannels(channels);
+    head_input_.assign(channels * head_block_, 0.0f);
+    head_output_.assign(channels * head_block_, 0.0f);
+    for (auto& stage : tail_stages_) {
+        stage->conv.prepareChannels(channels);
+        stage->input_slots.assign(stage->num_slots, std::vector<float>(channels * stage->block_size, 0.0f));
+        stage->output_slots.assign(stage->num_slots, std::vector<float>(channels * stage->block_size, 0.0f));
+        job_queue_.reserve(job_queue_.capacity() + stage->num_slots);
+    }
+    accumulator_.assign(channels, std::vector<float>(accumulator_mask_ + 1, 0.0f));
+    dry_delay_.assign(channels, std::vector<float>(head_block_, 0.0f));
+    reset();
+}
+
+size_t Convolver::getTailSamples() const {
+    // 先頭ブロック分の遅延 + IR長（テール段はワーカーで計算されるが、出力時刻は入力に対して固定）
+    size_t ir_length = 0;
+    for (const auto& channel : ir_) ir_length = std::max(ir_length, channel.size());
+    return head_block_ + ir_length;
+}
+
+void Convolver::reset() {
+    waitForIdle();
+    head_.reset();
+    std::fill(head_input_.begin(), head_input_.end(), 0.0f);
+    for (auto& stage : tail_stages_) {
+        stage->conv.reset();
+        stage->submitted = 0;
+        stage->processed = 0;
+        stage->completed = 0;
+        stage->consumed = 0;
+    }
+    for (auto& acc : accumulator_) std::fill(acc.begin(), acc.end(), 0.0f);
+    for (auto& delay : dry_delay_) std::fill(delay.begin(), delay.end(), 0.0f);
+    input_time_ = 0;
+}
+
+void Convolver::process(std::vector<float>& block, int channels) {
+    // バッファは setChannelLayout() で確保する。準備していないチャンネル数のブロックは素通しする
+    if (!enabled_ || channels <= 0 || ir_.empty() || channels != channels_) return;
+
+    const size_t num_frames = block.size() / channels;
+    const size_t head = head_block_;
+    size_t frame = 0;
+
+    while (frame < num_frames) {
+        // 先頭段のブロック境界までをまとめて処理する（テール段の境界も必ずここに揃う）
+        size_t pos = static_cast<size_t>(input_time_ % head);
+        size_t chunk = std::min(num_frames - frame, head - pos);
+
+        for (int c = 0; c < channels; ++c) {
+            float* head_in = head_input_.data() + c * head + pos;
+            float* acc = accumulator_[c].data();
+            float* dry = dry_delay_[c].data() + pos;
+            for (size_t j = 0; j < chunk; ++j) {
+                float& sample = block[(frame + j) * channels + c];
+                float x = sample;
+                head_in[j] = x;
+                size_t acc_index = static_cast<size_t>(input_time_ + j) & accumulator_mask_;
+                float wet = acc[acc_index];
+                acc[acc_index] = 0.0f;
+                sample = dry_gain_ * dry[j] + wet_gain_ * wet;
+                dry[j] = x;
+            }
+        }
+        // テール段の入力スロットへは、先頭段の入力バッファに取り込んだ原信号をコピーする
+        for (auto& stage : tail_stages_) {
+            size_t n = stage->block_size;
+            long long k = input_time_ / static_cast<long long>(n);
+            for (int c = 0; c < channels; ++c) {
+                float* dst = stage->input_slots[k % stage->num_slots].data() + c * n + (input_time_ % n);
+                std::copy(head_input_.data() + c * head + pos, head_input_.data() + c * head + pos + chunk, dst);
+            }
+        }
+
+        frame += chunk;
+        input_time_ += chunk;
+        if (input_time_ % head == 0) onHeadBoundary();
+    }
+}
+
+void Convolver::onHeadBoundary() {
+    const size_t head = head_block_;
+    const long long now = input_time_;
+
+    // 1. 先頭段を処理スレッド上で計算し、今から出力する区間へ加算
+    head_.processBlock(head_input_.data(), head_output_.data());
+    for (int c = 0; c < channels_; ++c) {
+        float* acc = accumulator_[c].data();
+        const float* out = head_output_.data() + c * head;
+        for (size_t j = 0; j < head; ++j) {
+            acc[static_cast<size_t>(now + j) & accumulator_mask_] += out[j];
+        }
+    }
+
+    // 2. 入力が揃ったテール段のブロックをワーカーへ投入
+    for (auto& stage : tail_stages_) {
+        long long n = static_cast<long long>(stage->block_size);
+        if (now % n == 0) {
+            long long k = now / n - 1;
+            submitStage(*stage, k * n + static_cast<long long>(stage->offset + head));
+        }
+    }
+
+    // 3. 出力時刻に達したテール段の結果を待ち受けて加算
+    for (auto& stage : tail_stages_) {
+        long long n = static_cast<long long>(stage->block_size);
+        while (stage->consumed < stage->submitted &&
+               stage->consumed * n + static_cast<long long>(stage->offset + head) <= now) {
+            long long k = stage->consumed;
+            if (stage->completed.load(std::memory_order_acquire) <= k) deadline_misses_.fetch_add(1, std::memory_order_relaxed);
+            waitForStage(*stage, k);
+            long long start = k * n + static_cast<long long>(stage->offset + head);
+            const std::vector<float>& result = stage->output_slots[k % stage->num_slots];
+            for (int c = 0; c < channels_; ++c) {
+                float* acc = accumulator_[c].data();
+                const float* out = result.data() + c * stage->block_size;
+                for (size_t j = 0; j < stage->block_size; ++j) {
+                    acc[static_cast<size_t>(start + j) & accumulator_mask_] += out[j];
+                }
+            }
+            stage->consumed++;
+        }
+    }
+}
+
+// --- ワーカープール（デッドライン順スケジューリング） ---
+
+void Convolver::startWorkers() {
+    if (worker_threads_ <= 0 || tail_stages_.empty()) return;
+    stop_workers_ = false;
+    int count = std::min<int>(worker_threads_, static_cast<int>(tail_stages_.size()));
+    for (int i = 0; i < count; ++i) {
+        workers_.emplace_back(&Convolver::workerLoop, this);
+    }
+}
+
+void Convolver::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stop_workers_ = true;
+        job_queue_.clear();
+    }
+    queue_cv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+    workers_.clear();
+    stop_workers_ = false;
+}
+
+void Convolver::workerLoop() {
+    // テールの計算が間に合わないとブロックを待たせるため、処理スレッドに準じた優先度で動かす
+    applyWorkerThreadSchedule();
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait(lock, [this] { return stop_workers_ || !job_queue_.empty(); });
+            if (stop_workers_) return;
+            std::pop_heap(job_queue_.begin(), job_queue_.end(), std::greater<Job>());
+            job = job_queue_.back();
+            job_queue_.pop_back();
+        }
+        runStage(*job.stage);
+    }
+}
+
+void Convolver::runStage(TailStage& stage) {
+    {
+        // 同じ段のブロックは必ず投入順に計算する（FDLの順序を保つため）
+        std::lock_guard<std::mutex> lock(stage.mutex);
+        long long k = stage.processed++;
+        size_t slot = k % stage.num_slots;
+        stage.conv.processBlock(stage.input_slots[slot].data(), stage.output_slots[slot].data());
+        stage.completed.store(k + 1, std::memory_order_release);
+    }
+    std::lock_guard<std::mutex> lock(completion_mutex_);
+    completion_cv_.notify_all();
+}
+
+void Convolver::submitStage(TailStage& stage, long long deadline) {
+    stage.submitted++;
+    if (workers_.empty()) {
+        runStage(stage);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        job_queue_.push_back({deadline, &stage});
+        std::push_heap(job_queue_.begin(), job_queue_.end(), std::greater<Job>());
+    }
+    queue_cv_.notify_one();
+}
+
+void Convolver::waitForStage(TailStage& stage, long long block_index) {
+    if (stage.completed.load(std::memory_order_acquire) > block_index) return;
+    std::unique_lock<std::mutex> lock(completion_mutex_);
+    completion_cv_.wait(lock, [&stage, block_index] {
+        return stage.completed.load(std::memory_order_acquire) > block_index;
+    });
+}
+
+void Convolver::waitForIdle() {
+    for (auto& stage : tail_stages_) {
+        if (stage->submitted > 0) waitForStage(*stage, stage->submitted - 1);
+    }
+}
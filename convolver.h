@@ -0,0 +1,175 @@
+// ./convolver.h
+// 非一様分割畳み込みによるコンボルバー（ルーム補正・ヘッドホンEQ用の長いインパルス応答向け）
+#pragma once
+
+#include "AudioEffect.h"
+#include "fft_plan_registry.h"
+#include <vector>
+#include <string>
+#include <complex>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <fftw3.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+/**
+ * @class UniformPartitionedConvolution
+ * @brief 一様分割・周波数領域遅延線（FDL）によるオーバーラップ・セーブ畳み込み
+ *
+ * ブロック長Nの入力を受け取るたびに、IRセグメントとのN個分の畳み込み結果を計算します。
+ * 非一様分割の各段はこのクラスを1つずつ持ちます。
+ */
+class UniformPartitionedConvolution {
+public:
+    /**
+     * @brief IRセグメントを分割してスペクトルを事前計算する
+     * @param block_size 分割ブロック長N（FFT長は2N）
+     * @param ir IRのチャンネルごとのデータ
+     * @param offset このセグメントの開始タップ位置
+     * @param num_partitions 分割数
+     */
+    void init(size_t block_size, const std::vector<std::vector<float>>& ir, size_t offset, size_t num_partitions);
+
+    // 処理チャンネル数に合わせて入力履歴とFDLを確保する
+    void prepareChannels(int channels);
+
+    /**
+     * @brief 1ブロック分の畳み込みを計算する
+     * @param input チャンネルごとにN個並んだ入力（チャンネル間隔はN）
+     * @param output チャンネルごとにN個の結果を書き込む（チャンネル間隔はN）
+     */
+    void processBlock(const float* input, float* output);
+
+    void reset();
+
+    size_t getBlockSize() const { return block_size_; }
+    size_t getNumPartitions() const { return num_partitions_; }
+
+private:
+    struct ChannelState {
+        FFTWVector<float> input_window;                   // 直前ブロック + 現在ブロック (2N)
+        std::vector<std::complex<float>> fdl;             // 入力スペクトルの遅延線 (partitions * bins)
+        size_t fdl_pos = 0;
+    };
+
+    size_t block_size_ = 0;
+    size_t fft_size_ = 0;
+    size_t num_bins_ = 0;
+    size_t num_partitions_ = 0;
+    int ir_channels_ = 0;
+
+    // IRチャンネルごとの分割スペクトル (partitions * bins)、1/(2N) の正規化込み
+    std::vector<std::vector<std::complex<float>>> ir_spectra_;
+    std::vector<ChannelState> channel_states_;
+
+    // プランはFFTPlanRegistryで共有し、下記の作業配列に対して新配列実行する
+    fftwf_plan fwd_plan_ = nullptr;
+    fftwf_plan bwd_plan_ = nullptr;
+    FFTWVector<float> time_buffer_;
+    FFTWVector<std::complex<float>> freq_buffer_;
+    FFTWVector<std::complex<float>> accumulator_;
+};
+
+/**
+ * @class Convolver
+ * @brief 非一様分割畳み込みエフェクト
+ *
+ * IRの先頭は短いブロックで処理スレッド上で計算し、長いテール部分は
+ * ブロック長を段階的に大きくしてワーカースレッドで計算します。
+ * ワーカーは出力が必要になる時刻（デッドライン）が早いジョブから処理します。
+ * 遅延は先頭ブロック長（head_block）分です。
+ */
+class Convolver : public AudioEffect {
+public:
+    Convolver() = default;
+    ~Convolver() override;
+
+    void setup(double sr, const json& params) override;
+    void process(std::vector<float>& block, int channels) override;
+    void reset() override;
+    bool isActive() const override { return enabled_ && !ir_.empty(); }
+    size_t getTailSamples() const override;
+    size_t getLatencySamples() const override { return head_block_; }
+    uint64_t getDeadlineMisses() const override { return deadline_misses_.load(std::memory_order_relaxed); }
+    // 入力履歴・スロット・アキュムレータはここで確保する（処理スレッドでは確保しない）
+    void setChannelCount(int channels) override { prepareChannels(channels); }
+    void setChannelLayout(const ChannelLayout& layout) override { prepareChannels(layout.channels()); }
+    const std::string& getName() const override { return name_; }
+
+private:
+    // ワーカースレッドで計算されるテール段
+    struct TailStage {
+        UniformPartitionedConvolution conv;
+        size_t block_size = 0;
+        size_t offset = 0;                         // IR上の開始タップ位置
+        size_t num_slots = 0;
+        std::vector<std::vector<float>> input_slots;  // ブロックkの入力 (channels * N)
+        std::vector<std::vector<float>> output_slots; // ブロックkの結果 (channels * N)
+        long long submitted = 0;                   // 投入済みブロック数
+        long long processed = 0;                   // 計算を開始したブロック数（ワーカー側で使用）
+        std::atomic<long long> completed{0};       // 計算完了ブロック数
+        long long consumed = 0;                    // 出力に加算済みブロック数
+        std::mutex mutex;                          // 同じ段を複数ワーカーが同時に計算しないためのロック
+    };
+
+    struct Job {
+        long long deadline;                        // 結果が必要になる入力サンプル時刻
+        TailStage* stage;
+        bool operator>(const Job& other) const { return deadline > other.deadline; }
+    };
+
+    std::string name_ = "convolver";
+    bool enabled_ = true;
+    double sample_rate_ = 48000.0;
+    std::string ir_file_;
+    double mix_ = 1.0;
+    double gain_db_ = 0.0;
+    bool normalize_ = true;
+    size_t head_block_ = 128;
+    size_t max_block_ = 8192;
+    int worker_threads_ = 1;
+
+    int channels_ = 0;
+    std::vector<std::vector<float>> ir_;       // 処理サンプルレートに変換済みのIR
+    float wet_gain_ = 1.0f;
+    float dry_gain_ = 0.0f;
+
+    // 先頭段（処理スレッドで計算）
+    UniformPartitionedConvolution head_;
+    std::vector<float> head_input_;            // channels * head_block
+    std::vector<float> head_output_;           // channels * head_block
+    std::vector<std::unique_ptr<TailStage>> tail_stages_;
+
+    // 出力アキュムレータ（チャンネルごとのリング、畳み込み結果の時刻で索引）
+    std::vector<std::vector<float>> accumulator_;
+    size_t accumulator_mask_ = 0;
+    std::vector<std::vector<float>> dry_delay_; // ドライ信号を遅延量に合わせるためのリング
+    long long input_time_ = 0;                 // これまでに受け取った入力サンプル数
+
+    // デッドライン順のワーカープール
+    std::vector<std::thread> workers_;
+    std::vector<Job> job_queue_;               // std::push_heap / pop_heap で管理する最小ヒープ
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::condition_variable completion_cv_;
+    std::mutex completion_mutex_;
+    bool stop_workers_ = false;
+    std::atomic<uint64_t> deadline_misses_{0};    // onHeadBoundary() でテール段の結果を待った回数
+
+    bool loadImpulseResponse();
+    void buildPartitionLayout();
+    void prepareChannels(int channels);
+    void startWorkers();
+    void stopWorkers();
+    void workerLoop();
+    void runStage(TailStage& stage);
+    void submitStage(TailStage& stage, long long deadline);
+    void waitForStage(TailStage& stage, long long block_index);
+    void waitForIdle();
+    void onHeadBoundary();
+};
@@ -1,6 +1,7 @@
 // ./custom_effects.cpp
 // 新規作成：ExciterとGlossEnhancerエフェクトの実装
 #include "custom_effects.h"
+#include "fast_math.h"
 #include <cmath>
 
 // --- Exciterクラスのメソッド実装 ---
@@ -14,48 +15,111 @@ void Exciter::setup(double sr, const json& params) {
         mix_ = params.value("mix", 0.18);
     }
 
-    highpass_filter_l_.set_hpf(sr, crossover_freq_, 0.707);
-    highpass_filter_r_.set_hpf(sr, crossover_freq_, 0.707);
-    lowpass_filter_l_.set_lpf(sr, crossover_freq_, 0.707);
-    lowpass_filter_r_.set_lpf(sr, crossover_freq_, 0.707);
-    reset();
+    highpass_.set_hpf(sr, crossover_freq_, 0.707);
+    lowpass_.set_lpf(sr, crossover_freq_, 0.707);
+    applyCoefficients();
+    mix_ramp_.reset(mix_);
+}
+
+bool Exciter::setParameter(const std::string& name, double value, size_t ramp_samples) {
+    if (!enabled_) return false;
+    if (name == "mix") {
+        mix_ = value;
+        mix_ramp_.setTarget(value, ramp_samples);
+        return true;
+    }
+    if (name == "crossover_freq") {
+        if (value == crossover_freq_) return true;
+        crossover_freq_ = value;
+        highpass_.set_hpf(sample_rate_, crossover_freq_, 0.707);
+        lowpass_.set_lpf(sample_rate_, crossover_freq_, 0.707);
+        for (auto& state : channel_states_) {
+            state.highpass.update_coefficients(highpass_.coefficients());
+            state.lowpass.update_coefficients(lowpass_.coefficients());
+        }
+        return true;
+    }
+    return false;
+}
+
+void Exciter::applyCoefficients() {
+    // 原型は処理に使わないので状態は常に0（コピーでリセットも兼ねる）
+    for (auto& state : channel_states_) {
+        state.highpass = highpass_;
+        state.lowpass = lowpass_;
+    }
 }
 
 void Exciter::reset() {
-    highpass_filter_l_.reset();
-    highpass_filter_r_.reset();
-    lowpass_filter_l_.reset();
-    lowpass_filter_r_.reset();
+    for (auto& state : channel_states_) {
+        state.highpass.reset();
+        state.lowpass.reset();
+    }
 }
 
-float Exciter::saturate(float x) {
-    // drive_を適用したtanh関数でシンプルなサチュレーションを実装
-    return std::tanh(x * drive_);
+void Exciter::setChannelLayout(const ChannelLayout& layout) {
+    channel_states_.resize(static_cast<size_t>(layout.channels()));
+    applyCoefficients();
+    active_channels_ = layout.fullRangeChannels();
+    // 全チャンネルを処理するモノラル/ステレオだけを特殊化し、それ以外（LFEを含むレイアウトなど）は汎用版
+    const bool all = static_cast<int>(active_channels_.size()) == layout.channels();
+    kernel_.select(layout.channels(), all ? &Exciter::processKernel<1> : &Exciter::processKernel<0>,
+                   all ? &Exciter::processKernel<2> : &Exciter::processKernel<0>, &Exciter::processKernel<0>);
 }
 
-float Exciter::processSample(float sample, SimpleBiquad& hpf, SimpleBiquad& lpf) {
-    float dry_signal = sample;
-    float high_freq_component = hpf.process(dry_signal);
-    float low_freq_component = lpf.process(dry_signal);
+template <int Channels>
+void Exciter::processChannel(float* block, size_t num_frames, int channels, int channel, ChannelState& state, const float* mix) {
+    const int ch = kernelChannels<Channels>(channels);
+    highs_.resize(num_frames);
+    lows_.resize(num_frames);
+
+    // 1. クロスオーバーで高域と低域を抽出（フィルタは逐次処理）
+    for (size_t i = 0; i < num_frames; ++i) {
+        float dry_signal = block[i * ch + channel];
+        highs_[i] = state.highpass.process(dry_signal);
+        lows_[i] = state.lowpass.process(dry_signal);
+    }
 
-    float saturated_highs = saturate(high_freq_component);
+    // 2. 高域にdrive_を適用したtanhサチュレーションをブロック単位で掛ける
+    fast_math::fast_tanh_scaled_block(highs_.data(), highs_.data(), num_frames, static_cast<float>(drive_));
 
-    return low_freq_component + (dry_signal * (1.0f - mix_)) + (saturated_highs * mix_);
+    // 3. ミックス（mix がランプ中ならサンプルごとの値を使う）
+    if (mix) {
+        for (size_t i = 0; i < num_frames; ++i) {
+            float& sample = block[i * ch + channel];
+            sample = lows_[i] + (sample * (1.0f - mix[i])) + (highs_[i] * mix[i]);
+        }
+        return;
+    }
+    const float dry_gain = static_cast<float>(1.0 - mix_);
+    const float wet_gain = static_cast<float>(mix_);
+    for (size_t i = 0; i < num_frames; ++i) {
+        float& sample = block[i * ch + channel];
+        sample = lows_[i] + (sample * dry_gain) + (highs_[i] * wet_gain);
+    }
 }
 
-void Exciter::process(std::vector<float>& block, int channels) {
-    if (!enabled_) return;
-
-    for (size_t i = 0; i < block.size(); i += channels) {
-        if (channels == 1) {
-            block[i] = processSample(block[i], highpass_filter_l_, lowpass_filter_l_);
-        } else if (channels == 2) {
-            block[i] = processSample(block[i], highpass_filter_l_, lowpass_filter_l_);
-            block[i + 1] = processSample(block[i + 1], highpass_filter_r_, lowpass_filter_r_);
-        }
+template <int Channels>
+void Exciter::processKernel(float* block, size_t frames, int channels) {
+    const float* mix = nullptr;
+    if (mix_ramp_.ramping()) {
+        mix_values_.resize(frames);
+        mix_ramp_.fill(mix_values_.data(), frames);
+        mix = mix_values_.data();
+    }
+    if (Channels > 0) {
+        for (int c = 0; c < Channels; ++c) processChannel<Channels>(block, frames, channels, c, channel_states_[c], mix);
+    } else {
+        for (int c : active_channels_) processChannel<0>(block, frames, channels, c, channel_states_[c], mix);
     }
 }
 
+void Exciter::process(std::vector<float>& block, int channels) {
+    if (!enabled_ || channels <= 0) return;
+    if (channels != kernel_.channels()) setChannelCount(channels);
+    kernel_.run(*this, block);
+}
+
 
 // --- GlossEnhancerクラスのメソッド実装 ---
 
@@ -76,56 +140,84 @@ void GlossEnhancer::setup(double sr, const json& params) {
         double presence_gain_db = 20.0 * log10(presence_gain);
         double air_gain_db = 20.0 * log10(air_gain);
 
-        presence_filter_l_.set_peaking(sr, 4000.0, 1.5, presence_gain_db);
-        presence_filter_r_.set_peaking(sr, 4000.0, 1.5, presence_gain_db);
-        air_filter_l_.set_peaking(sr, 12000.0, 2.0, air_gain_db);
-        air_filter_r_.set_peaking(sr, 12000.0, 2.0, air_gain_db);
+        presence_filter_.set_peaking(sr, 4000.0, 1.5, presence_gain_db);
+        air_filter_.set_peaking(sr, 12000.0, 2.0, air_gain_db);
+    }
+    dc_blocker_.set_hpf(sr, 15.0, 0.707);
+    applyCoefficients();
+}
+
+void GlossEnhancer::applyCoefficients() {
+    // 原型は処理に使わないので状態は常に0（コピーでリセットも兼ねる）
+    for (auto& state : channel_states_) {
+        state.dc_blocker = dc_blocker_;
+        state.presence = presence_filter_;
+        state.air = air_filter_;
     }
-    dc_blocker_l_.set_hpf(sr, 15.0, 0.707);
-    dc_blocker_r_.set_hpf(sr, 15.0, 0.707);
-    reset();
 }
 
 void GlossEnhancer::reset() {
-    dc_blocker_l_.reset();
-    dc_blocker_r_.reset();
-    presence_filter_l_.reset();
-    presence_filter_r_.reset();
-    air_filter_l_.reset();
-    air_filter_r_.reset();
+    for (auto& state : channel_states_) {
+        state.dc_blocker.reset();
+        state.presence.reset();
+        state.air.reset();
+    }
 }
 
-float GlossEnhancer::processSample(float sample, SimpleBiquad& dc, SimpleBiquad& pres, SimpleBiquad& air) {
-    float dry_signal = sample;
+void GlossEnhancer::setChannelLayout(const ChannelLayout& layout) {
+    channel_states_.resize(static_cast<size_t>(layout.channels()));
+    applyCoefficients();
+    active_channels_ = layout.fullRangeChannels();
+    const bool all = static_cast<int>(active_channels_.size()) == layout.channels();
+    kernel_.select(layout.channels(), all ? &GlossEnhancer::processKernel<1> : &GlossEnhancer::processKernel<0>,
+                   all ? &GlossEnhancer::processKernel<2> : &GlossEnhancer::processKernel<0>, &GlossEnhancer::processKernel<0>);
+}
+
+template <int Channels>
+void GlossEnhancer::processChannel(float* block, size_t num_frames, int channels, int channel, ChannelState& state) {
+    const int ch = kernelChannels<Channels>(channels);
+    work_.resize(num_frames);
+    odd_.resize(num_frames);
+    float* processed = work_.data();
 
     // 1. DCオフセット除去
-    float processed = dc.process(sample);
-    
-    // 2. 倍音付加
-    float harmonics = 0.0f;
-    float abs_processed = std::abs(processed);
-    // 偶数次倍音 (x^2 - |x|)
-    harmonics += (processed * processed - abs_processed) * even_harmonics_;
-    // 奇数次倍音 (tanh)
-    harmonics += (std::tanh(processed * 1.5f) - processed) * odd_harmonics_;
-    processed += harmonics * harmonic_drive_;
-
-    // 3. プレゼンスとエアーの調整
-    processed = pres.process(processed);
-    processed = air.process(processed);
-
-    return (dry_signal * (1.0f - total_mix_)) + (processed * total_mix_);
+    for (size_t i = 0; i < num_frames; ++i) {
+        processed[i] = state.dc_blocker.process(block[i * ch + channel]);
+    }
+
+    // 2. 倍音付加（tanhはブロック単位のSIMD近似）
+    fast_math::fast_tanh_scaled_block(processed, odd_.data(), num_frames, 1.5f);
+    const float even = static_cast<float>(even_harmonics_);
+    const float odd = static_cast<float>(odd_harmonics_);
+    const float drive = static_cast<float>(harmonic_drive_);
+    for (size_t i = 0; i < num_frames; ++i) {
+        float x = processed[i];
+        // 偶数次倍音 (x^2 - |x|) と 奇数次倍音 (tanh)
+        float harmonics = (x * x - std::abs(x)) * even + (odd_[i] - x) * odd;
+        processed[i] = x + harmonics * drive;
+    }
+
+    // 3. プレゼンスとエアーの調整、4. ミックス
+    const float dry_gain = static_cast<float>(1.0 - total_mix_);
+    const float wet_gain = static_cast<float>(total_mix_);
+    for (size_t i = 0; i < num_frames; ++i) {
+        float wet = state.air.process(state.presence.process(processed[i]));
+        float& sample = block[i * ch + channel];
+        sample = (sample * dry_gain) + (wet * wet_gain);
+    }
 }
 
-void GlossEnhancer::process(std::vector<float>& block, int channels) {
-    if (!enabled_) return;
-
-    for (size_t i = 0; i < block.size(); i += channels) {
-        if (channels == 1) {
-            block[i] = processSample(block[i], dc_blocker_l_, presence_filter_l_, air_filter_l_);
-        } else if (channels == 2) {
-            block[i] = processSample(block[i], dc_blocker_l_, presence_filter_l_, air_filter_l_);
-            block[i + 1] = processSample(block[i + 1], dc_blocker_r_, presence_filter_r_, air_filter_r_);
-        }
+template <int Channels>
+void GlossEnhancer::processKernel(float* block, size_t frames, int channels) {
+    if (Channels > 0) {
+        for (int c = 0; c < Channels; ++c) processChannel<Channels>(block, frames, channels, c, channel_states_[c]);
+    } else {
+        for (int c : active_channels_) processChannel<0>(block, frames, channels, c, channel_states_[c]);
     }
-}
\ No newline at end of file
+}
+
+void GlossEnhancer::process(std::vector<float>& block, int channels) {
+    if (!enabled_ || channels <= 0) return;
+    if (channels != kernel_.channels()) setChannelCount(channels);
+    kernel_.run(*this, block);
+}
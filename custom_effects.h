@@ -4,6 +4,8 @@
 
 #include "AudioEffect.h"
 #include "SimpleBiquad.h"
+#include "channel_kernel.h"
+#include "parameter_ramp.h"
 #include <vector>
 #include <string>
 #include <nlohmann/json.hpp>
@@ -22,6 +24,16 @@ public:
     void setup(double sr, const json& params) override;
     void process(std::vector<float>& block, int channels) override;
     void reset() override;
+    void setChannelCount(int channels) override { setChannelLayout(ChannelLayout::defaultFor(channels)); }
+    void setChannelLayout(const ChannelLayout& layout) override;
+    bool isFusable() const override { return true; }
+    bool isActive() const override { return enabled_ && mix_ != 0.0; }
+    size_t getTailSamples() const override {
+        return std::max(highpass_.ring_down_samples(), lowpass_.ring_down_samples());
+    }
+    // "mix" はサンプルごとにランプし、"crossover_freq" はフィルタの状態を保ったまま係数を更新する
+    bool setParameter(const std::string& name, double value, size_t ramp_samples) override;
+    bool serializeState(StateArchive& ar) override { ar(channel_states_); return true; }
     const std::string& getName() const override { return name_; }
 
 private:
@@ -33,13 +45,25 @@ private:
     double crossover_freq_ = 7800.0;
     double drive_ = 1.0;
     double mix_ = 0.2;
+    ParameterRamp mix_ramp_;
+    std::vector<float> mix_values_;         // ランプ中のブロックのサンプルごとの mix（全チャンネルで共有）
 
-    // 2チャンネル分のフィルター
-    SimpleBiquad highpass_filter_l_, highpass_filter_r_;
-    SimpleBiquad lowpass_filter_l_, lowpass_filter_r_;
+    // チャンネルごとのクロスオーバー（highpass_ / lowpass_ は係数を持つ原型）
+    struct ChannelState {
+        SimpleBiquad highpass, lowpass;
+        void serializeState(StateArchive& ar) { ar(highpass, lowpass); }
+    };
+    SimpleBiquad highpass_, lowpass_;
+    std::vector<ChannelState> channel_states_;
+    std::vector<int> active_channels_;      // 処理する全帯域チャンネル（LFEは素通し）
 
-    float processSample(float sample, SimpleBiquad& hpf, SimpleBiquad& lpf);
-    float saturate(float x);
+    // ブロック処理用の作業バッファ（1チャンネル分）
+    std::vector<float> highs_, lows_;
+
+    ChannelKernel<Exciter> kernel_;
+    template <int Channels> void processKernel(float* block, size_t frames, int channels);
+    template <int Channels> void processChannel(float* block, size_t frames, int channels, int channel, ChannelState& state, const float* mix);
+    void applyCoefficients();
 };
 
 /**
@@ -54,6 +78,14 @@ public:
     void setup(double sr, const json& params) override;
     void process(std::vector<float>& block, int channels) override;
     void reset() override;
+    void setChannelCount(int channels) override { setChannelLayout(ChannelLayout::defaultFor(channels)); }
+    void setChannelLayout(const ChannelLayout& layout) override;
+    bool isFusable() const override { return true; }
+    bool isActive() const override { return enabled_ && total_mix_ != 0.0; }
+    size_t getTailSamples() const override {
+        return addTails(dc_blocker_.ring_down_samples(), addTails(presence_filter_.ring_down_samples(), air_filter_.ring_down_samples()));
+    }
+    bool serializeState(StateArchive& ar) override { ar(channel_states_); return true; }
     const std::string& getName() const override { return name_; }
 
 private:
@@ -67,10 +99,20 @@ private:
     double odd_harmonics_ = 0.18;
     double total_mix_ = 0.22;
 
-    // 2チャンネル分のフィルターと状態
-    SimpleBiquad dc_blocker_l_, dc_blocker_r_;
-    SimpleBiquad presence_filter_l_, presence_filter_r_;
-    SimpleBiquad air_filter_l_, air_filter_r_;
+    // チャンネルごとのフィルター（dc_blocker_ / presence_filter_ / air_filter_ は係数を持つ原型）
+    struct ChannelState {
+        SimpleBiquad dc_blocker, presence, air;
+        void serializeState(StateArchive& ar) { ar(dc_blocker, presence, air); }
+    };
+    SimpleBiquad dc_blocker_, presence_filter_, air_filter_;
+    std::vector<ChannelState> channel_states_;
+    std::vector<int> active_channels_;      // 処理する全帯域チャンネル（LFEは素通し）
+
+    // ブロック処理用の作業バッファ（1チャンネル分）
+    std::vector<float> work_, odd_;
 
-    float processSample(float sample, SimpleBiquad& dc, SimpleBiquad& pres, SimpleBiquad& air);
+    ChannelKernel<GlossEnhancer> kernel_;
+    template <int Channels> void processKernel(float* block, size_t frames, int channels);
+    template <int Channels> void processChannel(float* block, size_t frames, int channels, int channel, ChannelState& state);
+    void applyCoefficients();
 };
\ No newline at end of file
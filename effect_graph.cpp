@@ -0,0 +1,329 @@
+// ./effect_graph.cpp
+#include "effect_graph.h"
+#include "AudioEffectFactory.h"
+#include <iostream>
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// エッジの端点（"from" / "to"）を取り出す。["a", "b"] の短縮形も受け付ける
+bool parseEdgeEnds(const json& edge, std::string& from, std::string& to) {
+    if (edge.is_array() && edge.size() == 2 && edge[0].is_string() && edge[1].is_string()) {
+        from = edge[0].get<std::string>();
+        to = edge[1].get<std::string>();
+        return true;
+    }
+    if (edge.is_object() && edge.contains("from") && edge.contains("to") && edge["from"].is_string() && edge["to"].is_string()) {
+        from = edge["from"].get<std::string>();
+        to = edge["to"].get<std::string>();
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool EffectGraph::build(const json& graph, const json& params, const ChannelLayout& layout, double sr, size_t max_block_frames) {
+    pool_.stop();
+    nodes_.clear();
+    order_.clear();
+    roots_.clear();
+    layout_ = layout;
+    channels_ = layout.channels();
+    unpaired_.clear();
+    for (int c = 0; c < channels_; ++c) {
+        bool paired = false;
+        for (const auto& pair : layout_.stereoPairs()) paired = paired || pair.first == c || pair.second == c;
+        if (!paired) unpaired_.push_back(static_cast<size_t>(c));
+    }
+
+    nodes_.resize(2);
+    nodes_[kInput].id = "input";
+    nodes_[kOutput].id = "output";
+    auto findNode = [this](const std::string& id) -> size_t {
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            if (nodes_[i].id == id) return i;
+        }
+        return nodes_.size();
+    };
+
+    // 1. ノード（エフェクト）を作成してセットアップする
+    const json nodes = graph.value("nodes", json::array());
+    for (const auto& entry : nodes) {
+        const std::string id = entry.is_object() ? entry.value("id", "") : "";
+        const std::string effect_key = entry.is_object() ? entry.value("effect", "") : "";
+        if (id.empty() || findNode(id) != nodes_.size()) {
+            std::cerr << "[WARN] EffectGraph: Each node needs a unique 'id' other than 'input' and 'output' (got '" << id << "')." << std::endl;
+            return false;
+        }
+        auto effect = AudioEffectFactory::getInstance().createEffect(effect_key);
+        if (!effect) {
+            std::cerr << "[WARN] EffectGraph: Unknown effect '" << effect_key << "' for node '" << id << "'." << std::endl;
+            return false;
+        }
+        json effect_params = params.value(effect_key, json({}));
+        if (entry.contains("params")) {
+            const json& source = entry["params"];
+            effect_params = source.is_string() ? params.value(source.get<std::string>(), json({})) : source;
+        }
+        effect->setup(sr, effect_params);
+        effect->setChannelLayout(layout_);
+        Node node;
+        node.id = id;
+        node.effect = std::move(effect);
+        nodes_.push_back(std::move(node));
+    }
+
+    // 2. エッジを接続する（入力は宣言順に足し込む）
+    const json edges = graph.value("edges", json::array());
+    for (const auto& entry : edges) {
+        std::string from, to;
+        if (!parseEdgeEnds(entry, from, to)) {
+            std::cerr << "[WARN] EffectGraph: Each edge needs 'from' and 'to' node ids." << std::endl;
+            return false;
+        }
+        const size_t source = findNode(from);
+        const size_t target = findNode(to);
+        if (source == nodes_.size() || target == nodes_.size() || source == kOutput || target == kInput) {
+            std::cerr << "[WARN] EffectGraph: Invalid edge '" << from << "' -> '" << to << "'." << std::endl;
+            return false;
+        }
+        Edge edge;
+        edge.from = source;
+        if (entry.is_object()) {
+            edge.gain = entry.value("gain", 1.0f);
+            const std::string matrix = entry.value("matrix", "none");
+            if (matrix == "mid") {
+                edge.matrix = Matrix::Mid;
+            } else if (matrix == "side") {
+                edge.matrix = Matrix::Side;
+            } else if (matrix != "none") {
+                std::cerr << "[WARN] EffectGraph: Unknown edge matrix '" << matrix << "' (available: none, mid, side)." << std::endl;
+                return false;
+            }
+        }
+        nodes_[target].inputs.push_back(edge);
+        nodes_[source].successors.push_back(target);
+    }
+    if (nodes_[kOutput].inputs.empty()) {
+        std::cerr << "[WARN] EffectGraph: No edge reaches 'output'." << std::endl;
+        return false;
+    }
+
+    // 3. トポロジカル順を求め（循環があれば失敗）、input からの深さを求める
+    std::vector<size_t> indegree(nodes_.size());
+    for (size_t i = 0; i < nodes_.size(); ++i) indegree[i] = nodes_[i].inputs.size();
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (indegree[i] == 0) {
+            order_.push_back(i);
+            roots_.push_back(i);
+        }
+    }
+    for (size_t k = 0; k < order_.size(); ++k) {
+        const Node& node = nodes_[order_[k]];
+        for (size_t next : node.successors) {
+            nodes_[next].depth = std::max(nodes_[next].depth, node.depth + 1);
+            if (--indegree[next] == 0) order_.push_back(next);
+        }
+    }
+    if (order_.size() != nodes_.size()) {
+        std::cerr << "[WARN] EffectGraph: The graph has a cycle." << std::endl;
+        return false;
+    }
+
+    // output に届かないノードは実行しても出力に影響しない
+    std::vector<bool> reaches(nodes_.size(), false);
+    reaches[kOutput] = true;
+    for (size_t k = order_.size(); k-- > 0;) {
+        for (size_t next : nodes_[order_[k]].successors) {
+            if (reaches[next]) reaches[order_[k]] = true;
+        }
+    }
+    for (size_t i = 2; i < nodes_.size(); ++i) {
+        if (!reaches[i]) std::cerr << "[WARN] EffectGraph: Node '" << nodes_[i].id << "' is not connected to 'output'." << std::endl;
+    }
+
+    // 4. バッファとスレッドを用意する。自動のスレッド数は同じ深さにあるノード数の最大（グラフの幅）で抑える
+    for (Node& node : nodes_) node.buffer.reserve(max_block_frames * static_cast<size_t>(channels_));
+    compensateLatency(max_block_frames);
+    pending_.reset(new std::atomic<size_t>[nodes_.size()]);
+    std::vector<size_t> width(nodes_.size(), 0);
+    size_t max_width = 1;
+    for (size_t i = 2; i < nodes_.size(); ++i) max_width = std::max(max_width, ++width[nodes_[i].depth]);
+    int threads = graph.value("threads", 0);
+    if (threads <= 0) {
+        const size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+        threads = static_cast<int>(std::min(cores, max_width));
+    }
+    pool_.start(static_cast<size_t>(threads), nodes_.size());
+    return true;
+}
+
+void EffectGraph::process(std::vector<float>& block) {
+    if (nodes_.empty() || channels_ <= 0) return;
+    frames_ = block.size() / static_cast<size_t>(channels_);
+    input_ = &block;
+    for (size_t i = 0; i < nodes_.size(); ++i) pending_[i].store(nodes_[i].inputs.size(), std::memory_order_relaxed);
+    pool_.run(*this, roots_, nodes_.size());
+    const std::vector<float>& output = nodes_[kOutput].buffer;
+    std::copy(output.begin(), output.end(), block.begin());
+}
+
+void EffectGraph::reset() {
+    for (Node& node : nodes_) {
+        if (node.effect) node.effect->reset();
+        for (Edge& edge : node.inputs) std::fill(edge.line.begin(), edge.line.end(), 0.0f);
+    }
+}
+
+void EffectGraph::serializeState(StateArchive& ar) {
+    uint64_t count = nodes_.size();
+    ar(count);
+    if (count != nodes_.size()) {
+        ar.fail();
+        return;
+    }
+    for (Node& node : nodes_) {
+        if (node.effect) AudioEffect::transferState(*node.effect, ar);
+        for (Edge& edge : node.inputs) ar(edge.line);
+    }
+}
+
+void EffectGraph::execute(size_t task, size_t worker) {
+    Node& node = nodes_[task];
+    if (task == kInput) {
+        node.buffer.assign(input_->begin(), input_->end());
+    } else {
+        mixInputs(node);
+        if (node.effect && node.effect->isActive()) node.effect->process(node.buffer, channels_);
+    }
+    // 最後の入力を満たした前段が後続を自分のキューに積む
+    for (size_t next : node.successors) {
+        if (pending_[next].fetch_sub(1, std::memory_order_acq_rel) == 1) pool_.push(worker, next);
+    }
+}
+
+void EffectGraph::mixInputs(Node& node) {
+    const size_t channels = static_cast<size_t>(channels_);
+    const size_t samples = frames_ * channels;
+    if (node.inputs.size() == 1 && node.inputs[0].gain == 1.0f && node.inputs[0].matrix == Matrix::None && node.inputs[0].delay == 0) {
+        const std::vector<float>& source = nodes_[node.inputs[0].from].buffer;
+        node.buffer.assign(source.begin(), source.begin() + static_cast<std::ptrdiff_t>(samples));
+        return;
+    }
+    node.buffer.assign(samples, 0.0f);
+    for (Edge& edge : node.inputs) {
+        addEdge(edge, delayEdge(edge, nodes_[edge.from].buffer.data()), node.buffer.data());
+        // 遅延線の末尾 delay フレームを次のブロックの履歴として先頭へ移す
+        if (edge.delay > 0) {
+            const size_t history = edge.delay * channels;
+            std::copy(edge.line.begin() + static_cast<std::ptrdiff_t>(samples),
+                      edge.line.begin() + static_cast<std::ptrdiff_t>(samples + history), edge.line.begin());
+        }
+    }
+}
+
+void EffectGraph::addEdge(const Edge& edge, const float* src, float* dst) const {
+    const size_t channels = static_cast<size_t>(channels_);
+    const size_t samples = frames_ * channels;
+    const float gain = edge.gain;
+    if (edge.matrix == Matrix::None) {
+        for (size_t i = 0; i < samples; ++i) dst[i] += gain * src[i];
+        return;
+    }
+    // M/S: 左右の組は (M, M) または (S, -S)、組にならないチャンネルは M 側だけにそのまま通す
+    const bool mid = (edge.matrix == Matrix::Mid);
+    const float half = 0.5f * gain;
+    if (mid) {
+        for (size_t c : unpaired_) {
+            for (size_t i = 0; i < frames_; ++i) dst[i * channels + c] += gain * src[i * channels + c];
+        }
+    }
+    for (const auto& pair : layout_.stereoPairs()) {
+        const size_t l = static_cast<size_t>(pair.first), r = static_cast<size_t>(pair.second);
+        for (size_t i = 0; i < frames_; ++i) {
+            const float left = src[i * channels + l], right = src[i * channels + r];
+            const float value = mid ? half * (left + right) : half * (left - right);
+            dst[i * channels + l] += value;
+            dst[i * channels + r] += mid ? value : -value;
+        }
+    }
+}
+
+void EffectGraph::compensateLatency(size_t max_block_frames) {
+    // 各ノードの出力の遅延（input から）を求め、入力エッジを最も遅い入力に揃える
+    std::vector<size_t> latency(nodes_.size(), 0);
+    for (size_t index : order_) {
+        Node& node = nodes_[index];
+        size_t longest = 0;
+        for (const Edge& edge : node.inputs) longest = std::max(longest, latency[edge.from]);
+        for (Edge& edge : node.inputs) {
+            edge.delay = longest - latency[edge.from];
+            edge.line.assign(edge.delay > 0 ? (edge.delay + max_block_frames) * static_cast<size_t>(channels_) : 0, 0.0f);
+        }
+        const bool active = node.effect && node.effect->isActive();
+        latency[index] = longest + (active ? node.effect->getLatencySamples() : 0);
+    }
+}
+
+const float* EffectGraph::delayEdge(Edge& edge, const float* source) {
+    if (edge.delay == 0) return source;
+    const size_t channels = static_cast<size_t>(channels_);
+    const size_t history = edge.delay * channels;
+    const size_t samples = frames_ * channels;
+    if (edge.line.size() < history + samples) edge.line.resize(history + samples, 0.0f);
+    // [履歴 delay フレーム | 今のブロック] の先頭 frames_ フレームが遅れた信号
+    std::copy(source, source + samples, edge.line.begin() + static_cast<std::ptrdiff_t>(history));
+    return edge.line.data();
+}
+
+size_t EffectGraph::latencySamples() const {
+    std::vector<size_t> latency(nodes_.size(), 0);
+    for (size_t index : order_) {
+        const Node& node = nodes_[index];
+        size_t longest = 0;
+        for (const Edge& edge : node.inputs) longest = std::max(longest, latency[edge.from]);
+        const bool active = node.effect && node.effect->isActive();
+        latency[index] = longest + (active ? node.effect->getLatencySamples() : 0);
+    }
+    return latency.empty() ? 0 : latency[kOutput];
+}
+
+uint64_t EffectGraph::deadlineMisses() const {
+    uint64_t total = 0;
+    for (const Node& node : nodes_) {
+        if (node.effect) total += node.effect->getDeadlineMisses();
+    }
+    return total;
+}
+
+std::vector<std::pair<std::string, AudioEffect*>> EffectGraph::automationTargets() const {
+    std::vector<std::pair<std::string, AudioEffect*>> targets;
+    for (const Node& node : nodes_) {
+        if (node.effect) targets.emplace_back(node.id, node.effect.get());
+    }
+    for (const Node& node : nodes_) {
+        if (node.effect) targets.emplace_back(node.effect->getName(), node.effect.get());
+    }
+    return targets;
+}
+
+std::vector<std::string> EffectGraph::describe() const {
+    std::vector<std::string> lines;
+    for (size_t index : order_) {
+        if (index == kInput) continue;
+        const Node& node = nodes_[index];
+        std::string line = node.id;
+        if (node.effect) line += " (" + node.effect->getName() + (node.effect->isActive() ? "" : ", inactive") + ")";
+        std::string sources;
+        for (const Edge& edge : node.inputs) {
+            std::string source = nodes_[edge.from].id;
+            if (edge.gain != 1.0f) source += " x" + std::to_string(edge.gain).substr(0, 5);
+            if (edge.matrix != Matrix::None) source += (edge.matrix == Matrix::Mid) ? " [mid]" : " [side]";
+            sources += (sources.empty() ? "" : ", ") + source;
+        }
+        lines.push_back(line + " <- " + (sources.empty() ? "(silence)" : sources));
+    }
+    return lines;
+}
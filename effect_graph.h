@@ -0,0 +1,109 @@
+// ./effect_graph.h
+// エフェクトを有向非巡回グラフ（並列の帯域、ドライ/ウェット、M/S分割）で接続し、独立な枝を並列に実行する
+#pragma once
+
+#include "AudioEffect.h"
+#include "channel_layout.h"
+#include "task_pool.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <utility>
+
+/**
+ * @class EffectGraph
+ * @brief params.json の "effect_graph" で記述したエフェクトのグラフを実行する
+ *
+ * ノードは登録済みのエフェクト、エッジはノードの出力バッファを次のノードの入力に足し込む
+ * 接続（ゲインと M/S 行列を指定できる）。特別なノード "input"（チェーンへの入力）と
+ * "output"（チェーンの出力）を持つ。
+ *
+ *   "effect_graph": {
+ *     "enabled": true,
+ *     "threads": 0,                                   // 0 はグラフの幅とコア数から自動
+ *     "nodes": [ { "id": "wet", "effect": "exciter", "params": "exciter" } ],
+ *     "edges": [ { "from": "input", "to": "wet" },
+ *                { "from": "wet", "to": "output", "gain": 0.7 },
+ *                { "from": "input", "to": "output", "gain": 0.3 } ]
+ *   }
+ *
+ * "params" は params.json のキー名（省略時はエフェクト名）か、パラメータのオブジェクト。
+ * エッジの "matrix": "mid" は左右の組を (M, M)、"side" は (S, -S) にして足し込むため、
+ * M と S の枝をそのまま "output" で合流させると L = M + S, R = M - S に戻る。
+ *
+ * ブロックごとに、前段がすべて終わったノードから WorkStealingPool で並列に実行する。
+ * ノードの入力はエッジの宣言順に足し込むので、スケジュールによらず出力は同じになる。
+ * 遅延（getLatencySamples）の異なる枝を合流させると櫛形フィルタになるため、構築時に各ノードの
+ * 入力エッジのうち遅延の短いものを最長のものに揃えて遅らせる（エッジごとの遅延線）。
+ * バッファはノードごとに1本で、構築時に確保する（より長いブロックが来たときだけ拡張する）。
+ * 直列チェーンの実行計画（融合・フィルタバンク・無音区間の省略・解析バス）は使わない。
+ */
+class EffectGraph : private WorkStealingPool::Client {
+public:
+    ~EffectGraph() override { pool_.stop(); }
+
+    /**
+     * @brief グラフを構築する
+     * @return 構成が正しければ true。誤り（未知のノード・エフェクト、循環など）は警告して false を返す
+     */
+    bool build(const json& graph, const json& params, const ChannelLayout& layout, double sr, size_t max_block_frames);
+    void process(std::vector<float>& block);
+    void reset();
+    // ノードのエフェクトの状態を保存・復元する（AudioEffect::transferState）
+    void serializeState(StateArchive& ar);
+
+    // input から output までの経路のうち、ノードの遅延（getLatencySamples）の和が最大のもの
+    // （エッジの遅延線で揃えるため、どの経路もこの遅延になる）
+    size_t latencySamples() const;
+    // ノードのエフェクトがワーカーの結果を待った回数の合計（AudioEffect::getDeadlineMisses）
+    uint64_t deadlineMisses() const;
+
+    // オートメーションの対象（ノードの id とエフェクト。続けてエフェクト名でも引けるように並べる）
+    std::vector<std::pair<std::string, AudioEffect*>> automationTargets() const;
+
+    // 実行計画の表示用（ノードごとに1行、実行順）
+    std::vector<std::string> describe() const;
+    size_t numThreads() const { return pool_.numWorkers(); }
+
+private:
+    enum class Matrix { None, Mid, Side };
+    struct Edge {
+        size_t from = 0;
+        float gain = 1.0f;
+        Matrix matrix = Matrix::None;
+        size_t delay = 0;               // 遅延の補償（フレーム数）
+        std::vector<float> line;        // 遅延線（delay フレームの履歴の後ろに今のブロックを書く）
+    };
+    struct Node {
+        std::string id;
+        std::unique_ptr<AudioEffect> effect;    // "input" / "output" は nullptr
+        std::vector<Edge> inputs;               // 宣言順に足し込む
+        std::vector<size_t> successors;         // エッジごとに1つ（同じノードへの複数のエッジは重複する）
+        std::vector<float> buffer;              // このノードの出力
+        size_t depth = 0;                       // input からの最長距離（並列度の見積もり用）
+    };
+
+    static constexpr size_t kInput = 0;
+    static constexpr size_t kOutput = 1;
+
+    std::vector<Node> nodes_;
+    std::vector<size_t> order_;                 // トポロジカル順
+    std::vector<size_t> roots_;                 // 入力エッジを持たないノード
+    std::unique_ptr<std::atomic<size_t>[]> pending_;   // 未完了の入力エッジ数（ブロックごとに戻す）
+    ChannelLayout layout_;
+    std::vector<size_t> unpaired_;              // 左右の組に属さないチャンネル（M/S 行列では M 側に通す）
+    int channels_ = 0;
+    size_t frames_ = 0;
+    const std::vector<float>* input_ = nullptr;
+    WorkStealingPool pool_;
+
+    void execute(size_t task, size_t worker) override;
+    void mixInputs(Node& node);
+    // ノードの遅延から各エッジの補償量を決め、遅延線を確保する
+    void compensateLatency(size_t max_block_frames);
+    // エッジの遅延線に source を通し、delay フレーム遅らせた frames_ フレームの先頭を返す
+    const float* delayEdge(Edge& edge, const float* source);
+    // エッジのゲインと M/S 行列を掛けて dst に足し込む
+    void addEdge(const Edge& edge, const float* src, float* dst) const;
+};
@@ -0,0 +1,90 @@
+// ./fft_plan_registry.cpp
+#include "fft_plan_registry.h"
+#include <iostream>
+#include <chrono>
+#include <stdexcept>
+
+FFTPlanRegistry::~FFTPlanRegistry() {
+    for (auto& entry : plans_) {
+        fftwf_destroy_plan(entry.second);
+    }
+}
+
+fftwf_plan FFTPlanRegistry::getForward(size_t n) {
+    return getPlan(n, Kind::R2C);
+}
+
+fftwf_plan FFTPlanRegistry::getInverse(size_t n) {
+    return getPlan(n, Kind::C2R);
+}
+
+fftwf_plan FFTPlanRegistry::getPlan(size_t n, Kind kind) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto key = std::make_pair(n, kind);
+    auto it = plans_.find(key);
+    if (it != plans_.end()) return it->second;
+
+    // MEASURE/PATIENTは作業配列を書き換えるため、専用の配列で計画する
+    FFTWVector<float> real(n, 0.0f);
+    FFTWVector<std::complex<float>> complex(n / 2 + 1);
+    auto* complex_ptr = reinterpret_cast<fftwf_complex*>(complex.data());
+
+    auto start = std::chrono::steady_clock::now();
+    fftwf_plan plan = (kind == Kind::R2C)
+        ? fftwf_plan_dft_r2c_1d(static_cast<int>(n), real.data(), complex_ptr, planner_flags_)
+        : fftwf_plan_dft_c2r_1d(static_cast<int>(n), complex_ptr, real.data(), planner_flags_);
+    if (!plan) {
+        throw std::runtime_error("FFTPlanRegistry: Failed to create FFTW plan of size " + std::to_string(n));
+    }
+    auto elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (elapsed_ms > 50.0) {
+        std::cout << "[INFO] FFTPlanRegistry: Planned " << (kind == Kind::R2C ? "r2c" : "c2r") << " size " << n
+                  << " in " << elapsed_ms << " ms" << std::endl;
+    }
+
+    plans_[key] = plan;
+    wisdom_dirty_ = true;
+    return plan;
+}
+
+void FFTPlanRegistry::executeForwardOnce(size_t n, float* in, std::complex<float>* out) {
+    // FFTWのプランの作成と破棄はスレッドセーフでないため、共有のプランと同じロックで行う。
+    // FFTW_ESTIMATE は配列を書き換えずに計画する
+    std::lock_guard<std::mutex> lock(mutex_);
+    fftwf_plan plan = fftwf_plan_dft_r2c_1d(static_cast<int>(n), in, reinterpret_cast<fftwf_complex*>(out), FFTW_ESTIMATE);
+    if (!plan) {
+        throw std::runtime_error("FFTPlanRegistry: Failed to create FFTW plan of size " + std::to_string(n));
+    }
+    fftwf_execute(plan);
+    fftwf_destroy_plan(plan);
+}
+
+void FFTPlanRegistry::setPlannerLevel(const std::string& level) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (level == "estimate") planner_flags_ = FFTW_ESTIMATE;
+    else if (level == "patient") planner_flags_ = FFTW_PATIENT;
+    else if (level == "exhaustive") planner_flags_ = FFTW_EXHAUSTIVE;
+    else planner_flags_ = FFTW_MEASURE;
+}
+
+bool FFTPlanRegistry::loadWisdom(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wisdom_path_ = path;
+    if (fftwf_import_wisdom_from_filename(path.c_str()) == 0) {
+        std::cout << "[INFO] FFTPlanRegistry: No usable FFTW wisdom at " << path << " (plans will be measured)." << std::endl;
+        return false;
+    }
+    std::cout << "[INFO] FFTPlanRegistry: Loaded FFTW wisdom from " << path << std::endl;
+    return true;
+}
+
+bool FFTPlanRegistry::saveWisdom() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!wisdom_dirty_ || wisdom_path_.empty()) return true;
+    if (fftwf_export_wisdom_to_filename(wisdom_path_.c_str()) == 0) {
+        std::cerr << "[WARN] FFTPlanRegistry: Failed to write FFTW wisdom to " << wisdom_path_ << std::endl;
+        return false;
+    }
+    wisdom_dirty_ = false;
+    return true;
+}
@@ -0,0 +1,100 @@
+// ./fft_plan_registry.h
+// プロセス全体で共有するFFTWプランのレジストリとWisdomキャッシュ
+#pragma once
+
+#include <fftw3.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <complex>
+#include <cstddef>
+#include <new>
+
+/**
+ * @brief fftwf_malloc でSIMDアラインされた領域を確保するアロケーター
+ *
+ * レジストリのプランは新配列実行（fftwf_execute_dft_r2c など）で使うため、
+ * 実行時に渡す配列もプラン作成時と同じアラインメントである必要があります。
+ */
+template<typename T>
+struct FFTWAllocator {
+    using value_type = T;
+    FFTWAllocator() = default;
+    template<typename U> FFTWAllocator(const FFTWAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        void* p = fftwf_malloc(n * sizeof(T));
+        if (!p) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, size_t) { fftwf_free(p); }
+
+    template<typename U> bool operator==(const FFTWAllocator<U>&) const { return true; }
+    template<typename U> bool operator!=(const FFTWAllocator<U>&) const { return false; }
+};
+
+template<typename T>
+using FFTWVector = std::vector<T, FFTWAllocator<T>>;
+
+/**
+ * @class FFTPlanRegistry
+ * @brief サイズとレイアウトごとにFFTWプランを1つだけ作成し、全エフェクトで共有する
+ *
+ * プランはアラインされた作業配列に対して FFTW_MEASURE / FFTW_PATIENT で作成し、
+ * 以降は fftwf_execute_dft_r2c / fftwf_execute_dft_c2r で任意の配列に対して実行します。
+ * 新配列実行はスレッドセーフですが、プランの作成はこのクラスのロック下でのみ行います。
+ */
+class FFTPlanRegistry {
+public:
+    static FFTPlanRegistry& getInstance() {
+        static FFTPlanRegistry instance;
+        return instance;
+    }
+
+    /**
+     * @brief 実数→複素数（r2c）の1次元・アウトオブプレース変換プランを取得する
+     * @param n 変換長
+     */
+    fftwf_plan getForward(size_t n);
+
+    /**
+     * @brief 複素数→実数（c2r）の1次元・アウトオブプレース変換プランを取得する
+     * @param n 変換長（出力の実数サンプル数）
+     * @note c2r は入力配列を破壊します
+     */
+    fftwf_plan getInverse(size_t n);
+
+    /**
+     * @brief 1回だけ使う長さの r2c 変換を実行する（IRの解析など）
+     *
+     * プランは FFTW_ESTIMATE でロック下に作成・実行・破棄し、共有のプランには加えない。
+     * in は破壊しない。
+     */
+    void executeForwardOnce(size_t n, float* in, std::complex<float>* out);
+
+    // プラン作成時の探索レベルを設定する（"estimate" / "measure" / "patient" / "exhaustive"）
+    void setPlannerLevel(const std::string& level);
+
+    // Wisdomファイルを読み込む。以降の saveWisdom() もこのパスへ書き出す
+    bool loadWisdom(const std::string& path);
+
+    // 前回の保存以降に新しいプランを作成していればWisdomを書き出す
+    bool saveWisdom();
+
+private:
+    enum class Kind { R2C, C2R };
+
+    FFTPlanRegistry() = default;
+    ~FFTPlanRegistry();
+    FFTPlanRegistry(const FFTPlanRegistry&) = delete;
+    FFTPlanRegistry& operator=(const FFTPlanRegistry&) = delete;
+
+    fftwf_plan getPlan(size_t n, Kind kind);
+
+    std::map<std::pair<size_t, Kind>, fftwf_plan> plans_;
+    unsigned planner_flags_ = FFTW_MEASURE;
+    std::string wisdom_path_;
+    bool wisdom_dirty_ = false;
+    std::mutex mutex_;
+};
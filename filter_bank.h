@@ -0,0 +1,72 @@
+// ./filter_bank.h
+// チェーン内で隣接する線形フィルタ（バイクアッドの縦続接続）をまとめて実行するフィルタバンク
+#pragma once
+#include "SimpleBiquad.h"
+#include "AudioEffect.h"
+#include "channel_kernel.h"
+#include "channel_biquad.h"
+#include <vector>
+#include <string>
+
+/**
+ * @class FilterBank
+ * @brief EffectChain の実行計画で、getBiquadCascade() を実装する連続したエフェクトを置き換える
+ *
+ * 各段は元のエフェクトと同じ係数・同じ順序で処理するため、出力は個別に実行した場合と同一です。
+ * 全チャンネルの各段をフレームごとにまとめて更新するので、エフェクト間の仮想呼び出しとループが1つにまとまります。
+ */
+class FilterBank : public AudioEffect {
+public:
+    void setup(double sr, const json& params) override { (void)sr; (void)params; }
+
+    void append(const std::vector<BiquadCoefficients>& sections) {
+        sections_.insert(sections_.end(), sections.begin(), sections.end());
+        channels_ = 0;
+        for (const auto& c : sections) {
+            SimpleBiquad probe;
+            probe.set_coefficients(c);
+            tail_samples_ = addTails(tail_samples_, probe.ring_down_samples());
+        }
+    }
+
+    void process(std::vector<float>& block, int channels) override {
+        if (channels <= 0 || sections_.empty()) return;
+        if (channels != channels_) prepareChannels(channels);
+        kernel_.run(*this, block);
+    }
+
+    void setChannelCount(int channels) override { prepareChannels(channels); }
+
+    void reset() override { cascade_.reset(); }
+    bool serializeState(StateArchive& ar) override { ar(cascade_); return true; }
+
+    bool isFusable() const override { return true; }
+    bool getBiquadCascade(std::vector<BiquadCoefficients>& sections) const override {
+        sections.insert(sections.end(), sections_.begin(), sections_.end());
+        return true;
+    }
+    size_t getTailSamples() const override { return tail_samples_; }
+    const std::string& getName() const override { return name_; }
+    size_t numSections() const { return sections_.size(); }
+
+private:
+    std::string name_ = "filter_bank";
+    std::vector<BiquadCoefficients> sections_;
+    ChannelBiquadCascade cascade_;                      // 全チャンネル分の各段の状態
+    int channels_ = 0;
+    size_t tail_samples_ = 0;
+    ChannelKernel<FilterBank> kernel_;
+
+    void prepareChannels(int channels) {
+        channels_ = channels;
+        std::vector<int> all(static_cast<size_t>(channels));
+        for (int c = 0; c < channels; ++c) all[static_cast<size_t>(c)] = c;
+        cascade_.configure(sections_, all);
+        kernel_.select(channels, &FilterBank::processKernel<1>, &FilterBank::processKernel<2>, &FilterBank::processKernel<0>);
+    }
+
+    template <int Channels>
+    void processKernel(float* block, size_t frames, int channels) {
+        cascade_.process<Channels>(block, frames, kernelChannels<Channels>(channels));
+    }
+};
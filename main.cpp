@@ -15,8 +15,14 @@
 #include <queue>
 #include <memory>
 #include <filesystem>
+#include <map>
+#include <deque>
+#include <numeric>
+#include <functional>
+#include <climits>
 
 #include <samplerate.h>
+#include <sndfile.h>
 #include <portaudio.h>
 #include <nlohmann/json.hpp>
 
@@ -27,6 +33,16 @@
 #include "advanced_eq_harmonics.h"
 #include "spatial_processing.h"
 #include "custom_effects.h"
+#include "convolver.h"
+#include "fft_plan_registry.h"
+#include "stft_engine.h"
+#include "analysis_bus.h"
+#include "filter_bank.h"
+#include "effect_graph.h"
+#include "automation.h"
+#include "task_pool.h"
+#include "realtime_scheduling.h"
+#include "benchmark.h"
 
 using json = nlohmann::json;
 
@@ -34,6 +50,8 @@ using json = nlohmann::json;
 const double TARGET_SAMPLE_RATE = 192000.0; // 48kHzから192kHzへ変更
 const unsigned int PROCESSING_BLOCK_SIZE = 512;
 const size_t RING_BUFFER_FRAMES = 8192;
+const size_t FUSION_TILE_FRAMES = 64;         // 融合ループのタイル長（4の倍数。作業データがL1キャッシュに収まる長さ）
+const float SILENCE_THRESHOLD = 1.0f / 16777216.0f;  // 無音とみなす振幅（-144dBFS、24bitの1LSB未満）
 
 // --- ログ出力用マクロ ---
 #define LOG_INFO(msg) std::cout << "[INFO] " << msg << std::endl
@@ -59,7 +77,8 @@ public:
         return true;
     }
 
-    size_t pop(T* data, size_t frames) {
+    // first_frame には取り出した先頭のフレームの位置（clear() で指定した位置からの通し番号）を返す
+    size_t pop(T* data, size_t frames, long long* first_frame = nullptr) {
         std::lock_guard<std::mutex> lock(mutex_);
         size_t samples_to_read = frames * channels_;
         size_t available = available_read_samples();
@@ -69,6 +88,8 @@ public:
             data[i] = buffer_[read_pos_];
             read_pos_ = (read_pos_ + 1) % size_;
         }
+        if (first_frame) *first_frame = read_frame_;
+        read_frame_ += static_cast<long long>(to_read / channels_);
         return to_read / channels_;
     }
 
@@ -80,7 +101,10 @@ public:
         std::lock_guard<std::mutex> lock(mutex_);
         return available_write_samples() / channels_;
     }
-    void clear() { std::lock_guard<std::mutex> lock(mutex_); read_pos_ = write_pos_ = 0; }
+    // バッファの全ページを割り当てておく（処理中のページフォルトを避ける）
+    void prefault() { prefaultBuffer(buffer_.data(), buffer_.size() * sizeof(T)); }
+    // 空にし、次に積むフレームの位置を read_frame とする
+    void clear(long long read_frame = 0) { std::lock_guard<std::mutex> lock(mutex_); read_pos_ = write_pos_ = 0; read_frame_ = read_frame; }
 
 private:
     size_t available_read_samples() const {
@@ -94,19 +118,50 @@ private:
     size_t channels_;
     std::atomic<size_t> read_pos_{0};
     std::atomic<size_t> write_pos_{0};
+    long long read_frame_ = 0;
     mutable std::mutex mutex_;
 };
 
 // --- エフェクトチェーンクラス ---
 class EffectChain {
 public:
-    void setup(const json& params, int channels, double sr) {
+    /**
+     * @param max_block_frames process() に渡す最大のブロック長（リサンプル後）。STFTのフレームプールなどの
+     *                         作業バッファをこの長さで確保し、処理スレッドで確保しないようにする
+     */
+    void setup(const json& params, int channels, double sr, size_t max_block_frames = PROCESSING_BLOCK_SIZE) {
         std::lock_guard<std::mutex> lock(mutex_);
         channels_ = channels;
         sample_rate_ = sr;
+        max_block_frames_ = std::max<size_t>(max_block_frames, 1);
+        split_.reserve(max_block_frames_ * static_cast<size_t>(channels));
 
         effects_.clear();
         LOG_INFO("Building effect chain...");
+        layout_ = ChannelLayout::fromJson(params.value("channel_layout", json()), channels);
+        LOG_INFO("  -> Channel layout: " << layout_.describe());
+
+        // "effect_graph" が有効ならグラフで実行する（構成に誤りがあれば effect_chain_order の直列チェーンに戻る）
+        graph_.reset();
+        stages_.clear();
+        filter_banks_.clear();
+        automation_.load(params.value("automation", json()));
+        timeline_frame_ = 0;
+        if (params.contains("effect_graph") && params["effect_graph"].is_object() && params["effect_graph"].value("enabled", true)) {
+            auto graph = std::make_unique<EffectGraph>();
+            if (graph->build(params["effect_graph"], params, layout_, sample_rate_, max_block_frames_)) {
+                graph_ = std::move(graph);
+                const std::vector<std::string> lines = graph_->describe();
+                LOG_INFO("Effect graph (" << lines.size() - 1 << " nodes, " << graph_->numThreads() << " threads):");
+                for (const auto& line : lines) LOG_INFO("  " << line);
+                // レーンのキーはノードの id（"<id>.<パラメータ名>"）。id にないものはエフェクト名で探す
+                automation_.bind(graph_->automationTargets(), sample_rate_);
+                if (!automation_.empty()) LOG_INFO("  -> Automation: " << automation_.numLanes() << " lanes");
+                LOG_INFO("Effect chain built.");
+                return;
+            }
+            LOG_WARN("  -> Invalid effect_graph. Using effect_chain_order instead.");
+        }
 
         if (params.contains("effect_chain_order") && params["effect_chain_order"].is_array()) {
             const auto& order = params["effect_chain_order"];
@@ -118,6 +173,7 @@ public:
 
                     if (effect) {
                         effect->setup(sample_rate_, params.value(effect_key, json({})));
+                        effect->setChannelLayout(layout_);
                         LOG_INFO("  -> Loaded: " << effect->getName());
                         effects_.push_back(std::move(effect));
                     } else {
@@ -128,29 +184,786 @@ public:
         } else {
             LOG_WARN("'effect_chain_order' not found or not an array in params.json. No effects will be loaded.");
         }
+        automation_.bind(effects_, sample_rate_);
+        if (!automation_.empty()) LOG_INFO("  -> Automation: " << automation_.numLanes() << " lanes");
+        connectAnalysisBus();
+        compileStages();
         LOG_INFO("Effect chain built.");
     }
 
     void process(std::vector<float>& block) {
         std::lock_guard<std::mutex> lock(mutex_);
         if (block.empty() || channels_ == 0) return;
-
-        for (auto& effect : effects_) {
-            effect->process(block, channels_);
+        // setup() で指定した最大長より長いブロックは分けて処理する（解析バスなどの作業バッファを処理中に拡張しない）
+        const size_t channels = static_cast<size_t>(channels_);
+        const size_t total_frames = block.size() / channels;
+        if (total_frames <= max_block_frames_) {
+            processBlock(block);
+            return;
+        }
+        for (size_t start = 0; start < total_frames; start += max_block_frames_) {
+            const size_t frames = std::min(max_block_frames_, total_frames - start);
+            float* piece = block.data() + start * channels;
+            split_.assign(piece, piece + frames * channels);
+            processBlock(split_);
+            std::copy(split_.begin(), split_.end(), piece);
         }
     }
 
+
     void reset() {
         std::lock_guard<std::mutex> lock(mutex_);
-        for (auto& effect : effects_) {
-            effect->reset();
+        resetUnlocked();
+    }
+
+    /**
+     * @brief 全エフェクト・フィルタバンク・STFT・解析バスの処理状態を保存または復元する
+     *
+     * 同じパラメータで構築したチェーンの間でのみ有効。復元できなかった場合はチェーン全体を
+     * reset() した状態になる（非対応のエフェクトは個別に reset() される）。
+     * オートメーションの時刻は含めないため、復元後に seekTimeline() で合わせる。
+     */
+    void serializeState(StateArchive& ar) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (graph_) {
+            graph_->serializeState(ar);
+        } else {
+            uint64_t counts[3] = {effects_.size(), filter_banks_.size(), stages_.size()};
+            ar(counts);
+            if (counts[0] != effects_.size() || counts[1] != filter_banks_.size() || counts[2] != stages_.size()) ar.fail();
+            for (auto& effect : effects_) {
+                if (!ar.ok()) break;
+                AudioEffect::transferState(*effect, ar);
+            }
+            for (auto& bank : filter_banks_) {
+                if (!ar.ok()) break;
+                AudioEffect::transferState(*bank, ar);
+            }
+            for (auto& stage : stages_) {
+                if (!ar.ok()) break;
+                if (stage.stft) ar(*stage.stft);
+                ar(stage.silent_frames, stage.idle);
+            }
+            ar(bus_, chain_idle_);
+        }
+        if (!ar.saving() && !ar.ok()) resetUnlocked();
+    }
+
+    // オートメーションの時刻（曲の先頭からの秒）を移す。reset() は時刻を変えない
+    void seekTimeline(double seconds) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        timeline_frame_ = static_cast<uint64_t>(std::max(0.0, seconds) * sample_rate_ + 0.5);
+        automation_.jump(timeline_frame_);
+    }
+
+    // 入力の影響が出力から消えるまでの長さ（有限なテール長の和。グラフでは0）。オフラインの区間処理で
+    // 状態を収束させるために手前から処理する長さの目安にする
+    size_t warmupFrames() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t total = 0;
+        for (const auto& stage : stages_) {
+            if (stage.tail != AudioEffect::kInfiniteTail) total = AudioEffect::addTails(total, stage.tail);
         }
+        return total;
+    }
+
+    // 出力が入力に対して遅れるサンプル数（ステージの遅延の和。グラフでは最も遅い経路）
+    size_t latencySamples() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (graph_) return graph_->latencySamples();
+        size_t total = 0;
+        for (const auto& stage : stages_) total += stage.latency;
+        return total;
+    }
+
+    // エフェクトがワーカーの結果を待った回数の合計（AudioEffect::getDeadlineMisses）。
+    // カウンタはアトミックなので処理中のロックは取らない（setup() と同時には呼ばない）
+    uint64_t deadlineMisses() const {
+        if (graph_) return graph_->deadlineMisses();
+        uint64_t total = 0;
+        for (const auto& effect : effects_) total += effect->getDeadlineMisses();
+        return total;
+    }
+
+    double timelineSeconds() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return (sample_rate_ > 0.0) ? static_cast<double>(timeline_frame_) / sample_rate_ : 0.0;
     }
 private:
+    // 実行計画の要素。連続するバイクアッド縦続のエフェクトは1つのフィルタバンクにまとめる
+    struct PlanItem {
+        AudioEffect* effect = nullptr;
+        std::vector<size_t> analysis_taps;  // 実行前に計算する解析バスのタップ
+        std::string label;
+        bool cascade = false;               // getBiquadCascade() で表せる
+        std::vector<BiquadCoefficients> sections;
+        FilterBank* bank = nullptr;         // 2つ以上をまとめた場合のフィルタバンク
+        size_t merged = 1;
+    };
+
+    // 実行単位。隣接する融合可能なエフェクト、または同じSTFT設定の周波数領域エフェクトは1つのステージにまとめる
+    struct Stage {
+        std::vector<AudioEffect*> effects;
+        std::vector<std::string> labels;
+        std::unique_ptr<StftEngine> stft;   // スペクトルセグメントの場合のみ（全エフェクトで共有）
+        std::vector<size_t> analysis_taps;  // ステージの入力で特徴量を計算する解析バスのタップ
+        size_t tail = 0;                    // 入力が無音になってから出力が無音になるまでのサンプル数
+        size_t latency = 0;                 // 出力の遅延（直列は各エフェクトの和、スペクトルセグメントは共有STFTの遅延）
+        size_t silent_frames = 0;           // 入力が無音だった連続フレーム数
+        bool idle = false;                  // テールを出し切り、実行を省略中
+        bool automated = false;             // オートメーションでパラメータが変わるエフェクトを含む
+    };
+
     int channels_ = 0;
+    ChannelLayout layout_;      // チャンネルの役割（params.json の channel_layout）
     double sample_rate_ = 0.0;
+    size_t max_block_frames_ = PROCESSING_BLOCK_SIZE;   // process() に渡される最大のブロック長
     std::vector<std::unique_ptr<AudioEffect>> effects_;
+    std::vector<Stage> stages_;
+    std::vector<std::unique_ptr<FilterBank>> filter_banks_;   // 実行計画でまとめたフィルタバンク
+    std::unique_ptr<EffectGraph> graph_;                      // "effect_graph" で構築した場合のみ
+    std::vector<float> tile_;   // 融合ループ用のタイルバッファ
+    std::vector<float> split_;  // 最大長を超えるブロックを分けて処理するためのバッファ
+    AnalysisBus bus_;
+    AutomationLanes automation_;
+    uint64_t timeline_frame_ = 0;   // 次のブロックの先頭の時刻（チェーンのサンプルレートでのフレーム数）
+    bool chain_idle_ = false;   // 全ステージが実行を省略中
+    mutable std::mutex mutex_;
+
+    // 最大長以内の1ブロックを処理する（mutex_ を保持して呼ぶ）
+    void processBlock(std::vector<float>& block) {
+        // オートメーションはブロック末尾の値へブロック内でランプさせる
+        const size_t num_frames = block.size() / static_cast<size_t>(channels_);
+        const bool automation_changed = automation_.apply(timeline_frame_, num_frames);
+        timeline_frame_ += num_frames;
+        if (graph_) {
+            graph_->process(block);
+            return;
+        }
+
+        // 無音の入力が続き、テールを出し切ったステージは reset() して実行を省略する（出力は厳密な0）。
+        // 信号が戻ったブロックでは、リセット済みの状態からブロック全体を処理するためサンプル単位で正確に再開する
+        bool silent = isSilent(block);
+        if (silent && chain_idle_) {
+            std::fill(block.begin(), block.end(), 0.0f);
+            return;
+        }
+        bool all_idle = true;
+        for (auto& stage : stages_) {
+            for (size_t tap : stage.analysis_taps) bus_.compute(tap, block);
+            if (silent && stage.silent_frames >= stage.tail) {
+                if (!stage.idle) {
+                    resetStage(stage);
+                    stage.idle = true;
+                }
+                std::fill(block.begin(), block.end(), 0.0f);
+                continue;
+            }
+            all_idle = false;
+            stage.idle = false;
+            if (stage.stft) {
+                processSpectral(stage, block);
+            } else if (stage.effects.size() == 1) {
+                stage.effects.front()->process(block, channels_);
+            } else {
+                processFused(stage, block);
+            }
+            // オートメーションで係数が変わるとテール長も変わるため、無音の省略に使う長さを計算し直す
+            if (automation_changed && stage.automated) stage.tail = stageTail(stage);
+            stage.silent_frames = silent ? AudioEffect::addTails(stage.silent_frames, num_frames) : 0;
+            silent = isSilent(block);
+        }
+        // チェーン全体が休止したら解析バスもリセットし、以降の無音ブロックは無音判定だけで返す
+        if (all_idle && !chain_idle_) bus_.reset();
+        chain_idle_ = all_idle;
+    }
+
+    void resetUnlocked() {
+        if (graph_) graph_->reset();
+        for (auto& effect : effects_) {
+            effect->reset();
+        }
+        for (auto& bank : filter_banks_) {
+            bank->reset();
+        }
+        for (auto& stage : stages_) {
+            if (stage.stft) stage.stft->reset();
+            stage.silent_frames = 0;
+            stage.idle = false;
+        }
+        bus_.reset();
+        chain_idle_ = false;
+    }
+
+    static bool isSilent(const std::vector<float>& block) {
+        // 早期終了しない最大値の計算はベクトル化される
+        float peak = 0.0f;
+        for (float sample : block) peak = std::max(peak, std::fabs(sample));
+        return peak < SILENCE_THRESHOLD;
+    }
+
+    // 直列のステージはテールの和、スペクトルセグメントは共有STFTのテール（各エフェクトの最大値）
+    static size_t stageTail(const Stage& stage) {
+        size_t tail = 0;
+        for (const auto* effect : stage.effects) {
+            const size_t effect_tail = effect->getTailSamples();
+            tail = stage.stft ? std::max(tail, effect_tail) : AudioEffect::addTails(tail, effect_tail);
+        }
+        return tail;
+    }
+
+    void resetStage(Stage& stage) {
+        for (auto* effect : stage.effects) effect->reset();
+        if (stage.stft) stage.stft->reset();
+    }
+
+    // 各エフェクトの解析特徴量の要求を解析バスに登録する
+    void connectAnalysisBus() {
+        bus_.configure(layout_, sample_rate_, max_block_frames_);
+        for (size_t i = 0; i < effects_.size(); ++i) {
+            bus_.beginEffect(i, effects_[i]->getName());
+            if (effects_[i]->isActive() || automation_.automates(effects_[i].get())) effects_[i]->declareAnalysis(bus_);
+        }
+        if (bus_.numRequests() > 0) {
+            LOG_INFO("  -> Analysis bus: " << bus_.numFeatures() << " features for " << bus_.numRequests() << " requests");
+        }
+    }
+
+    // 実行計画を作る:
+    //  1. isActive() が false のエフェクト（無効・恒等変換）を外す（オートメーションで動くものは残す）
+    //  2. 連続するバイクアッド縦続のエフェクトを1つのフィルタバンクにまとめる（係数がオートメーションで
+    //     変わるエフェクトはまとめない）
+    //  3. チェーン順を保ったまま、isFusable() が連続する区間と、同じSTFT設定の周波数領域エフェクトが
+    //     連続する区間（スペクトルセグメント）をそれぞれ1ステージにまとめる
+    // 解析バスのタップがある位置では、その時点のブロック全体から特徴量を計算するためまとめない
+    void compileStages() {
+        stages_.clear();
+        filter_banks_.clear();
+
+        std::vector<PlanItem> plan;
+        std::vector<size_t> pending_taps;
+        std::vector<std::string> skipped;
+        for (size_t index = 0; index < effects_.size(); ++index) {
+            AudioEffect* effect = effects_[index].get();
+            if (bus_.hasTap(index)) pending_taps.push_back(index);
+            const bool automated = automation_.automates(effect);
+            if (!effect->isActive() && !automated) {
+                skipped.push_back(effect->getName());
+                continue;
+            }
+
+            // フィルタバンクはすべてのチャンネルに同じ段を掛ける（LFEを素通しするEQは縦続として申告しない）
+            std::vector<BiquadCoefficients> sections;
+            const bool cascade = !automated && effect->getBiquadCascade(sections);
+            if (cascade && pending_taps.empty() && !plan.empty() && plan.back().cascade) {
+                PlanItem& last = plan.back();
+                if (!last.bank) {
+                    filter_banks_.push_back(std::make_unique<FilterBank>());
+                    last.bank = filter_banks_.back().get();
+                    last.bank->append(last.sections);
+                    last.effect = last.bank;
+                }
+                last.bank->append(sections);
+                last.bank->setChannelCount(channels_);
+                last.label += " + " + effect->getName();
+                ++last.merged;
+                continue;
+            }
+
+            PlanItem item;
+            item.effect = effect;
+            item.analysis_taps.swap(pending_taps);
+            item.label = effect->getName();
+            item.cascade = cascade;
+            item.sections = std::move(sections);
+            plan.push_back(std::move(item));
+        }
+
+        for (auto& item : plan) {
+            if (item.bank) {
+                item.label = "filter_bank[" + item.label + ", " + std::to_string(item.bank->numSections()) + " sections]";
+            }
+            const StftConfig config = item.effect->getStftConfig();
+            bool extend = false;
+            if (!stages_.empty() && item.analysis_taps.empty()) {
+                const Stage& last = stages_.back();
+                if (config.isSpectral()) {
+                    extend = last.stft && last.stft->getConfig() == config;
+                } else {
+                    extend = !last.stft && item.effect->isFusable() && last.effects.back()->isFusable();
+                }
+            }
+            if (!extend) {
+                Stage stage;
+                stage.analysis_taps = item.analysis_taps;
+                if (config.isSpectral()) {
+                    stage.stft = std::make_unique<StftEngine>();
+                    stage.stft->configure(config.fft_size, config.hop_size, channels_, sample_rate_, max_block_frames_);
+                }
+                stages_.push_back(std::move(stage));
+            }
+            Stage& stage = stages_.back();
+            stage.effects.push_back(item.effect);
+            stage.labels.push_back(item.label);
+            stage.automated = stage.automated || automation_.automates(item.effect);
+            stage.tail = stageTail(stage);
+            stage.latency = stage.stft ? stage.stft->getLatencySamples() : stage.latency + item.effect->getLatencySamples();
+        }
+        chain_idle_ = false;
+        tile_.reserve(FUSION_TILE_FRAMES * static_cast<size_t>(channels_));
+        logExecutionPlan(skipped);
+    }
+
+    void logExecutionPlan(const std::vector<std::string>& skipped) const {
+        LOG_INFO("Execution plan (" << effects_.size() - skipped.size() << " of " << effects_.size() << " effects active):");
+        for (size_t i = 0; i < stages_.size(); ++i) {
+            const Stage& stage = stages_[i];
+            std::string names;
+            for (const auto& label : stage.labels) names += (names.empty() ? "" : " + ") + label;
+            std::string kind;
+            if (stage.stft) {
+                const StftConfig config = stage.stft->getConfig();
+                kind = "spectral (fft " + std::to_string(config.fft_size) + ", hop " + std::to_string(config.hop_size) + ")";
+            } else {
+                kind = (stage.effects.size() > 1) ? "fused" : "single";
+            }
+            const std::string tail = (stage.tail == AudioEffect::kInfiniteTail) ? "never skipped" : std::to_string(stage.tail) + " samples";
+            LOG_INFO("  " << i + 1 << ". " << kind << ": " << names << "  (tail " << tail
+                     << (stage.latency > 0 ? ", latency " + std::to_string(stage.latency) + " samples" : std::string()) << ")"
+                     << (stage.analysis_taps.empty() ? "" : "  [analysis taps: " + std::to_string(stage.analysis_taps.size()) + "]"));
+        }
+        if (!skipped.empty()) {
+            std::string names;
+            for (const auto& name : skipped) names += (names.empty() ? "" : ", ") + name;
+            LOG_INFO("  skipped (disabled or neutral): " << names);
+        }
+    }
+
+    // スペクトルセグメント: 1組のFFT/IFFTで得たフレーム列に対して各エフェクトを順に適用する
+    void processSpectral(const Stage& stage, std::vector<float>& block) {
+        stage.stft->process(block, channels_, [&stage](SpectralFrame* frames, size_t count) {
+            for (auto* effect : stage.effects) {
+                effect->processSpectrum(frames, count);
+            }
+        });
+    }
+
+    // ブロックをタイルに分け、タイルごとにステージ内の全エフェクトを順に適用する。
+    // 各エフェクトのパスがキャッシュ上のタイルだけを読み書きするため、ブロック全体を
+    // エフェクト数だけ往復するメモリトラフィックがなくなる（融合可能なエフェクトは
+    // ブロック分割に依存しないので、出力はエフェクトを個別に実行した場合と同一）
+    void processFused(const Stage& stage, std::vector<float>& block) {
+        const size_t channels = static_cast<size_t>(channels_);
+        const size_t num_frames = block.size() / channels;
+        for (size_t start = 0; start < num_frames; start += FUSION_TILE_FRAMES) {
+            const size_t frames = std::min(FUSION_TILE_FRAMES, num_frames - start);
+            float* tile_start = block.data() + start * channels;
+            tile_.assign(tile_start, tile_start + frames * channels);
+            bus_.setReadOffset(start);
+            for (auto* effect : stage.effects) {
+                effect->process(tile_, channels_);
+            }
+            std::copy(tile_.begin(), tile_.end(), tile_start);
+        }
+        bus_.setReadOffset(0);
+    }
+};
+
+// --- プリセットバンククラス ---
+// 名前付きのプリセットごとに構築済みの EffectChain を持ち、ファイルの読み込みやチェーンの再構築なしに切り替える
+class PresetBank {
+public:
+    struct Preset {
+        std::string name;
+        json params;    // params.json にプリセットの差分を適用したもの
+    };
+
+    /**
+     * @brief すべてのプリセットのチェーンを構築する
+     * @param shadow true なら選択されていないチェーンにも毎ブロック同じ入力を通し、フィルタや
+     *               エンベロープの状態を温めておく（CPU負荷はプリセット数に比例する）
+     *
+     * @param max_block_frames process() に渡す最大のブロック長（リサンプル後）
+     *
+     * 各チェーンは最大の長さの無音を1ブロック処理してからリセットし、作業バッファの確保やカーネルの
+     * 選択を済ませておく。再構築の前に選択していたプリセットが残っていれば、それを選択したままにする。
+     *
+     * 遅延の異なるチェーンは、出力を最も長い遅延に揃えて遅らせる。切り替えで再生位置が飛ばず、
+     * クロスフェードする2つの出力の時刻も一致する（揃えないと櫛形フィルタになる）。
+     *
+     * process() / reset() / seek() / serializeState() は処理スレッドから呼び、setup() とは呼び出し側で
+     * 排他する（再生エンジンの処理ロック、ライブ入力ではストリームの開始前）。ロックはコマンドスレッドの
+     * 問い合わせと setup() の排他にだけ使い、処理スレッドは取らない。
+     */
+    void setup(const std::vector<Preset>& presets, bool shadow, int channels, double sr, size_t max_block_frames) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const std::string previous = names_.empty() ? std::string() : names_[active_.load()];
+        chains_.clear();
+        names_.clear();
+        for (const auto& preset : presets) {
+            LOG_INFO("Preset '" << preset.name << "':");
+            auto chain = std::make_unique<EffectChain>();
+            chain->setup(preset.params, channels, sr, max_block_frames);
+            std::vector<float> warmup(max_block_frames * static_cast<size_t>(channels), 0.0f);
+            chain->process(warmup);
+            chain->reset();
+            chain->seekTimeline(0.0);
+            chains_.push_back(std::move(chain));
+            names_.push_back(preset.name);
+        }
+        shadow_ = shadow;
+        channels_ = channels;
+        size_t active = 0;
+        for (size_t i = 0; i < names_.size(); ++i) {
+            if (names_[i] == previous) active = i;
+        }
+        active_.store(active);
+        requested_.store(active);
+
+        size_t latency = 0;
+        for (const auto& chain : chains_) latency = std::max(latency, chain->latencySamples());
+        delays_.assign(chains_.size(), OutputDelay());
+        for (size_t i = 0; i < chains_.size(); ++i) {
+            delays_[i].line.assign((latency - chains_[i]->latencySamples()) * static_cast<size_t>(channels), 0.0f);
+        }
+        latency_.store(latency);
+
+        const size_t samples = max_block_frames * static_cast<size_t>(channels);
+        input_.reserve(samples);
+        fade_.reserve(samples);
+        shadow_block_.reserve(samples);
+        if (names_.size() > 1) {
+            LOG_INFO("Preset bank: " << names_.size() << " presets" << (shadow_ ? " (shadow mode)" : "") << ", active '" << names_[active] << "'");
+            for (size_t i = 0; i < chains_.size(); ++i) {
+                if (!delays_[i].line.empty()) {
+                    LOG_INFO("  -> '" << names_[i] << "' delayed by " << delays_[i].line.size() / static_cast<size_t>(channels)
+                             << " samples to match the bank latency (" << latency << " samples)");
+                }
+            }
+        }
+    }
+
+    // "default"（params.json そのもの）と、"presets" の各エントリ（差分のオブジェクト、または差分を書いた
+    // JSONファイルの実行ファイルからの相対パス）を JSON Merge Patch で params.json に適用したもの
+    static std::vector<Preset> loadPresets(const json& params, const std::filesystem::path& directory) {
+        json base = params.is_object() ? params : json::object();
+        const json entries = base.value("presets", json::object());
+        base.erase("presets");
+        loadAutomationFile(base, directory);
+        std::vector<Preset> presets{{"default", base}};
+        if (!entries.is_object()) {
+            LOG_WARN("'presets' must be an object of preset names. Ignoring it.");
+            return presets;
+        }
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            json patch = it.value();
+            if (patch.is_string()) {
+                std::ifstream f(directory / patch.get<std::string>());
+                patch = f.is_open() ? json::parse(f, nullptr, false, true) : json();
+            }
+            if (it.key() == "default" || !patch.is_object()) {
+                LOG_WARN("Preset '" << it.key() << "' must be a JSON object or a readable JSON file (and not named 'default'). Skipping.");
+                continue;
+            }
+            json merged = base;
+            merged.merge_patch(patch);
+            loadAutomationFile(merged, directory);
+            presets.push_back({it.key(), merged});
+        }
+        return presets;
+    }
+
+    // "automation" がサイドカーのJSONファイル（実行ファイルからの相対パス）なら、その内容に置き換える
+    static void loadAutomationFile(json& params, const std::filesystem::path& directory) {
+        if (!params.contains("automation") || !params["automation"].is_string()) return;
+        const std::string file = params["automation"].get<std::string>();
+        std::ifstream f(directory / file);
+        json lanes = f.is_open() ? json::parse(f, nullptr, false, true) : json();
+        if (!lanes.is_object()) {
+            LOG_WARN("Could not read automation file '" << file << "'. Ignoring it.");
+            lanes = json();
+        }
+        params["automation"] = lanes;
+    }
+
+    // 次に処理するブロックから name のプリセットに切り替える（見つからなければ false）
+    bool select(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < names_.size(); ++i) {
+            if (names_[i] == name) {
+                requested_.store(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::string> names() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return names_;
+    }
+
+    std::string activeName() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return names_.empty() ? std::string() : names_[requested_.load()];
+    }
+
+    // 出力の遅延（サンプル数）。どのプリセットでも同じ（最も長いチェーンの遅延に揃える）
+    size_t latencySamples() const { return latency_.load(); }
+
+    // すべてのチェーン（シャドウ実行を含む）がワーカーの結果を待った回数の合計
+    uint64_t deadlineMisses() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t total = 0;
+        for (const auto& chain : chains_) total += chain->deadlineMisses();
+        return total;
+    }
+
+    // 切り替えを要求されたブロックでは、切り替え前後のチェーンの出力を等パワー（cos/sin）で
+    // ブロック全体にわたってクロスフェードする
+    void process(std::vector<float>& block) {
+        if (chains_.empty()) return;
+        if (shadow_) input_.assign(block.begin(), block.end());
+
+        const size_t requested = requested_.load();
+        const size_t previous = active_.load(std::memory_order_relaxed);
+        const size_t active = requested;
+        if (requested != previous) {
+            // シャドウ実行していないチェーンの状態は最後に使ったときのままなので、初期状態から始める
+            // （オートメーションの時刻も切り替え前のチェーンに合わせる）
+            if (!shadow_) {
+                chains_[active]->reset();
+                chains_[active]->seekTimeline(chains_[previous]->timelineSeconds());
+                delays_[active].reset();
+            }
+            fade_.assign(block.begin(), block.end());
+            processChain(previous, fade_);
+            processChain(active, block);
+            crossfade(fade_, block);
+            active_.store(active);
+        } else {
+            processChain(active, block);
+        }
+
+        if (shadow_) {
+            for (size_t i = 0; i < chains_.size(); ++i) {
+                if (i == active || i == previous) continue;
+                shadow_block_.assign(input_.begin(), input_.end());
+                processChain(i, shadow_block_);
+            }
+        }
+    }
+
+    void reset() {
+        for (auto& chain : chains_) chain->reset();
+        for (auto& delay : delays_) delay.reset();
+    }
+
+    // 全チェーンのオートメーションの時刻を再生位置（秒）に合わせる
+    void seek(double seconds) {
+        for (auto& chain : chains_) chain->seekTimeline(seconds);
+    }
+
+    /**
+     * @brief チェーンの処理状態を保存または復元する（シーク用のスナップショット）
+     *
+     * シャドウ実行しないチェーンの状態は切り替え時にリセットされるため、選択中のチェーンだけを
+     * 保存する。保存時と選択中のプリセットが異なれば復元に失敗し、全チェーンをリセットする。
+     */
+    void serializeState(StateArchive& ar) {
+        const size_t active = active_.load();
+        uint64_t header[2] = {active, chains_.size()};
+        ar(header);
+        if (header[0] != active || header[1] != chains_.size()) ar.fail();
+        for (size_t i = 0; i < chains_.size() && ar.ok(); ++i) {
+            if (shadow_ || i == active) {
+                chains_[i]->serializeState(ar);
+                ar(delays_[i].line, delays_[i].pos);
+            }
+        }
+        if (!ar.saving() && !ar.ok()) reset();
+    }
+
+private:
+    // 遅延の短いチェーンの出力を、バンクの遅延に揃えるまで遅らせるリングバッファ（インターリーブ）
+    struct OutputDelay {
+        std::vector<float> line;
+        size_t pos = 0;
+        void process(std::vector<float>& block) {
+            if (line.empty()) return;
+            for (float& sample : block) {
+                std::swap(sample, line[pos]);
+                pos = (pos + 1 == line.size()) ? 0 : pos + 1;
+            }
+        }
+        void reset() {
+            std::fill(line.begin(), line.end(), 0.0f);
+            pos = 0;
+        }
+    };
+
+    std::vector<std::unique_ptr<EffectChain>> chains_;
+    std::vector<OutputDelay> delays_;       // チェーンごと
+    std::vector<std::string> names_;
+    std::atomic<size_t> active_{0};         // 処理中のプリセット（処理スレッドだけが書く）
+    std::atomic<size_t> requested_{0};      // select() で要求されたプリセット（次のブロックで反映）
+    std::atomic<size_t> latency_{0};        // 出力の遅延（最も長いチェーンの遅延）
+    bool shadow_ = false;
+    int channels_ = 0;
+    std::vector<float> input_;              // シャドウ実行用の入力のコピー
+    std::vector<float> fade_;               // 切り替え前のチェーンの出力
+    std::vector<float> shadow_block_;
     mutable std::mutex mutex_;
+
+    void processChain(size_t index, std::vector<float>& block) {
+        chains_[index]->process(block);
+        delays_[index].process(block);
+    }
+
+    void crossfade(const std::vector<float>& from, std::vector<float>& to) const {
+        const size_t channels = static_cast<size_t>(channels_);
+        const size_t num_frames = to.size() / channels;
+        for (size_t i = 0; i < num_frames; ++i) {
+            const double angle = 0.5 * M_PI * (static_cast<double>(i) + 0.5) / static_cast<double>(num_frames);
+            const float fade_out = static_cast<float>(std::cos(angle));
+            const float fade_in = static_cast<float>(std::sin(angle));
+            for (size_t c = 0; c < channels; ++c) {
+                to[i * channels + c] = fade_out * from[i * channels + c] + fade_in * to[i * channels + c];
+            }
+        }
+    }
+};
+
+// 再生中に一定間隔で取ったプリセットバンクの状態（出力フレーム位置 → バイト列）。
+// 上限を超えたら古く取ったものから捨てる
+class SnapshotStore {
+public:
+    using Snapshot = std::pair<const long long, std::vector<uint8_t>>;
+
+    void configure(size_t max_snapshots) {
+        max_snapshots_ = max_snapshots;
+        clear();
+    }
+    void clear() {
+        snapshots_.clear();
+        order_.clear();
+    }
+    void store(long long frame, std::vector<uint8_t> state) {
+        if (max_snapshots_ == 0) return;
+        if (snapshots_.find(frame) == snapshots_.end()) order_.push_back(frame);
+        snapshots_[frame] = std::move(state);
+        while (snapshots_.size() > max_snapshots_) {
+            snapshots_.erase(order_.front());
+            order_.pop_front();
+        }
+    }
+    // frame 以前で最も近いもの（max_distance より離れていれば nullptr）
+    const Snapshot* nearest(long long frame, long long max_distance) const {
+        auto it = snapshots_.upper_bound(frame);
+        if (it == snapshots_.begin()) return nullptr;
+        --it;
+        return (frame - it->first <= max_distance) ? &*it : nullptr;
+    }
+    bool enabled() const { return max_snapshots_ > 0; }
+
+private:
+    std::map<long long, std::vector<uint8_t>> snapshots_;
+    std::deque<long long> order_;   // 取った順
+    size_t max_snapshots_ = 0;
+};
+
+/**
+ * @class SourceReader
+ * @brief デコーダとリサンプラーの組。TARGET_SAMPLE_RATE のブロックを順に返す
+ *
+ * 出力フレーム = 入力フレーム * rate_num / rate_den（既約分数）。リサンプラーの状態は戻せないため、
+ * シークは出力の格子に揃う（rate_den の倍数の）入力フレームへ、フィルタが満ちる分だけ手前に行う。
+ */
+class SourceReader {
+public:
+    explicit SourceReader(const std::string& path) {
+        decoder_ = AudioDecoderFactory::createDecoder(path);
+        if (!decoder_) throw std::runtime_error("Failed to create a suitable decoder.");
+        info_ = decoder_->getInfo();
+        if (info_.channels <= 0 || info_.sampleRate <= 0) throw std::runtime_error("Invalid audio file properties.");
+
+        if (info_.sampleRate != TARGET_SAMPLE_RATE) {
+            resampling_ratio_ = TARGET_SAMPLE_RATE / info_.sampleRate;
+            int error = 0;
+            resampler_state_ = src_new(SRC_SINC_BEST_QUALITY, info_.channels, &error);
+            if (!resampler_state_) throw std::runtime_error(std::string("src_new failed: ") + src_strerror(error));
+            const long long source_rate = info_.sampleRate;
+            const long long target_rate = std::llround(TARGET_SAMPLE_RATE);
+            const long long divisor = std::gcd(source_rate, target_rate);
+            rate_num_ = target_rate / divisor;
+            rate_den_ = source_rate / divisor;
+        }
+        read_buffer_.resize(PROCESSING_BLOCK_SIZE * info_.channels);
+        resampled_buffer_.resize(static_cast<size_t>(ceil(PROCESSING_BLOCK_SIZE * std::max(resampling_ratio_, 1.0))) * info_.channels);
+    }
+    ~SourceReader() { if (resampler_state_) src_delete(resampler_state_); }
+    SourceReader(const SourceReader&) = delete;
+    SourceReader& operator=(const SourceReader&) = delete;
+
+    const AudioInfo& info() const { return info_; }
+    bool resampling() const { return resampler_state_ != nullptr; }
+    // パイプやソケットからのストリーム入力では false（seekBefore() は読み始めの位置でしか成功しない）
+    bool seekable() const { return decoder_->isSeekable(); }
+    // read() が返す1ブロックの最大フレーム数
+    size_t maxBlockFrames() const { return resampled_buffer_.size() / info_.channels; }
+    // 入力のフレーム位置に対応する出力のフレーム位置（切り上げ）
+    long long toOutputFrame(long long source_frame) const { return (source_frame * rate_num_ + rate_den_ - 1) / rate_den_; }
+    long long totalOutputFrames() const { return toOutputFrame(info_.totalFrames); }
+    // 出力の格子（整数の入力フレームに対応する出力フレーム）の間隔
+    long long outputGrid() const { return rate_num_; }
+
+    // 出力フレーム frame より手前の読み始められる位置へシークし、次の read() の先頭の出力フレームを返す
+    long long seekBefore(long long frame) {
+        long long source_start = frame * rate_den_ / rate_num_ - (resampler_state_ ? kResamplerPrerollFrames : 0);
+        source_start = std::max(0LL, source_start / rate_den_ * rate_den_);
+        decoder_->seek(source_start);
+        if (resampler_state_) src_reset(resampler_state_);
+        return source_start * rate_num_ / rate_den_;
+    }
+
+    // ストリーム入力で待っている read() を中断し、以降は入力の終わりとして返させる（別のスレッドから呼べる）
+    void interrupt() { decoder_->interrupt(); }
+
+    // 1ブロック読み、必要ならリサンプルして block に入れる。入力の終わりでは false
+    bool read(std::vector<float>& block) {
+        const int channels = info_.channels;
+        size_t frames_read = decoder_->read(read_buffer_.data(), PROCESSING_BLOCK_SIZE);
+        if (frames_read == 0) return false;
+
+        block.clear();
+        if(resampler_state_) {
+            SRC_DATA src_data;
+            src_data.data_in = read_buffer_.data();
+            src_data.input_frames = frames_read;
+            src_data.data_out = resampled_buffer_.data();
+            src_data.output_frames = resampled_buffer_.size() / channels;
+            src_data.src_ratio = resampling_ratio_;
+            src_data.end_of_input = (frames_read < PROCESSING_BLOCK_SIZE);
+
+            if (src_process(resampler_state_, &src_data) == 0) {
+                block.assign(resampled_buffer_.data(), resampled_buffer_.data() + src_data.output_frames_gen * channels);
+            }
+        } else {
+            block.assign(read_buffer_.data(), read_buffer_.data() + frames_read * channels);
+        }
+        return true;
+    }
+
+private:
+    // シーク時にリサンプラーのフィルタを満たすため、出力を捨てて読む入力フレーム数
+    static constexpr long long kResamplerPrerollFrames = 1024;
+
+    std::unique_ptr<AudioDecoder> decoder_;
+    AudioInfo info_;
+    SRC_STATE* resampler_state_ = nullptr;
+    double resampling_ratio_ = 1.0;
+    long long rate_num_ = 1, rate_den_ = 1;
+    std::vector<float> read_buffer_, resampled_buffer_;
 };
 
 // --- オーディオエンジンクラス ---
@@ -160,39 +973,44 @@ public:
     RealtimeAudioEngine(const std::string& audio_file_path, const std::string& executable_path)
         : executable_path_(executable_path) {
         LOG_INFO("Initializing RealtimeAudioEngine...");
-        decoder_ = AudioDecoderFactory::createDecoder(audio_file_path);
-        if (!decoder_) throw std::runtime_error("Failed to create a suitable decoder.");
+        source_ = std::make_unique<SourceReader>(audio_file_path);
 
-        const AudioInfo info = decoder_->getInfo();
+        const AudioInfo& info = source_->info();
         channels_ = info.channels;
         source_sample_rate_ = static_cast<double>(info.sampleRate);
         total_frames_ = info.totalFrames;
 
         LOG_INFO("Audio file properties: " << channels_ << " channels, " << source_sample_rate_ << " Hz, " << total_frames_ << " frames.");
-        if (channels_ <= 0 || source_sample_rate_ <= 0) throw std::runtime_error("Invalid audio file properties.");
 
         processed_ring_buffer_ = std::make_unique<RingBuffer<float>>(RING_BUFFER_FRAMES, channels_);
 
-        if (source_sample_rate_ != TARGET_SAMPLE_RATE) {
+        if (!source_->seekable()) {
+            LOG_INFO("Stream input: seeking is disabled" << (total_frames_ > 0 ? "." : " and the length is unknown."));
+        }
+        if (source_->resampling()) {
             LOG_INFO("Resampling required: " << source_sample_rate_ << " Hz -> " << TARGET_SAMPLE_RATE << " Hz");
-            resampling_ratio_ = TARGET_SAMPLE_RATE / source_sample_rate_;
-            int error = 0;
-            resampler_state_ = src_new(SRC_SINC_BEST_QUALITY, channels_, &error);
-            if (!resampler_state_) throw std::runtime_error(std::string("src_new failed: ") + src_strerror(error));
         }
 
         init_portaudio();
         reloadParameters();
+
+        // "realtime": 処理スレッドのスケジューリングはスレッドの中で適用し、メモリはチェーンの構築後にロックする
+        const json realtime_params = params_.value("realtime", json::object());
+        processing_schedule_ = ThreadSchedule::fromJson(realtime_params.value("processing_thread", json::object()));
+        prefault_stack_bytes_ = realtime_params.value("prefault_stack_kb", static_cast<size_t>(256)) * 1024;
+        processed_ring_buffer_->prefault();
+        if (realtime_params.value("lock_memory", false)) LOG_INFO("Realtime: memory " << lockProcessMemory());
         processing_thread_ = std::thread(&RealtimeAudioEngine::processing_thread_func, this);
     }
 
     ~RealtimeAudioEngine() {
         LOG_INFO("Shutting down RealtimeAudioEngine...");
         should_exit_ = true;
+        // ストリーム入力では処理スレッドが read() で待っていることがあるため、先に中断する
+        source_->interrupt();
         processing_cv_.notify_all();
         if (processing_thread_.joinable()) processing_thread_.join();
         if (stream_) { Pa_StopStream(stream_); Pa_CloseStream(stream_); }
-        if (resampler_state_) src_delete(resampler_state_);
         Pa_Terminate();
         LOG_INFO("Shutdown complete.");
     }
@@ -201,6 +1019,10 @@ public:
         std::lock_guard<std::mutex> lock(state_mutex_);
         if (playback_state_ != PlaybackState::PLAYING) {
             if (playback_state_ == PlaybackState::FINISHED) {
+                if (!source_->seekable()) {
+                    LOG_WARN("Stream input has ended and cannot be replayed.");
+                    return;
+                }
                 LOG_INFO("Playback finished. Resetting to beginning.");
                 seek_to_frame(0);
             }
@@ -222,8 +1044,8 @@ public:
         }
     }
     void pause() { std::lock_guard<std::mutex> lock(state_mutex_); if (playback_state_ == PlaybackState::PLAYING) { playback_state_ = PlaybackState::PAUSED; LOG_INFO("Playback paused."); } }
-    void stop() { { std::lock_guard<std::mutex> lock(state_mutex_); if (playback_state_ != PlaybackState::STOPPED) { playback_state_ = PlaybackState::STOPPED; LOG_INFO("Playback stopped."); } } if (stream_ && Pa_IsStreamActive(stream_) == 1) { Pa_StopStream(stream_); } seek_to_frame(0); }
-    void seek(double seconds) { long long target_frame = static_cast<long long>(seconds * source_sample_rate_); target_frame = std::max((long long)0, std::min(target_frame, total_frames_ - 1)); LOG_INFO("Seeking to " << seconds << "s (frame " << target_frame << ")"); seek_to_frame(target_frame); }
+    void stop() { { std::lock_guard<std::mutex> lock(state_mutex_); if (playback_state_ != PlaybackState::STOPPED) { playback_state_ = PlaybackState::STOPPED; LOG_INFO("Playback stopped."); } } if (stream_ && Pa_IsStreamActive(stream_) == 1) { Pa_StopStream(stream_); } if (source_->seekable()) seek_to_frame(0); }
+    void seek(double seconds) { if (!source_->seekable()) { LOG_WARN("Seeking is not available for stream input."); return; } long long target_frame = static_cast<long long>(seconds * source_sample_rate_); target_frame = std::max((long long)0, std::min(target_frame, total_frames_ - 1)); LOG_INFO("Seeking to " << seconds << "s (frame " << target_frame << ")"); seek_to_frame(target_frame); }
     void reloadParameters() {
         json new_params;
         try {
@@ -231,44 +1053,114 @@ public:
             std::filesystem::path config_path = exe_path.parent_path() / "params.json";
             LOG_INFO("Loading parameters from: " << config_path);
             std::ifstream f(config_path);
-            if (f.is_open()) new_params = json::parse(f, nullptr, false);
+            if (f.is_open()) new_params = json::parse(f, nullptr, false, true);
             else { LOG_WARN("Could not open params.json. Using defaults."); }
         } catch (const std::exception& e) { LOG_WARN("Failed to load or parse params.json: " << e.what()); return; }
+        const std::vector<PresetBank::Preset> presets = PresetBank::loadPresets(new_params, std::filesystem::path(executable_path_).parent_path());
 
         std::lock_guard<std::mutex> lock(processing_mutex_);
         params_ = new_params;
-        effect_chain_.setup(params_, channels_, TARGET_SAMPLE_RATE);
+        FFTPlanRegistry::getInstance().setPlannerLevel(params_.value("fftw_planner", "measure"));
+        // チェーンの補助スレッド（コンボルバー・エフェクトグラフ）は構築時に起動するため、先に設定を登録する
+        setWorkerThreadSchedule(ThreadSchedule::workersFromJson(params_.value("realtime", json::object())));
+        preset_bank_.setup(presets, params_.value("preset_shadow", false), channels_, TARGET_SAMPLE_RATE, source_->maxBlockFrames());
+        preset_bank_.seek(static_cast<double>(output_frame_) / TARGET_SAMPLE_RATE);
+        const size_t latency = preset_bank_.latencySamples();
+        LOG_INFO("Chain latency: " << latency << " samples (" << static_cast<double>(latency) / TARGET_SAMPLE_RATE * 1000.0 << " ms)");
+        // 構成が変わると以前のスナップショットは使えない
+        const json snapshot_params = params_.value("seek_snapshots", json::object());
+        const bool snapshots_enabled = snapshot_params.value("enabled", true);
+        snapshot_interval_frames_ = std::max(1LL, std::llround(snapshot_params.value("interval_sec", 4.0) * TARGET_SAMPLE_RATE));
+        seek_preroll_frames_ = std::max(0LL, std::llround(snapshot_params.value("preroll_sec", 0.5) * TARGET_SAMPLE_RATE));
+        snapshots_.configure(snapshots_enabled && source_->seekable() ? snapshot_params.value("max_snapshots", static_cast<size_t>(128)) : 0);
+        snapshot_size_logged_ = false;
+        // 新しいサイズのプランを作成した場合はWisdomを保存し、次回起動時の計画時間を省く
+        FFTPlanRegistry::getInstance().saveWisdom();
     }
+    bool selectPreset(const std::string& name) {
+        if (!preset_bank_.select(name)) return false;
+        LOG_INFO("Switching to preset '" << name << "'.");
+        return true;
+    }
+    std::vector<std::string> presetNames() const { return preset_bank_.names(); }
+    std::string activePreset() const { return preset_bank_.activeName(); }
     bool isPlaying() const { std::lock_guard<std::mutex> lock(state_mutex_); return playback_state_ == PlaybackState::PLAYING; }
 
+    /**
+     * @brief いま鳴っているサンプルに対応する入力の位置（秒）
+     *
+     * 最後のコールバックで出力したバッファの先頭のフレームと、それがDACに届く時刻
+     * （PaStreamCallbackTimeInfo::outputBufferDacTime）から現在の出力フレームを求め、チェーンの遅延を引く。
+     * リングバッファに積んだ分は含まれない。ホストAPIが時刻を返さない場合はストリームの出力遅延で見積もる。
+     */
+    double playbackPosition() const {
+        PlayedBuffer played;
+        {
+            std::lock_guard<std::mutex> lock(position_mutex_);
+            played = played_;
+        }
+        double offset = 0.0;
+        if (played.dac_time > 0.0 && stream_) {
+            offset = (Pa_GetStreamTime(stream_) - played.dac_time) * TARGET_SAMPLE_RATE;
+        } else if (played.dac_time == 0.0 && stream_) {
+            const PaStreamInfo* info = Pa_GetStreamInfo(stream_);
+            offset = info ? -info->outputLatency * TARGET_SAMPLE_RATE : 0.0;
+        }
+        // バッファの終わりより先は（アンダーランや一時停止で）無音なので、位置は進まない
+        offset = std::min(offset, static_cast<double>(played.frames));
+        const double frame = static_cast<double>(played.frame) + offset - static_cast<double>(preset_bank_.latencySamples());
+        return std::max(0.0, frame) / TARGET_SAMPLE_RATE;
+    }
+
 private:
-    std::unique_ptr<AudioDecoder> decoder_;
+    std::unique_ptr<SourceReader> source_;
     std::unique_ptr<RingBuffer<float>> processed_ring_buffer_;
-    EffectChain effect_chain_;
+    PresetBank preset_bank_;
     json params_;
     std::string executable_path_;
     int channels_;
     double source_sample_rate_ = 0.0;
     long long total_frames_ = 0;
+    // 次に処理する出力フレーム（TARGET_SAMPLE_RATE。オートメーションの時刻とスナップショットの位置。processing_mutex_ で保護）
+    long long output_frame_ = 0;
+    // シーク用のスナップショット（"seek_snapshots"）
+    SnapshotStore snapshots_;
+    long long snapshot_interval_frames_ = 0;
+    long long seek_preroll_frames_ = 0;        // スナップショットがないときに目標位置の手前から処理する長さ
+    bool snapshot_size_logged_ = false;
+    // 最後のコールバックで出力したバッファ（チェーンの出力のフレーム位置と、その先頭がDACに届く時刻）
+    struct PlayedBuffer {
+        long long frame = 0;
+        double dac_time = -1.0;     // 負ならシーク後まだ出力していない。0 はホストAPIが時刻を返さない
+        size_t frames = 0;
+    };
+    PlayedBuffer played_;
+    mutable std::mutex position_mutex_;
+    ThreadSchedule processing_schedule_;
+    size_t prefault_stack_bytes_ = 0;
     PaStream* stream_ = nullptr;
     // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↓修正開始◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
     std::atomic<PlaybackState> playback_state_{PlaybackState::STOPPED}; // 初期化子を修正
     // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↑修正終わり◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
     mutable std::mutex state_mutex_;
-    SRC_STATE* resampler_state_ = nullptr;
-    double resampling_ratio_ = 1.0;
     std::thread processing_thread_;
     std::atomic<bool> should_exit_{false};
     std::atomic<bool> end_of_input_{false};
     std::condition_variable processing_cv_;
     std::mutex processing_mutex_;
+    // source_ の読み込みとシークを直列にする。処理スレッドは processing_mutex_ を持たずに読むため、
+    // ストリーム入力で読み込みを待っていてもパラメータの再読み込みや終了が止まらない
+    // （ロックの順序は processing_mutex_ → source_mutex_）
+    std::mutex source_mutex_;
+    std::atomic<uint64_t> seek_generation_{0};  // シークごとに増やす（読み込み中にシークされたブロックを捨てる）
 
     void init_portaudio();
     void seek_to_frame(long long frame);
+    void captureSnapshot(size_t frames);
     void processing_thread_func();
-    int audioCallback(float* output_buffer, unsigned long frames_per_buffer);
-    static int paCallback(const void*, void* out, unsigned long frames, const PaStreamCallbackTimeInfo*, PaStreamCallbackFlags, void* data) {
-        return static_cast<RealtimeAudioEngine*>(data)->audioCallback(static_cast<float*>(out), frames);
+    int audioCallback(float* output_buffer, unsigned long frames_per_buffer, const PaStreamCallbackTimeInfo* time_info);
+    static int paCallback(const void*, void* out, unsigned long frames, const PaStreamCallbackTimeInfo* time_info, PaStreamCallbackFlags, void* data) {
+        return static_cast<RealtimeAudioEngine*>(data)->audioCallback(static_cast<float*>(out), frames, time_info);
     }
 };
 
@@ -292,15 +1184,57 @@ void RealtimeAudioEngine::init_portaudio() {
     }
 }
 
+// スナップショットがあれば目標位置の直前の状態を復元し、なければ preroll だけ手前から処理して
+// 状態を作る。どちらも目標位置までの出力は捨て、目標位置以降をリングバッファに積む
 void RealtimeAudioEngine::seek_to_frame(long long frame) {
     std::lock_guard<std::mutex> lock(processing_mutex_);
-    LOG_INFO("Seeking decoder to frame " << frame);
-    decoder_->seek(frame);
-    processed_ring_buffer_->clear();
-    if (resampler_state_) src_reset(resampler_state_);
-    effect_chain_.reset();
+    seek_generation_.fetch_add(1);
+    std::lock_guard<std::mutex> source_lock(source_mutex_);
     end_of_input_ = false;
 
+    // チェーンの遅延だけ先の出力から積むと、最初に鳴るサンプルが入力の frame に対応する
+    const long long target = source_->toOutputFrame(frame) + static_cast<long long>(preset_bank_.latencySamples());
+    processed_ring_buffer_->clear(target);
+    {
+        std::lock_guard<std::mutex> position_lock(position_mutex_);
+        played_ = PlayedBuffer{target, -1.0, 0};
+    }
+    long long start = std::max(0LL, target - seek_preroll_frames_);
+    bool restored = false;
+    preset_bank_.reset();
+    if (const SnapshotStore::Snapshot* snapshot = snapshots_.nearest(target, snapshot_interval_frames_ + seek_preroll_frames_)) {
+        StateArchive archive = StateArchive::reader(snapshot->second.data(), snapshot->second.size());
+        preset_bank_.serializeState(archive);
+        restored = archive.ok();
+        if (restored) start = snapshot->first;
+    }
+    preset_bank_.seek(static_cast<double>(start) / TARGET_SAMPLE_RATE);
+
+    // リサンプラーの状態は戻せないため、start より手前から読み、start までの出力は処理せずに捨てる
+    long long position = source_->seekBefore(start);
+    LOG_INFO("Seeking to output frame " << target << " (" << (restored ? "snapshot" : "preroll") << " from "
+             << static_cast<double>(start) / TARGET_SAMPLE_RATE << "s)");
+    std::vector<float> block;
+    while (position < target) {
+        if (!source_->read(block)) {
+            end_of_input_ = true;
+            break;
+        }
+        const long long block_start = position;
+        const long long num_frames = static_cast<long long>(block.size()) / channels_;
+        position += num_frames;
+        const long long skip = std::min(std::max(start - block_start, 0LL), num_frames);
+        if (skip == num_frames) continue;
+        block.erase(block.begin(), block.begin() + skip * channels_);
+        preset_bank_.process(block);
+        const long long first = block_start + skip;
+        const long long keep_from = std::min(std::max(target - first, 0LL), num_frames - skip);
+        if (keep_from < num_frames - skip) {
+            processed_ring_buffer_->push(block.data() + keep_from * channels_, static_cast<size_t>(num_frames - skip - keep_from));
+        }
+    }
+    output_frame_ = position;
+
     {
         std::lock_guard<std::mutex> state_lock(state_mutex_);
         if(playback_state_ == PlaybackState::FINISHED) playback_state_ = PlaybackState::STOPPED;
@@ -308,18 +1242,36 @@ void RealtimeAudioEngine::seek_to_frame(long long frame) {
     processing_cv_.notify_all();
 }
 
+// 出力位置がスナップショットの間隔の境界を越えたブロックの後で、プリセットバンクの状態を保存する
+void RealtimeAudioEngine::captureSnapshot(size_t frames) {
+    if (!snapshots_.enabled()) return;
+    if (output_frame_ / snapshot_interval_frames_ == (output_frame_ - static_cast<long long>(frames)) / snapshot_interval_frames_) return;
+    std::vector<uint8_t> state;
+    StateArchive archive = StateArchive::writer(state);
+    preset_bank_.serializeState(archive);
+    if (!snapshot_size_logged_) {
+        LOG_INFO("Seek snapshots: " << state.size() << " bytes every " << static_cast<double>(snapshot_interval_frames_) / TARGET_SAMPLE_RATE << "s");
+        snapshot_size_logged_ = true;
+    }
+    snapshots_.store(output_frame_, std::move(state));
+}
+
 void RealtimeAudioEngine::processing_thread_func() {
     LOG_INFO("Processing thread started.");
-    std::vector<float> read_buffer(PROCESSING_BLOCK_SIZE * channels_);
-
-    const size_t resampled_buffer_max_frames = static_cast<size_t>(ceil(PROCESSING_BLOCK_SIZE * (resampling_ratio_ > 1.0 ? resampling_ratio_ : 1.0)));
-    std::vector<float> resampled_buffer(resampled_buffer_max_frames * channels_);
+    // デコードとリサンプリングもこのスレッドで行うため、同じ優先度・CPUで動く
+    LOG_INFO("Realtime: processing thread " << applyThreadSchedule(processing_schedule_));
+    prefaultStack(prefault_stack_bytes_);
+    const size_t resampled_buffer_max_frames = source_->maxBlockFrames();
+    std::vector<float> block_to_process;
+    block_to_process.reserve(resampled_buffer_max_frames * channels_);
+    prefaultBuffer(block_to_process.data(), block_to_process.capacity() * sizeof(float));
 
     while (!should_exit_) {
+        uint64_t generation = 0;
         {
             std::unique_lock<std::mutex> lock(processing_mutex_);
             processing_cv_.wait(lock, [this, resampled_buffer_max_frames] {
-                const size_t required_frames = resampler_state_ ? resampled_buffer_max_frames : PROCESSING_BLOCK_SIZE;
+                const size_t required_frames = source_->resampling() ? resampled_buffer_max_frames : PROCESSING_BLOCK_SIZE;
                 bool has_enough_space = processed_ring_buffer_->available_write_frames() >= required_frames;
 
                 bool should_run = (playback_state_ == PlaybackState::PLAYING &&
@@ -329,43 +1281,36 @@ void RealtimeAudioEngine::processing_thread_func() {
             });
 
             if (should_exit_) break;
+            generation = seek_generation_.load();
+        }
 
-            if (playback_state_ == PlaybackState::PLAYING && !end_of_input_) {
-                size_t frames_read = decoder_->read(read_buffer.data(), PROCESSING_BLOCK_SIZE);
-                if (frames_read == 0) {
-                    if (!end_of_input_) {
-                        LOG_INFO("End of input file reached.");
-                        end_of_input_ = true;
-                    }
-                    continue;
-                }
+        if (playback_state_ == PlaybackState::PLAYING && !end_of_input_) {
+            // 読み込みは processing_mutex_ の外で行う（ストリーム入力では次のデータが届くまで待つ）
+            bool has_block = false;
+            {
+                std::lock_guard<std::mutex> source_lock(source_mutex_);
+                if (generation != seek_generation_.load()) continue;
+                has_block = source_->read(block_to_process);
+            }
 
-                std::vector<float> block_to_process;
-                size_t frames_to_process = 0;
-
-                if(resampler_state_) {
-                    SRC_DATA src_data;
-                    src_data.data_in = read_buffer.data();
-                    src_data.input_frames = frames_read;
-                    src_data.data_out = resampled_buffer.data();
-                    src_data.output_frames = resampled_buffer.size() / channels_;
-                    src_data.src_ratio = resampling_ratio_;
-                    src_data.end_of_input = (frames_read < PROCESSING_BLOCK_SIZE);
-
-                    if (src_process(resampler_state_, &src_data) == 0) {
-                        frames_to_process = src_data.output_frames_gen;
-                        block_to_process.assign(resampled_buffer.data(), resampled_buffer.data() + frames_to_process * channels_);
-                    }
-                } else {
-                    frames_to_process = frames_read;
-                    block_to_process.assign(read_buffer.data(), read_buffer.data() + frames_to_process * channels_);
+            std::lock_guard<std::mutex> lock(processing_mutex_);
+            // 読んでいる間にシークされたら、そのブロックは新しい位置のものではないので捨てる
+            if (should_exit_ || generation != seek_generation_.load()) continue;
+            if (!has_block) {
+                if (!end_of_input_) {
+                    LOG_INFO("End of input file reached.");
+                    end_of_input_ = true;
                 }
+                continue;
+            }
 
-                if(frames_to_process > 0) {
-                    effect_chain_.process(block_to_process);
-                    if(!processed_ring_buffer_->push(block_to_process.data(), frames_to_process)) {
-                        LOG_WARN("Ring buffer push failed (overflow).");
-                    }
+            const size_t frames_to_process = block_to_process.size() / channels_;
+            if(frames_to_process > 0) {
+                preset_bank_.process(block_to_process);
+                output_frame_ += static_cast<long long>(frames_to_process);
+                captureSnapshot(frames_to_process);
+                if(!processed_ring_buffer_->push(block_to_process.data(), frames_to_process)) {
+                    LOG_WARN("Ring buffer push failed (overflow).");
                 }
             }
         }
@@ -377,8 +1322,14 @@ void RealtimeAudioEngine::processing_thread_func() {
     LOG_INFO("Processing thread finished.");
 }
 
-int RealtimeAudioEngine::audioCallback(float* output_buffer, unsigned long frames_per_buffer) {
-    size_t frames_popped = processed_ring_buffer_->pop(output_buffer, frames_per_buffer);
+int RealtimeAudioEngine::audioCallback(float* output_buffer, unsigned long frames_per_buffer, const PaStreamCallbackTimeInfo* time_info) {
+    long long first_frame = 0;
+    size_t frames_popped = processed_ring_buffer_->pop(output_buffer, frames_per_buffer, &first_frame);
+    // 再生位置の計算用。コマンドのスレッドが読んでいる間は更新を1回見送る
+    if (position_mutex_.try_lock()) {
+        played_ = PlayedBuffer{first_frame, time_info ? time_info->outputBufferDacTime : 0.0, frames_popped};
+        position_mutex_.unlock();
+    }
 
     if (frames_popped < frames_per_buffer) {
         std::fill_n(output_buffer + frames_popped * channels_, (frames_per_buffer - frames_popped) * channels_, 0.0f);
@@ -397,8 +1348,656 @@ int RealtimeAudioEngine::audioCallback(float* output_buffer, unsigned long frame
     return paContinue;
 }
 
+// --- ライブ入力（キャプチャ）処理クラス ---
+/**
+ * @class LiveEngine
+ * @brief 入力デバイスの音をチェーンに通してそのまま出力する（--live）
+ *
+ * ファイル再生用のリングバッファ（RING_BUFFER_FRAMES）と処理スレッドを通さず、デュプレックス
+ * ストリームのコールバックの中で block_frames ごとにプリセットバンクを実行する。入力から出力までの
+ * 遅延はコールバックごとに（出力のDAC時刻 - 入力のADC時刻）として測り、処理時間と合わせて報告する。
+ *
+ * fake_capture を指定すると、入力デバイスの代わりにファイル（ストリーム入力も可）を block_frames ずつ
+ * 同じ処理に渡し、出力をWAVに書き出す（ハードウェアのないCI用）。既定ではデバイスと同じ速さで渡し、
+ * ブロックが揃ってから処理を終えるまでの実時間に、出力側のバッファ1ブロック分を加えて遅延とする。
+ */
+class LiveEngine {
+public:
+    struct Options {
+        std::string preset = "default";
+        std::filesystem::path config_directory;
+        int channels = 0;                   // 0 なら live.channels（fake_capture ではファイルのチャンネル数）
+        size_t block_frames = 0;            // 0 なら live.block_frames
+        int input_device = -1;              // -1 なら live.input_device、それも -1 なら既定のデバイス
+        int output_device = -1;
+        std::string fake_capture;           // 入力デバイスの代わりに読むファイル
+        std::string fake_output;            // fake_capture の出力を書くWAV（空なら捨てる）
+        bool pace = true;                   // fake_capture をブロックの長さごとに渡す（false なら待たずに）
+    };
+
+    LiveEngine(const Options& options, const json& params) : options_(options) {
+        const json live_params = params.value("live", json::object());
+        if (options_.block_frames == 0) options_.block_frames = live_params.value("block_frames", static_cast<size_t>(128));
+        options_.block_frames = std::clamp<size_t>(options_.block_frames, 16, PROCESSING_BLOCK_SIZE);
+        if (options_.input_device < 0) options_.input_device = live_params.value("input_device", -1);
+        if (options_.output_device < 0) options_.output_device = live_params.value("output_device", -1);
+        if (!options_.fake_capture.empty()) {
+            source_ = std::make_unique<SourceReader>(options_.fake_capture);
+            options_.channels = source_->info().channels;
+        } else if (options_.channels <= 0) {
+            options_.channels = live_params.value("channels", 2);
+        }
+        channels_ = options_.channels;
+        if (channels_ <= 0) throw std::runtime_error("Invalid live channel count.");
+
+        std::vector<PresetBank::Preset> presets = PresetBank::loadPresets(params, options_.config_directory);
+        setWorkerThreadSchedule(ThreadSchedule::workersFromJson(params.value("realtime", json::object())));
+        bank_.setup(presets, params.value("preset_shadow", false), channels_, TARGET_SAMPLE_RATE, options_.block_frames);
+        if (!bank_.select(options_.preset)) throw std::runtime_error("Unknown preset '" + options_.preset + "'.");
+        // コールバックで使うバッファはストリームを始める前（startDevice() より前）にページを割り当てておく
+        block_.reserve(options_.block_frames * static_cast<size_t>(channels_));
+        prefaultBuffer(block_.data(), block_.capacity() * sizeof(float));
+
+        // "realtime" の processing_thread はこのプログラムが作るスレッド（fake_capture を読むスレッド）にだけ適用する。
+        // デバイスのコールバックのスレッドはPortAudioのホストAPIが作って優先度を決めるため、変更しない
+        const json realtime_params = params.value("realtime", json::object());
+        schedule_ = ThreadSchedule::fromJson(realtime_params.value("processing_thread", json::object()));
+        prefault_stack_bytes_ = realtime_params.value("prefault_stack_kb", static_cast<size_t>(256)) * 1024;
+        if (realtime_params.value("lock_memory", false)) LOG_INFO("Realtime: memory " << lockProcessMemory());
+    }
+
+    ~LiveEngine() { stopDevice(); }
+
+    bool isFake() const { return source_ != nullptr; }
+
+    // 入力と出力のデバイスを開いて処理を始める
+    void startDevice() {
+        if (Pa_Initialize() != paNoError) throw std::runtime_error("PortAudio init failed.");
+        pa_initialized_ = true;
+        PaStreamParameters input_parameters = {}, output_parameters = {};
+        input_parameters.device = options_.input_device >= 0 ? options_.input_device : Pa_GetDefaultInputDevice();
+        output_parameters.device = options_.output_device >= 0 ? options_.output_device : Pa_GetDefaultOutputDevice();
+        if (input_parameters.device == paNoDevice || output_parameters.device == paNoDevice) {
+            throw std::runtime_error("No capture or playback device.");
+        }
+        const PaDeviceInfo* input_info = Pa_GetDeviceInfo(input_parameters.device);
+        const PaDeviceInfo* output_info = Pa_GetDeviceInfo(output_parameters.device);
+        if (!input_info || !output_info) throw std::runtime_error("Invalid capture or playback device index.");
+        LOG_INFO("Capture device: " << input_info->name << ", playback device: " << output_info->name);
+        input_parameters.channelCount = channels_;
+        input_parameters.sampleFormat = paFloat32;
+        input_parameters.suggestedLatency = input_info->defaultLowInputLatency;
+        output_parameters.channelCount = channels_;
+        output_parameters.sampleFormat = paFloat32;
+        output_parameters.suggestedLatency = output_info->defaultLowOutputLatency;
+
+        PaError err = Pa_OpenStream(&stream_, &input_parameters, &output_parameters, TARGET_SAMPLE_RATE,
+                                    static_cast<unsigned long>(options_.block_frames), paClipOff, paCallback, this);
+        if (err != paNoError) throw std::runtime_error("Failed to open duplex stream: " + std::string(Pa_GetErrorText(err)));
+        if (const PaStreamInfo* info = Pa_GetStreamInfo(stream_)) {
+            nominal_latency_ = info->inputLatency + info->outputLatency;
+            LOG_INFO("Live duplex stream: " << channels_ << " channels at " << info->sampleRate << " Hz, block " << options_.block_frames
+                     << " frames; device latency in " << info->inputLatency * 1000.0 << " ms + out " << info->outputLatency * 1000.0 << " ms");
+        }
+        LOG_INFO("Realtime: callback thread scheduling is left to the host API (processing_thread applies to fake capture only)");
+        err = Pa_StartStream(stream_);
+        if (err != paNoError) throw std::runtime_error("Failed to start duplex stream: " + std::string(Pa_GetErrorText(err)));
+    }
+
+    void stopDevice() {
+        if (stream_) {
+            Pa_StopStream(stream_);
+            Pa_CloseStream(stream_);
+            stream_ = nullptr;
+        }
+        if (pa_initialized_) {
+            Pa_Terminate();
+            pa_initialized_ = false;
+        }
+    }
+
+    /**
+     * @brief fake_capture のファイルを最後まで処理する
+     * @return 出力を書けなければ 1
+     */
+    int runFakeCapture() {
+        SNDFILE* out = nullptr;
+        if (!options_.fake_output.empty()) {
+            SF_INFO info = {};
+            info.samplerate = static_cast<int>(TARGET_SAMPLE_RATE);
+            info.channels = channels_;
+            info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+            out = sf_open(options_.fake_output.c_str(), SFM_WRITE, &info);
+            if (!out) {
+                LOG_ERROR("Cannot open '" << options_.fake_output << "' for writing: " << sf_strerror(nullptr));
+                return 1;
+            }
+        }
+        LOG_INFO("Fake capture from '" << options_.fake_capture << "': " << channels_ << " channels, block "
+                 << options_.block_frames << " frames" << (options_.pace ? " (paced in real time)" : " (unpaced)"));
+        // 待たずに処理する場合は他のスレッドを締め出さないよう、通常のスケジューリングのままにする
+        if (options_.pace) {
+            LOG_INFO("Realtime: fake capture thread " << applyThreadSchedule(schedule_));
+            prefaultStack(prefault_stack_bytes_);
+        }
+
+        const size_t channels = static_cast<size_t>(channels_);
+        const size_t block_samples = options_.block_frames * channels;
+        const double block_seconds = static_cast<double>(options_.block_frames) / TARGET_SAMPLE_RATE;
+        std::vector<float> pending, decoded, input(block_samples), output(block_samples);
+        size_t pending_offset = 0;
+        long long captured = 0;         // 渡したフレーム数（デバイスの時計）
+        bool end_of_input = false;
+        const auto start = std::chrono::steady_clock::now();
+        while (true) {
+            while (!end_of_input && pending.size() - pending_offset < block_samples) {
+                if (!source_->read(decoded)) {
+                    end_of_input = true;
+                    break;
+                }
+                pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(pending_offset));
+                pending_offset = 0;
+                pending.insert(pending.end(), decoded.begin(), decoded.end());
+            }
+            const size_t samples = std::min(block_samples, pending.size() - pending_offset);
+            if (samples == 0) break;
+            // 最後の端数のブロックは無音で埋める（デバイスは常に block_frames ずつ渡す）
+            std::copy(pending.begin() + static_cast<std::ptrdiff_t>(pending_offset), pending.begin() + static_cast<std::ptrdiff_t>(pending_offset + samples), input.begin());
+            std::fill(input.begin() + static_cast<std::ptrdiff_t>(samples), input.end(), 0.0f);
+            pending_offset += samples;
+
+            const double adc_time = static_cast<double>(captured) / TARGET_SAMPLE_RATE;
+            captured += static_cast<long long>(options_.block_frames);
+            const double block_complete = static_cast<double>(captured) / TARGET_SAMPLE_RATE;
+            if (options_.pace) {
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(block_complete)));
+            }
+            const auto begin = std::chrono::steady_clock::now();
+            processBlock(input.data(), output.data(), options_.block_frames);
+            const double processing = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            // 出力の先頭は、処理を終えた時点で再生中の1ブロックの後に鳴る
+            const double ready = options_.pace ? std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() : block_complete + processing;
+            recordCallback(ready + block_seconds - adc_time, processing, options_.block_frames, false);
+            if (out) sf_writef_float(out, output.data(), static_cast<sf_count_t>(samples / channels));
+        }
+        if (out) sf_close(out);
+        printReport();
+        return 0;
+    }
+
+    void printReport() const {
+        const uint64_t callbacks = stats_.callbacks.load();
+        if (callbacks == 0) {
+            LOG_INFO("Live latency: no blocks processed yet.");
+            return;
+        }
+        const double block_ms = static_cast<double>(options_.block_frames) / TARGET_SAMPLE_RATE * 1000.0;
+        LOG_INFO("Live latency (input -> output): min " << stats_.latency_min.load() * 1000.0 << " ms, avg "
+                 << stats_.latency_sum.load() / static_cast<double>(callbacks) * 1000.0 << " ms, max " << stats_.latency_max.load() * 1000.0
+                 << " ms over " << callbacks << " blocks of " << options_.block_frames << " frames (" << block_ms << " ms)");
+        const size_t chain_latency = bank_.latencySamples();
+        if (chain_latency > 0) {
+            LOG_INFO("Live chain latency: " << chain_latency << " samples (" << static_cast<double>(chain_latency) / TARGET_SAMPLE_RATE * 1000.0
+                     << " ms) on top of the device latency above");
+        }
+        LOG_INFO("Live processing: max " << stats_.processing_max.load() * 1000.0 << " ms per block; "
+                 << stats_.overruns.load() << " block(s) over budget, " << stats_.xruns.load() << " device xrun(s)");
+        LOG_INFO("Live worker deadlines: " << bank_.deadlineMisses() << " block(s) waited on the audio thread for worker results (convolver tail)");
+    }
+
+    bool selectPreset(const std::string& name) { return bank_.select(name); }
+    std::vector<std::string> presetNames() const { return bank_.names(); }
+    std::string activePreset() const { return bank_.activeName(); }
+
+private:
+    // コールバックが書き、コマンドのスレッドが読む（書き手は1つ）
+    struct LatencyStats {
+        std::atomic<uint64_t> callbacks{0};
+        std::atomic<uint64_t> overruns{0};          // 処理時間がブロックの長さを超えたブロック
+        std::atomic<uint64_t> xruns{0};             // デバイスが通知した入力のオーバーフロー・出力のアンダーフロー
+        std::atomic<double> latency_sum{0.0};
+        std::atomic<double> latency_min{INFINITY};
+        std::atomic<double> latency_max{0.0};
+        std::atomic<double> processing_max{0.0};
+    };
+
+    Options options_;
+    int channels_ = 0;
+    PresetBank bank_;
+    std::unique_ptr<SourceReader> source_;      // fake_capture の入力
+    ThreadSchedule schedule_;
+    size_t prefault_stack_bytes_ = 0;
+    std::vector<float> block_;                  // block_frames 分を確保済み（コールバックで確保しない）
+    PaStream* stream_ = nullptr;
+    bool pa_initialized_ = false;
+    double nominal_latency_ = 0.0;              // デバイスが時刻を返さない場合に使う
+    LatencyStats stats_;
+
+    // 1ブロックを処理する（デバイスのコールバックと fake_capture で共通）
+    void processBlock(const float* input, float* output, size_t frames) {
+        const size_t samples = frames * static_cast<size_t>(channels_);
+        if (input) block_.assign(input, input + samples);
+        else block_.assign(samples, 0.0f);
+        bank_.process(block_);
+        std::copy(block_.begin(), block_.end(), output);
+    }
+
+    void recordCallback(double latency, double processing, size_t frames, bool xrun) {
+        stats_.callbacks.store(stats_.callbacks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        stats_.latency_sum.store(stats_.latency_sum.load(std::memory_order_relaxed) + latency, std::memory_order_relaxed);
+        if (latency < stats_.latency_min.load(std::memory_order_relaxed)) stats_.latency_min.store(latency, std::memory_order_relaxed);
+        if (latency > stats_.latency_max.load(std::memory_order_relaxed)) stats_.latency_max.store(latency, std::memory_order_relaxed);
+        if (processing > stats_.processing_max.load(std::memory_order_relaxed)) stats_.processing_max.store(processing, std::memory_order_relaxed);
+        if (processing > static_cast<double>(frames) / TARGET_SAMPLE_RATE) stats_.overruns.store(stats_.overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (xrun) stats_.xruns.store(stats_.xruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    int audioCallback(const float* input, float* output, unsigned long frames, const PaStreamCallbackTimeInfo* time, PaStreamCallbackFlags flags) {
+        const auto begin = std::chrono::steady_clock::now();
+        processBlock(input, output, frames);
+        const double processing = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        // inputBufferAdcTime は入力の先頭、outputBufferDacTime は出力の先頭のサンプルの時刻（同じ時計）
+        const bool timed = time && time->inputBufferAdcTime > 0.0 && time->outputBufferDacTime > time->inputBufferAdcTime;
+        const double latency = timed ? time->outputBufferDacTime - time->inputBufferAdcTime : nominal_latency_;
+        recordCallback(latency, processing, frames, (flags & (paInputOverflow | paOutputUnderflow)) != 0);
+        return paContinue;
+    }
+    static int paCallback(const void* in, void* out, unsigned long frames, const PaStreamCallbackTimeInfo* time, PaStreamCallbackFlags flags, void* data) {
+        return static_cast<LiveEngine*>(data)->audioCallback(static_cast<const float*>(in), static_cast<float*>(out), frames, time, flags);
+    }
+};
+
+// --- オフラインレンダリングクラス ---
+/**
+ * @class OfflineRenderer
+ * @brief ファイル全体をチェーンに通してWAV（4GBを超える場合はRF64）に書き出す（--render）
+ *
+ * 出力を区間に分け、区間ごとに独立した SourceReader とチェーンを WorkStealingPool のワーカーで
+ * 並列に処理する。2番目以降の区間は、チェーンのテール長と preroll_sec の長い方だけ手前から処理して
+ * フィルタやエンベロープの状態を収束させ、前の区間と crossfade_ms の直線クロスフェードでつなぐ。
+ * 区間の出力は一時ファイルに書き、全区間の終了後に順につなげて書き出す。
+ * validate では1スレッド（区間1つ）で全体を処理し直し、書き出したファイルとの最大偏差を報告する。
+ *
+ * FFTWの計画やデコーダの初期化はスレッドセーフではないため、チェーンと SourceReader は
+ * 呼び出しスレッドで順に構築し、ワーカーは処理だけを行う。
+ */
+class OfflineRenderer : private WorkStealingPool::Client {
+public:
+    struct Options {
+        std::string input;
+        std::string output;
+        std::string preset = "default";
+        std::filesystem::path config_directory;     // params.json とプリセット・オートメーションのファイルの場所
+        size_t segments = 0;            // 0 なら offline_render.segments、それも0ならハードウェアのスレッド数
+        bool validate = false;
+    };
+
+    OfflineRenderer(const Options& options, const json& params) : options_(options), chain_params_(params) {
+        const json render_params = params.value("offline_render", json::object());
+        if (options_.segments == 0) options_.segments = render_params.value("segments", static_cast<size_t>(0));
+        if (options_.segments == 0) options_.segments = std::max(1u, std::thread::hardware_concurrency());
+        preroll_frames_ = std::max(0LL, std::llround(render_params.value("preroll_sec", 2.0) * TARGET_SAMPLE_RATE));
+        crossfade_frames_ = std::max(1LL, std::llround(render_params.value("crossfade_ms", 10.0) * 0.001 * TARGET_SAMPLE_RATE));
+        min_segment_frames_ = std::max(4 * crossfade_frames_, std::llround(render_params.value("min_segment_sec", 10.0) * TARGET_SAMPLE_RATE));
+        compensate_latency_ = render_params.value("compensate_latency", true);
+    }
+
+    int run() {
+        auto probe = std::make_unique<SourceReader>(options_.input);
+        channels_ = probe->info().channels;
+        max_block_frames_ = probe->maxBlockFrames();
+        const long long total = probe->totalOutputFrames();
+        // ストリーム入力は読み直せないため、1区間で先頭から処理する
+        const bool seekable = probe->seekable();
+        if (!seekable) {
+            LOG_INFO("Stream input: rendering in a single segment.");
+            options_.segments = 1;
+        }
+        LOG_INFO("Rendering '" << options_.input << "' -> '" << options_.output << "' (" << channels_ << " channels, "
+                 << static_cast<double>(total) / TARGET_SAMPLE_RATE << "s at " << TARGET_SAMPLE_RATE << " Hz)");
+
+        // 区間の境界は出力の格子（整数の入力フレームに対応する位置）に揃える
+        const long long count = std::max(1LL, std::min(static_cast<long long>(options_.segments), total / min_segment_frames_));
+        const long long grid = probe->outputGrid();
+        segments_.clear();
+        segments_.resize(static_cast<size_t>(count));
+        for (long long i = 0; i < count; ++i) {
+            Segment& segment = segments_[static_cast<size_t>(i)];
+            segment.begin = (i == 0) ? 0 : total * i / count / grid * grid;
+            segment.end = (i + 1 == count) ? LLONG_MAX : total * (i + 1) / count / grid * grid;
+            segment.write_begin = (i == 0) ? 0 : segment.begin - crossfade_frames_;
+            segment.warm = (i > 0);
+            segment.temp = options_.output + ".segment" + std::to_string(i) + ".tmp";
+            segment.source = (i == 0) ? std::move(probe) : std::make_unique<SourceReader>(options_.input);
+            segment.chain = makeChain();
+        }
+
+        const auto render_start = std::chrono::steady_clock::now();
+        WorkStealingPool pool;
+        pool.start(segments_.size(), segments_.size());
+        std::vector<size_t> roots(segments_.size());
+        std::iota(roots.begin(), roots.end(), 0);
+        pool.run(*this, roots, segments_.size());
+        pool.stop();
+        bool ok = true;
+        for (const Segment& segment : segments_) {
+            if (!segment.error.empty()) {
+                LOG_ERROR("Segment render failed: " << segment.error);
+                ok = false;
+            }
+        }
+        const long long frames = ok ? stitch() : -1;
+        for (Segment& segment : segments_) {
+            std::error_code ignored;
+            std::filesystem::remove(segment.temp, ignored);
+            segment.chain.reset();
+            segment.source.reset();
+        }
+        if (frames < 0) return 1;
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start).count();
+        LOG_INFO("Rendered " << static_cast<double>(frames) / TARGET_SAMPLE_RATE << "s in " << elapsed << "s with "
+                 << segments_.size() << " segment(s) (" << static_cast<double>(frames) / TARGET_SAMPLE_RATE / std::max(elapsed, 1e-9) << "x realtime)");
+        if (options_.validate && !seekable) {
+            LOG_WARN("--validate needs a file input; skipped for stream input.");
+            return 0;
+        }
+        return options_.validate ? validate(frames) : 0;
+    }
+
+private:
+    struct Segment {
+        long long begin = 0, end = 0;   // 担当する出力フレーム [begin, end)
+        long long write_begin = 0;      // 一時ファイルに書き始める位置（前の区間と重ねるクロスフェード分だけ手前）
+        bool warm = false;              // 手前から処理して状態を収束させる
+        std::string temp;
+        long long written = 0;
+        std::string error;
+        std::unique_ptr<SourceReader> source;
+        std::unique_ptr<EffectChain> chain;
+    };
+
+    Options options_;
+    json chain_params_;
+    int channels_ = 0;
+    size_t max_block_frames_ = PROCESSING_BLOCK_SIZE;  // SourceReader::read() が返す最大のブロック長
+    long long preroll_frames_ = 0;
+    long long crossfade_frames_ = 0;
+    long long min_segment_frames_ = 0;
+    bool compensate_latency_ = true;    // チェーンの遅延だけ出力を前に詰め、末尾は無音を入力して出し切る
+    std::vector<Segment> segments_;
+
+    std::unique_ptr<EffectChain> makeChain() const {
+        for (const auto& preset : PresetBank::loadPresets(chain_params_, options_.config_directory)) {
+            if (preset.name != options_.preset) continue;
+            auto chain = std::make_unique<EffectChain>();
+            chain->setup(preset.params, channels_, TARGET_SAMPLE_RATE, max_block_frames_);
+            return chain;
+        }
+        throw std::runtime_error("Unknown preset '" + options_.preset + "'.");
+    }
+
+    void execute(size_t task, size_t worker) override {
+        (void)worker;
+        Segment& segment = segments_[task];
+        std::ofstream file(segment.temp, std::ios::binary);
+        if (!file) {
+            segment.error = "cannot write '" + segment.temp + "'";
+            return;
+        }
+        segment.written = render(*segment.source, *segment.chain, segment.warm, segment.write_begin, segment.end,
+                                 [&file](const float* data, size_t bytes) { file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(bytes)); });
+        if (!file) segment.error = "write to '" + segment.temp + "' failed";
+    }
+
+    /**
+     * @brief 出力フレーム [from, end) を処理して sink にバイト列で渡す
+     * @param warm true なら from より warm-up（テール長と preroll の長い方）だけ手前から処理し、その出力は捨てる
+     * @return sink に渡したフレーム数（入力が先に終われば end - from より短い）
+     *
+     * compensate_latency では出力フレーム f にチェーンの出力 f + 遅延 を書き、入力の終わりの後は
+     * 遅延の長さだけ無音を処理して、入力と同じ長さ・同じ時刻の出力にする。
+     */
+    long long render(SourceReader& source, EffectChain& chain, bool warm, long long from, long long end,
+                     const std::function<void(const float*, size_t)>& sink) const {
+        const long long latency = compensate_latency_ ? static_cast<long long>(chain.latencySamples()) : 0;
+        from += latency;
+        end = (end > LLONG_MAX - latency) ? LLONG_MAX : end + latency;
+        const long long warmup = warm ? std::max(static_cast<long long>(chain.warmupFrames()), preroll_frames_) : 0;
+        const long long start = std::max(0LL, from - warmup);
+        chain.seekTimeline(static_cast<double>(start) / TARGET_SAMPLE_RATE);
+        long long position = source.seekBefore(start);
+        long long written = 0;
+        long long flush_end = LLONG_MAX;    // 入力が終わった後、無音を処理する終わりの位置
+        std::vector<float> block;
+        while (position < end) {
+            if (flush_end == LLONG_MAX && !source.read(block)) flush_end = position + latency;
+            if (flush_end != LLONG_MAX) {
+                if (position >= flush_end) break;
+                block.assign(static_cast<size_t>(std::min<long long>(flush_end - position, PROCESSING_BLOCK_SIZE)) * channels_, 0.0f);
+            }
+            const long long block_start = position;
+            const long long num_frames = static_cast<long long>(block.size()) / channels_;
+            position += num_frames;
+            const long long skip = std::min(std::max(start - block_start, 0LL), num_frames);
+            if (skip == num_frames) continue;
+            block.erase(block.begin(), block.begin() + skip * channels_);
+            chain.process(block);
+            const long long first = block_start + skip;
+            const long long lo = std::min(std::max(from - first, 0LL), num_frames - skip);
+            const long long hi = std::min(std::max(end - first, 0LL), num_frames - skip);
+            if (hi > lo) {
+                sink(block.data() + lo * channels_, static_cast<size_t>(hi - lo) * channels_ * sizeof(float));
+                written += hi - lo;
+            }
+        }
+        return written;
+    }
+
+    // 一時ファイルを順につなげて書き出す。重なる区間は前の区間から次の区間へ直線でクロスフェードする
+    long long stitch() const {
+        SF_INFO info = {};
+        info.samplerate = static_cast<int>(TARGET_SAMPLE_RATE);
+        info.channels = channels_;
+        info.format = SF_FORMAT_RF64 | SF_FORMAT_FLOAT;
+        SNDFILE* out = sf_open(options_.output.c_str(), SFM_WRITE, &info);
+        if (!out) {
+            LOG_ERROR("Cannot open '" << options_.output << "' for writing: " << sf_strerror(nullptr));
+            return -1;
+        }
+        sf_command(out, SFC_RF64_AUTO_DOWNGRADE, nullptr, SF_TRUE);
+
+        const size_t channels = static_cast<size_t>(channels_);
+        std::vector<float> buffer(PROCESSING_BLOCK_SIZE * channels);
+        std::vector<float> tail;       // 前の区間の、次の区間と重なる部分
+        long long total = 0;
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            const Segment& segment = segments_[i];
+            std::ifstream file(segment.temp, std::ios::binary);
+            auto read = [&file, channels](float* data, long long frames) {
+                file.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(frames * channels * sizeof(float)));
+            };
+            long long remaining = segment.written;
+
+            // 前の区間の末尾と、この区間の先頭を重ねる
+            const long long overlap = std::min(static_cast<long long>(tail.size() / channels), remaining);
+            if (overlap > 0) {
+                std::vector<float> head(static_cast<size_t>(overlap) * channels);
+                read(head.data(), overlap);
+                for (long long n = 0; n < overlap; ++n) {
+                    const float fade_in = static_cast<float>((static_cast<double>(n) + 0.5) / static_cast<double>(overlap));
+                    for (size_t c = 0; c < channels; ++c) {
+                        float& sample = head[static_cast<size_t>(n) * channels + c];
+                        sample = tail[static_cast<size_t>(n) * channels + c] * (1.0f - fade_in) + sample * fade_in;
+                    }
+                }
+                total += sf_writef_float(out, head.data(), overlap);
+                remaining -= overlap;
+            }
+
+            // 次の区間と重なる末尾は残しておく
+            long long keep = 0;
+            if (i + 1 < segments_.size()) {
+                keep = std::min(remaining, std::max(0LL, segment.write_begin + segment.written - segments_[i + 1].write_begin));
+            }
+            long long body = remaining - keep;
+            while (body > 0) {
+                const long long frames = std::min(body, static_cast<long long>(PROCESSING_BLOCK_SIZE));
+                read(buffer.data(), frames);
+                total += sf_writef_float(out, buffer.data(), frames);
+                body -= frames;
+            }
+            tail.assign(static_cast<size_t>(keep) * channels, 0.0f);
+            if (keep > 0) read(tail.data(), keep);
+            if (!file) {
+                LOG_ERROR("Reading '" << segment.temp << "' failed.");
+                sf_close(out);
+                return -1;
+            }
+        }
+        sf_close(out);
+        return total;
+    }
+
+    // 1区間で処理し直し、書き出したファイルとの最大偏差を報告する
+    int validate(long long frames) {
+        LOG_INFO("Validating against a single-threaded render...");
+        SF_INFO info = {};
+        SNDFILE* file = sf_open(options_.output.c_str(), SFM_READ, &info);
+        if (!file) {
+            LOG_ERROR("Cannot reopen '" << options_.output << "': " << sf_strerror(nullptr));
+            return 1;
+        }
+        SourceReader source(options_.input);
+        auto chain = makeChain();
+        std::vector<float> rendered;
+        double max_deviation = 0.0;
+        long long worst_frame = 0;
+        long long position = 0;
+        const long long reference = render(source, *chain, false, 0, LLONG_MAX, [&](const float* data, size_t bytes) {
+            const size_t samples = bytes / sizeof(float);
+            rendered.resize(samples);
+            const sf_count_t read = sf_readf_float(file, rendered.data(), static_cast<sf_count_t>(samples / channels_));
+            std::fill(rendered.begin() + read * channels_, rendered.end(), 0.0f);
+            for (size_t i = 0; i < samples; ++i) {
+                const double deviation = std::fabs(static_cast<double>(data[i]) - static_cast<double>(rendered[i]));
+                if (deviation > max_deviation) {
+                    max_deviation = deviation;
+                    worst_frame = position + static_cast<long long>(i) / channels_;
+                }
+            }
+            position += static_cast<long long>(samples) / channels_;
+        });
+        sf_close(file);
+        LOG_INFO("Max deviation from single-threaded output: " << max_deviation << " ("
+                 << (max_deviation > 0.0 ? 20.0 * std::log10(max_deviation) : -INFINITY) << " dBFS) at "
+                 << static_cast<double>(worst_frame) / TARGET_SAMPLE_RATE << "s; length " << frames << " vs " << reference << " frames");
+        return 0;
+    }
+};
+
 // --- main関数とヘルパー ---
-void print_help() { std::cout << "Commands: play, pause, stop, reload, seek <sec>, exit, help\n"; }
+// 実行ファイルと同じディレクトリの params.json を読み、FFTWの計画レベルを設定する（読めなければ空のオブジェクト）
+json readParamsFile(const std::filesystem::path& directory) {
+    json params;
+    std::ifstream f(directory / "params.json");
+    if (f.is_open()) params = json::parse(f, nullptr, false, true);
+    if (!params.is_object()) {
+        LOG_WARN("Could not read params.json. Using defaults.");
+        params = json::object();
+    }
+    FFTPlanRegistry::getInstance().setPlannerLevel(params.value("fftw_planner", "measure"));
+    return params;
+}
+
+// realtime_enhancer --render <入力> <出力> [--segments N] [--preset 名前] [--validate]
+int runOfflineRender(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " --render <audio_file> <output.wav> [--segments N] [--preset name] [--validate]" << std::endl;
+        return 1;
+    }
+    OfflineRenderer::Options options;
+    options.input = argv[2];
+    options.output = argv[3];
+    options.config_directory = std::filesystem::path(argv[0]).parent_path();
+    for (int i = 4; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--validate") options.validate = true;
+        else if (arg == "--segments" && i + 1 < argc) options.segments = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        else if (arg == "--preset" && i + 1 < argc) options.preset = argv[++i];
+        else { std::cerr << "Unknown option: " << arg << std::endl; return 1; }
+    }
+
+    const json params = readParamsFile(options.config_directory);
+    try {
+        OfflineRenderer renderer(options, params);
+        const int code = renderer.run();
+        FFTPlanRegistry::getInstance().saveWisdom();
+        return code;
+    } catch (const std::exception& e) {
+        LOG_ERROR("Render failed: " << e.what());
+        return 1;
+    }
+}
+
+// realtime_enhancer --live [--preset 名前] [--channels N] [--block N] [--input-device N] [--output-device N]
+//                          [--fake-capture <入力> [--fake-output <出力.wav>] [--no-pace]]
+int runLiveMode(int argc, char* argv[]) {
+    LiveEngine::Options options;
+    options.config_directory = std::filesystem::path(argv[0]).parent_path();
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--no-pace") options.pace = false;
+        else if (arg == "--preset" && has_value) options.preset = argv[++i];
+        else if (arg == "--channels" && has_value) options.channels = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--block" && has_value) options.block_frames = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        else if (arg == "--input-device" && has_value) options.input_device = std::atoi(argv[++i]);
+        else if (arg == "--output-device" && has_value) options.output_device = std::atoi(argv[++i]);
+        else if (arg == "--fake-capture" && has_value) options.fake_capture = argv[++i];
+        else if (arg == "--fake-output" && has_value) options.fake_output = argv[++i];
+        else {
+            std::cerr << "Usage: " << argv[0] << " --live [--preset name] [--channels N] [--block N] [--input-device N] [--output-device N]"
+                      << " [--fake-capture <audio_file> [--fake-output <output.wav>] [--no-pace]]" << std::endl;
+            return 1;
+        }
+    }
+
+    const json params = readParamsFile(options.config_directory);
+    try {
+        LiveEngine engine(options, params);
+        FFTPlanRegistry::getInstance().saveWisdom();
+        if (engine.isFake()) return engine.runFakeCapture();
+
+        engine.startDevice();
+        std::cout << "Commands: latency, preset [name], exit\n";
+        for (std::string line; std::cout << "> " && std::getline(std::cin, line);) {
+            std::stringstream ss(line);
+            std::string command;
+            ss >> command;
+            if (command == "exit" || command == "quit") break;
+            if (command == "latency") engine.printReport();
+            else if (command == "preset") {
+                std::string name;
+                if (ss >> name) {
+                    if (!engine.selectPreset(name)) std::cout << "Unknown preset: '" << name << "'\n";
+                } else {
+                    for (const auto& preset : engine.presetNames()) {
+                        std::cout << (preset == engine.activePreset() ? " * " : "   ") << preset << "\n";
+                    }
+                }
+            }
+            else if (!command.empty()) std::cout << "Unknown command: '" << command << "'\n";
+        }
+        engine.stopDevice();
+        engine.printReport();
+    } catch (const std::exception& e) {
+        LOG_ERROR("Live mode failed: " << e.what());
+        return 1;
+    }
+    return 0;
+}
+
+void print_help() { std::cout << "Commands: play, pause, stop, reload, seek <sec>, position, preset [name], exit, help\n"; }
 
 void registerAllEffects() {
     auto& factory = AudioEffectFactory::getInstance();
@@ -420,13 +2019,43 @@ void registerAllEffects() {
     // Custom Enhancement
     factory.registerEffect<Exciter>("exciter");
     factory.registerEffect<GlossEnhancer>("gloss_enhancer");
+
+    // Convolution
+    factory.registerEffect<Convolver>("convolver");
+}
+
+// realtime_enhancer --bench: 個々のエフェクトに加え、params.json の既定のチェーン全体を測る。
+// マルチバンド・コンプレッサーの multirate を切り替えたチェーンも構築し、処理時間と出力の差を比べる
+int runBenchmarkMode(const std::filesystem::path& directory) {
+    registerAllEffects();
+    json params = readParamsFile(directory);
+    std::vector<std::unique_ptr<EffectChain>> chains;
+    std::vector<BenchmarkChain> benchmarks;
+    auto addChain = [&](const std::string& label, const json& chain_params) {
+        chains.push_back(std::make_unique<EffectChain>());
+        EffectChain& chain = *chains.back();
+        chain.setup(chain_params, 2, TARGET_SAMPLE_RATE, PROCESSING_BLOCK_SIZE);
+        benchmarks.push_back(BenchmarkChain{label, [&chain](std::vector<float>& block) { chain.process(block); }, chain.latencySamples()});
+    };
+    addChain("params.json chain", params);
+    if (params.contains("multiband_compressor") && params["multiband_compressor"].is_object()) {
+        json toggled = params;
+        const bool multirate = toggled["multiband_compressor"].value("multirate", false);
+        toggled["multiband_compressor"]["multirate"] = !multirate;
+        addChain(multirate ? "params.json chain, multirate off" : "params.json chain, multirate on", toggled);
+    }
+    return runBenchmarks(TARGET_SAMPLE_RATE, PROCESSING_BLOCK_SIZE, benchmarks);
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) { std::cerr << "Usage: " << argv[0] << " <audio_file> [start_sec]" << std::endl; return 1; }
+    if (argc >= 2 && std::string(argv[1]) == "--bench") return runBenchmarkMode(std::filesystem::path(argv[0]).parent_path());
+    if (argc < 2) { std::cerr << "Usage: " << argv[0] << " <audio_file> [start_sec] | --render <audio_file> <output.wav> [options] | --live [options] | --bench" << std::endl; return 1; }
 
     LOG_INFO("Application starting...");
     registerAllEffects();
+    FFTPlanRegistry::getInstance().loadWisdom((std::filesystem::path(argv[0]).parent_path() / "fftw_wisdom.dat").string());
+    if (std::string(argv[1]) == "--render") return runOfflineRender(argc, argv);
+    if (std::string(argv[1]) == "--live") return runLiveMode(argc, argv);
 
     try {
         RealtimeAudioEngine engine(argv[1], argv[0]);
@@ -460,6 +2089,17 @@ int main(int argc, char* argv[]) {
                     if (ss >> sec) engine.seek(sec);
                     else std::cout << "Usage: seek <seconds>\n";
                 }
+                else if (command == "preset") {
+                    std::string name;
+                    if (ss >> name) {
+                        if (!engine.selectPreset(name)) std::cout << "Unknown preset: '" << name << "'\n";
+                    } else {
+                        for (const auto& preset : engine.presetNames()) {
+                            std::cout << (preset == engine.activePreset() ? " * " : "   ") << preset << "\n";
+                        }
+                    }
+                }
+                else if (command == "position") std::cout << "Position: " << engine.playbackPosition() << "s\n";
                 else if (command == "help") print_help();
                 else if (!command.empty()) std::cout << "Unknown command: '" << command << "'\n";
             } catch (const std::exception& e) {
@@ -0,0 +1,146 @@
+// ./multirate.cpp
+#include "multirate.h"
+#include <cmath>
+
+namespace {
+
+// 0次の第1種変形ベッセル関数（Kaiser窓用の級数展開）
+double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Kaiser窓付きsincのハーフバンドFIRを設計し、中心から奇数番目（±1, ±3, ...）の係数を返す
+// 直流利得が1になるよう正規化する（中心 0.5 + 両側の和 0.5）
+std::vector<float> designHalfband(int taps) {
+    const int half = (taps - 1) / 2;
+    const double beta = 7.0;
+    std::vector<double> side;
+    double sum = 0.0;
+    for (int n = 1; n <= half; n += 2) {
+        const double ratio = static_cast<double>(n) / (half + 1);
+        const double window = besselI0(beta * std::sqrt(1.0 - ratio * ratio)) / besselI0(beta);
+        const double sinc = std::sin(M_PI * n / 2.0) / (M_PI * n);
+        side.push_back(sinc * window);
+        sum += 2.0 * side.back();
+    }
+    std::vector<float> result;
+    for (double c : side) result.push_back(static_cast<float>(c * 0.5 / sum));
+    return result;
+}
+
+// 段ごとのタップ数: 最も内側（最も低いレート）の段は通過域が帯域端に近いので長くし、
+// 外側の段は折り返しが低域に届かないので短くて済む
+int stageTaps(int stage, int octaves) {
+    if (stage == octaves - 1) return 23;
+    if (stage == octaves - 2) return 11;
+    return 7;
+}
+
+} // namespace
+
+void HalfbandDecimator::configure(int taps, size_t max_frames) {
+    side_ = designHalfband(taps);
+    half_ = static_cast<size_t>((taps - 1) / 2);
+    work_.reserve(2 * half_ + max_frames);
+    work_.assign(2 * half_, 0.0f);
+    phase_ = 0;
+}
+
+void HalfbandDecimator::reset() {
+    work_.assign(2 * half_, 0.0f);
+    phase_ = 0;
+}
+
+size_t HalfbandDecimator::process(const float* in, size_t frames, float* out) {
+    const size_t history = 2 * half_;
+    work_.resize(history + frames);
+    std::copy(in, in + frames, work_.begin() + static_cast<std::ptrdiff_t>(history));
+
+    // 入力の通し番号が奇数のサンプルで出力する。出力の中心は half_ サンプル前の入力
+    size_t count = 0;
+    const size_t taps = side_.size();
+    for (size_t i = (phase_ == 0) ? 1 : 0; i < frames; i += 2) {
+        const float* center = work_.data() + i + half_;
+        float acc = 0.5f * center[0];
+        for (size_t p = 0; p < taps; ++p) {
+            const size_t offset = 2 * p + 1;
+            acc += side_[p] * (center[-static_cast<std::ptrdiff_t>(offset)] + center[offset]);
+        }
+        out[count++] = acc;
+    }
+    phase_ = (phase_ + frames) & 1;
+    std::copy(work_.end() - static_cast<std::ptrdiff_t>(history), work_.end(), work_.begin());
+    work_.resize(history);
+    return count;
+}
+
+void HalfbandInterpolator::configure(int taps, size_t max_frames) {
+    side_ = designHalfband(taps);
+    history_ = side_.size() * 2 - 1;
+    work_.reserve(history_ + max_frames);
+    work_.assign(history_, 0.0f);
+}
+
+void HalfbandInterpolator::reset() {
+    work_.assign(history_, 0.0f);
+}
+
+void HalfbandInterpolator::process(const float* in, size_t frames, float* out) {
+    work_.resize(history_ + frames);
+    std::copy(in, in + frames, work_.begin() + static_cast<std::ptrdiff_t>(history_));
+
+    // 0を挟んで2倍にアップサンプルした信号にハーフバンドFIRを掛けたものと同じ
+    // 偶数位相: 両側の係数の積和（2倍の利得）、奇数位相: 中心係数（0.5 * 2）で遅延した入力
+    const size_t k = side_.size() - 1;
+    for (size_t i = 0; i < frames; ++i) {
+        const float* current = work_.data() + i + history_;
+        float acc = 0.0f;
+        for (size_t p = 0; p <= k; ++p) {
+            acc += side_[p] * (current[-static_cast<std::ptrdiff_t>(k - p)] + current[-static_cast<std::ptrdiff_t>(k + 1 + p)]);
+        }
+        out[2 * i] = 2.0f * acc;
+        out[2 * i + 1] = current[-static_cast<std::ptrdiff_t>(k)];
+    }
+    std::copy(work_.end() - static_cast<std::ptrdiff_t>(history_), work_.end(), work_.begin());
+    work_.resize(history_);
+}
+
+int MultirateBand::octavesFor(double sample_rate, double max_freq) {
+    int octaves = 0;
+    while (octaves < kMaxOctaves && sample_rate / static_cast<double>(2 << octaves) >= kMinRateRatio * max_freq) ++octaves;
+    return octaves;
+}
+
+void MultirateBand::configure(int octaves, size_t max_block_frames) {
+    stages_.assign(static_cast<size_t>(std::max(octaves, 0)), Stage());
+    latency_ = 0;
+    max_block_frames_ = std::max<size_t>(max_block_frames, 1);
+    size_t frames = max_block_frames_;     // この段に入る最大のサンプル数
+    for (int s = 0; s < octaves; ++s) {
+        const int taps = stageTaps(s, octaves);
+        Stage& stage = stages_[static_cast<size_t>(s)];
+        const size_t low_frames = frames / 2 + 1;
+        stage.decimator.configure(taps, frames);
+        stage.interpolator.configure(taps, low_frames);
+        stage.low.resize(low_frames);
+        // 補間した出力は1サンプル待ってから返すので、1段の往復の遅延は（その段のレートで）taps - 1
+        stage.queue.reserve(2 * low_frames + 1);
+        stage.queue.assign(1, 0.0f);
+        latency_ += static_cast<size_t>(taps - 1) << s;
+        frames = low_frames;
+    }
+}
+
+void MultirateBand::reset() {
+    for (Stage& stage : stages_) {
+        stage.decimator.reset();
+        stage.interpolator.reset();
+        stage.queue.assign(1, 0.0f);
+        stage.low_count = 0;
+    }
+}
@@ -0,0 +1,141 @@
+// ./multirate.h
+// 低域だけに作用する処理を、ハーフバンドフィルタで間引いた低いサンプリングレートで実行する
+#pragma once
+
+#include "state_archive.h"
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+/**
+ * @brief 2:1 のポリフェーズ・ハーフバンドFIRによる間引き
+ *
+ * ハーフバンドFIRは中心以外の偶数番目の係数が0で、残りは左右対称なので、出力1サンプルあたりの
+ * 積和は (taps + 1) / 4 回で済む。入力2サンプルごとに1サンプルを出力し、ブロック境界を
+ * またいだ位相と履歴を保持するため、ブロックの分け方によらず同じ出力になる。
+ */
+class HalfbandDecimator {
+public:
+    // taps は 4k+3（7, 11, 15, ...）。max_frames は process() に渡す最大のサンプル数（作業バッファを確保する）
+    void configure(int taps, size_t max_frames);
+    void reset();
+    void serializeState(StateArchive& ar) { ar(work_, phase_); }
+    // in の frames サンプルを取り込み、out に出力を書いて出力数（frames/2 の切り捨てか切り上げ）を返す
+    size_t process(const float* in, size_t frames, float* out);
+
+private:
+    std::vector<float> side_;   // 中心から ±1, ±3, ... 離れた係数（中心は 0.5）
+    std::vector<float> work_;   // 直前の taps-1 サンプル + 入力ブロック
+    size_t half_ = 0;           // (taps - 1) / 2
+    size_t phase_ = 0;          // これまでの入力数の偶奇
+};
+
+/**
+ * @brief 1:2 のポリフェーズ・ハーフバンドFIRによる補間
+ *
+ * 入力1サンプルにつき2サンプルを出力する。片方の位相は中心係数だけなので遅延した入力そのもの、
+ * もう片方は (taps + 1) / 2 回の積和で求まる。
+ */
+class HalfbandInterpolator {
+public:
+    void configure(int taps, size_t max_frames);
+    void reset();
+    void serializeState(StateArchive& ar) { ar(work_); }
+    // out には 2 * frames サンプルを書く
+    void process(const float* in, size_t frames, float* out);
+
+private:
+    std::vector<float> side_;
+    std::vector<float> work_;   // 直前の (taps-1)/2 サンプル + 入力ブロック
+    size_t history_ = 0;
+};
+
+/**
+ * @brief 信号を 2^octaves 分の1のレートに間引いて処理し、元のレートに補間して戻す
+ *
+ * ハーフバンドの間引きと補間を octaves 段重ねる。低レート側の処理は process() に渡す関数で
+ * インプレースに行う。出力は入力に対して latency() サンプル遅れる（直線位相なので全周波数で
+ * 同じ遅延）ため、元のレートのまま処理する信号と合成する側はその分だけ遅延させて揃える。
+ * 各段は入力1サンプルにつき出力1サンプルを返すので、ブロック長は任意でよい。
+ * 作業バッファは configure() で max_block_frames に合わせて確保し、それより長いブロックは
+ * その長さずつに分けて処理する（処理スレッドでは確保しない）。
+ */
+class MultirateBand {
+public:
+    /**
+     * @brief 最高周波数 max_freq の信号を扱うのに使える間引き段数
+     *
+     * 間引き後のレートが max_freq の kMinRateRatio 倍以上残る最大の段数（kMaxOctaves まで）を返す。
+     * 0 は間引かない（元のレートで処理する）ことを表す。
+     */
+    static int octavesFor(double sample_rate, double max_freq);
+
+    static constexpr int kMaxOctaves = 5;           // 192kHz で 6kHz まで
+    static constexpr double kMinRateRatio = 24.0;   // 間引き後のレート / 最高周波数
+
+    void configure(int octaves, size_t max_block_frames);
+    void reset();
+    void serializeState(StateArchive& ar) { ar(stages_); }
+    int octaves() const { return static_cast<int>(stages_.size()); }
+    int factor() const { return 1 << octaves(); }
+    size_t latency() const { return latency_; }
+
+    /**
+     * @brief in を間引き、low_rate(samples, count) で処理してから補間して out に書く
+     * @param out in と同じでもよい（frames サンプル）
+     */
+    template <class LowRateFunction>
+    void process(const float* in, float* out, size_t frames, LowRateFunction&& low_rate) {
+        if (stages_.empty()) {
+            std::copy(in, in + frames, out);
+            low_rate(out, frames);
+            return;
+        }
+        while (frames > max_block_frames_) {
+            processChunk(in, out, max_block_frames_, low_rate);
+            in += max_block_frames_;
+            out += max_block_frames_;
+            frames -= max_block_frames_;
+        }
+        processChunk(in, out, frames, low_rate);
+    }
+
+private:
+    struct Stage {
+        HalfbandDecimator decimator;
+        HalfbandInterpolator interpolator;
+        std::vector<float> low;     // この段で間引いた（処理後は補間前の）信号
+        size_t low_count = 0;
+        std::vector<float> queue;   // 補間した出力のうち、まだ外側に返していないもの
+        void serializeState(StateArchive& ar) { ar(decimator, interpolator); ar.buffer(queue); }
+    };
+    std::vector<Stage> stages_;
+    size_t latency_ = 0;
+    size_t max_block_frames_ = 0;
+
+    // frames は max_block_frames_ 以下（configure() で確保したバッファの中で処理する）
+    template <class LowRateFunction>
+    void processChunk(const float* in, float* out, size_t frames, LowRateFunction& low_rate) {
+        // 1. 外側の段から順に間引く
+        const float* source = in;
+        size_t count = frames;
+        for (Stage& stage : stages_) {
+            stage.low_count = stage.decimator.process(source, count, stage.low.data());
+            source = stage.low.data();
+            count = stage.low_count;
+        }
+        // 2. 最も低いレートで処理する
+        low_rate(stages_.back().low.data(), stages_.back().low_count);
+        // 3. 内側の段から補間し、各段の入力と同じ数だけ取り出して1つ外側の段に返す
+        for (size_t s = stages_.size(); s-- > 0;) {
+            Stage& stage = stages_[s];
+            const size_t queued = stage.queue.size();
+            stage.queue.resize(queued + 2 * stage.low_count);
+            stage.interpolator.process(stage.low.data(), stage.low_count, stage.queue.data() + queued);
+            float* destination = (s == 0) ? out : stages_[s - 1].low.data();
+            const size_t needed = (s == 0) ? frames : stages_[s - 1].low_count;
+            std::copy(stage.queue.begin(), stage.queue.begin() + static_cast<std::ptrdiff_t>(needed), destination);
+            stage.queue.erase(stage.queue.begin(), stage.queue.begin() + static_cast<std::ptrdiff_t>(needed));
+        }
+    }
+};
@@ -0,0 +1,54 @@
+// ./parameter_ramp.h
+// オートメーションで変化するパラメータを、ブロック内でサンプルごとに直線で動かす
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @class ParameterRamp
+ * @brief 目標値までの直線ランプ
+ *
+ * setTarget() で目標値と到達までのサンプル数を与え、process() の中で fill() を呼んで
+ * サンプルごとの値を得る。ランプ中でなければ fill() を呼ばずに定数の経路で処理できるように
+ * ramping() を用意する。値の累積は double で行い、ランプの終端では目標値に一致させる。
+ */
+class ParameterRamp {
+public:
+    // ランプを止めて value に固定する
+    void reset(double value) {
+        current_ = target_ = value;
+        step_ = 0.0;
+        remaining_ = 0;
+    }
+
+    // target へ samples サンプルかけて移る（0 なら直ちに）
+    void setTarget(double target, size_t samples) {
+        target_ = target;
+        if (samples == 0 || target == current_) {
+            reset(target);
+            return;
+        }
+        step_ = (target - current_) / static_cast<double>(samples);
+        remaining_ = samples;
+    }
+
+    bool ramping() const { return remaining_ > 0; }
+    double current() const { return current_; }
+    double target() const { return target_; }
+
+    // 次の frames サンプル分の値を out に書き、ランプを進める（ランプの後は目標値を保つ）
+    void fill(float* out, size_t frames) {
+        for (size_t i = 0; i < frames; ++i) {
+            if (remaining_ > 0) {
+                current_ = (--remaining_ == 0) ? target_ : current_ + step_;
+            }
+            out[i] = static_cast<float>(current_);
+        }
+    }
+
+private:
+    double current_ = 0.0;
+    double target_ = 0.0;
+    double step_ = 0.0;
+    size_t remaining_ = 0;
+};
@@ -0,0 +1,145 @@
+// ./realtime_scheduling.cpp
+#include "realtime_scheduling.h"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <alloca.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+size_t pageSize() {
+    const long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? static_cast<size_t>(size) : 4096;
+}
+
+std::mutex worker_schedule_mutex;
+ThreadSchedule worker_schedule;                 // setWorkerThreadSchedule() で登録した設定
+std::atomic<bool> worker_schedule_reported{true};
+
+} // namespace
+
+ThreadSchedule ThreadSchedule::fromJson(const json& params) {
+    ThreadSchedule schedule;
+    if (!params.is_object()) return schedule;
+    const std::string policy = params.value("policy", "other");
+    if (policy == "fifo") schedule.policy = Policy::Fifo;
+    else if (policy == "rr") schedule.policy = Policy::RoundRobin;
+    schedule.priority = params.value("priority", 0);
+    if (params.contains("cpus") && params["cpus"].is_array()) {
+        for (const auto& cpu : params["cpus"]) {
+            if (cpu.is_number_integer() && cpu.get<int>() >= 0) schedule.cpus.push_back(cpu.get<int>());
+        }
+    }
+    return schedule;
+}
+
+ThreadSchedule ThreadSchedule::workersFromJson(const json& realtime) {
+    if (!realtime.is_object()) return ThreadSchedule();
+    if (realtime.contains("worker_threads")) return fromJson(realtime["worker_threads"]);
+    ThreadSchedule schedule = fromJson(realtime.value("processing_thread", json::object()));
+    schedule.cpus.clear();
+    return schedule;
+}
+
+void setWorkerThreadSchedule(const ThreadSchedule& schedule) {
+    std::lock_guard<std::mutex> lock(worker_schedule_mutex);
+    worker_schedule = schedule;
+    // 通常のスケジューリングのままなら表示しない
+    worker_schedule_reported = (schedule.policy == ThreadSchedule::Policy::Other && schedule.cpus.empty());
+}
+
+void applyWorkerThreadSchedule() {
+    ThreadSchedule schedule;
+    {
+        std::lock_guard<std::mutex> lock(worker_schedule_mutex);
+        schedule = worker_schedule;
+    }
+    if (schedule.policy == ThreadSchedule::Policy::Other && schedule.cpus.empty()) return;
+    const std::string report = applyThreadSchedule(schedule);
+    if (!worker_schedule_reported.exchange(true)) std::cout << "[INFO] Realtime: worker threads " << report << std::endl;
+}
+
+std::string applyThreadSchedule(const ThreadSchedule& schedule) {
+    std::string report = "SCHED_OTHER";
+    if (schedule.policy != ThreadSchedule::Policy::Other) {
+        const int policy = (schedule.policy == ThreadSchedule::Policy::Fifo) ? SCHED_FIFO : SCHED_RR;
+        const std::string name = (policy == SCHED_FIFO) ? "SCHED_FIFO" : "SCHED_RR";
+        int priority = std::clamp(schedule.priority, sched_get_priority_min(policy), sched_get_priority_max(policy));
+        sched_param param = {};
+        param.sched_priority = priority;
+        int err = pthread_setschedparam(pthread_self(), policy, &param);
+#ifdef RLIMIT_RTPRIO
+        // 非特権のプロセスでも RLIMIT_RTPRIO（/etc/security/limits.conf の rtprio）までは設定できる
+        rlimit limit = {};
+        if (err == EPERM && getrlimit(RLIMIT_RTPRIO, &limit) == 0 && limit.rlim_cur > 0 && static_cast<rlim_t>(priority) > limit.rlim_cur) {
+            priority = static_cast<int>(limit.rlim_cur);
+            param.sched_priority = priority;
+            err = pthread_setschedparam(pthread_self(), policy, &param);
+        }
+#endif
+        if (err == 0) {
+            report = name + " priority " + std::to_string(priority);
+            if (priority != schedule.priority) report += " (requested " + std::to_string(schedule.priority) + ")";
+        } else {
+            report += " (" + name + " " + std::to_string(schedule.priority) + " denied: " + std::strerror(err)
+                    + "; needs CAP_SYS_NICE or an rtprio limit)";
+        }
+    }
+
+    if (!schedule.cpus.empty()) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        std::string list;
+        for (int cpu : schedule.cpus) {
+            if (cpu >= CPU_SETSIZE) continue;
+            CPU_SET(cpu, &set);
+            list += (list.empty() ? "" : ",") + std::to_string(cpu);
+        }
+        const int err = list.empty() ? EINVAL : pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        report += (err == 0) ? ", CPUs {" + list + "}" : std::string(", CPU affinity not set (") + std::strerror(err) + ")";
+#else
+        report += ", CPU affinity not supported on this platform";
+#endif
+    }
+    return report;
+}
+
+std::string lockProcessMemory() {
+#ifdef __GLIBC__
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+#endif
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) return "locked (current and future pages)";
+    const int err = errno;
+    return std::string("not locked (") + std::strerror(err) + "; raise RLIMIT_MEMLOCK (ulimit -l) or grant CAP_IPC_LOCK)";
+}
+
+void prefaultStack(size_t bytes) {
+    if (bytes == 0) return;
+    // スタックは上位アドレスから伸びるため、上から順にページを触る
+    volatile uint8_t* stack = static_cast<volatile uint8_t*>(alloca(bytes));
+    const size_t page = pageSize();
+    for (size_t offset = bytes; offset > page; offset -= page) stack[offset - 1] = 0;
+    stack[0] = 0;
+}
+
+void prefaultBuffer(void* data, size_t bytes) {
+    if (!data || bytes == 0) return;
+    volatile uint8_t* memory = static_cast<volatile uint8_t*>(data);
+    const size_t page = pageSize();
+    for (size_t offset = 0; offset < bytes; offset += page) memory[offset] = memory[offset];
+    memory[bytes - 1] = memory[bytes - 1];
+}
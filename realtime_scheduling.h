@@ -0,0 +1,63 @@
+// ./realtime_scheduling.h
+// 処理スレッドのリアルタイムスケジューリング・CPUアフィニティとメモリのロック
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+/**
+ * @brief スレッドに適用するスケジューリングの設定（params.json の "realtime" の各スレッド）
+ *
+ *   { "policy": "fifo", "priority": 70, "cpus": [2, 3] }
+ *
+ * policy は "fifo"（SCHED_FIFO）・"rr"（SCHED_RR）・"other"（通常のスケジューリング）。
+ * cpus が空ならCPUを固定しない。
+ */
+struct ThreadSchedule {
+    enum class Policy { Other, Fifo, RoundRobin };
+    Policy policy = Policy::Other;
+    int priority = 0;
+    std::vector<int> cpus;
+
+    static ThreadSchedule fromJson(const json& params);
+    // "realtime" の "worker_threads" を読む。省略時は "processing_thread" の policy と priority を引き継ぐ
+    // （補助スレッドを処理スレッドと同じCPUに固定すると並列に動けないため、cpus は引き継がない）
+    static ThreadSchedule workersFromJson(const json& realtime);
+};
+
+/**
+ * @brief 呼び出したスレッドに設定を適用し、実際に適用した内容を1行で返す
+ *
+ * 権限がなく SCHED_FIFO / SCHED_RR に設定できない場合は、RLIMIT_RTPRIO の範囲まで優先度を
+ * 下げて再試行し、それも失敗すれば通常のスケジューリングのまま続ける（理由を返す）。
+ * CPUアフィニティは Linux でのみ設定する。
+ */
+std::string applyThreadSchedule(const ThreadSchedule& schedule);
+
+/**
+ * @brief エフェクトが内部で起動する補助スレッド（コンボルバーのテール計算、エフェクトグラフのワーカー）の設定
+ *
+ * チェーンを構築する前に setWorkerThreadSchedule() で登録しておき、補助スレッドは起動直後に
+ * applyWorkerThreadSchedule() を呼ぶ。適用した結果は登録後の最初の1スレッドだけが表示する。
+ */
+void setWorkerThreadSchedule(const ThreadSchedule& schedule);
+void applyWorkerThreadSchedule();
+
+/**
+ * @brief プロセスの現在と今後のページをメモリにロックする（mlockall）
+ * @return 結果を1行で返す（RLIMIT_MEMLOCK が足りなければロックせずに理由を返す）
+ *
+ * glibc では解放したヒープをOSに返さず、大きな確保も mmap にしないよう設定し、
+ * 再確保のたびに新しいページでフォルトが起きないようにする。
+ */
+std::string lockProcessMemory();
+
+// 呼び出したスレッドのスタックを bytes だけ先に触り、ページを割り当てておく
+void prefaultStack(size_t bytes);
+
+// 確保済みのバッファの全ページに書き込み（内容は変えない）、ページを割り当てておく
+void prefaultBuffer(void* data, size_t bytes);
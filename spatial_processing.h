@@ -2,6 +2,8 @@
 #pragma once
 #include "SimpleBiquad.h"
 #include "AudioEffect.h"
+#include "channel_kernel.h"
+#include "parameter_ramp.h"
 #include <vector>
 #include <cmath>
 #include <array>
@@ -15,34 +17,53 @@ public:
             bass_mono_freq_ = params.value("bass_mono_freq", 120.0);
             enabled_ = params.value("enabled", true);
         }
-        bass_lpf_l_.set_lpf(sr, bass_mono_freq_, 0.707);
-        bass_lpf_r_.set_lpf(sr, bass_mono_freq_, 0.707);
-        bass_hpf_l_.set_hpf(sr, bass_mono_freq_, 0.707);
-        bass_hpf_r_.set_hpf(sr, bass_mono_freq_, 0.707);
+        bass_lpf_.set_lpf(sr, bass_mono_freq_, 0.707);
+        bass_hpf_.set_hpf(sr, bass_mono_freq_, 0.707);
+        for (auto& state : pair_states_) initPair(state);
+        width_ramp_.reset(width_);
     }
     
     void process(std::vector<float>& block, int channels) override {
-        if (!enabled_ || channels != 2) return;
-
-        size_t frame_count = block.size() / 2;
-        for(size_t i = 0; i < frame_count; ++i) {
-            float left = block[i*2];
-            float right = block[i*2 + 1];
-            
-            auto processed = processSample(left, right);
+        if (!enabled_ || channels <= 0) return;
+        if (channels != kernel_.channels()) setChannelLayout(ChannelLayout::defaultFor(channels));
+        kernel_.run(*this, block);
+    }
 
-            block[i*2] = processed.first;
-            block[i*2 + 1] = processed.second;
-        }
+    // 左右の組（L/R, Ls/Rs, Lb/Rb）ごとに処理する。センター・LFE・モノラルは素通し
+    void setChannelLayout(const ChannelLayout& layout) override {
+        pairs_ = layout.stereoPairs();
+        pair_states_.resize(pairs_.size());
+        for (auto& state : pair_states_) initPair(state);
+        // ステレオ（組が (0, 1) の1つだけ）はストライドと位置を定数にした版を使う
+        const bool stereo = layout.channels() == 2 && pairs_.size() == 1 && pairs_[0] == std::make_pair(0, 1);
+        kernel_.select(layout.channels(), &StereoEnhancer::processKernel<0>,
+                       stereo ? &StereoEnhancer::processKernel<2> : &StereoEnhancer::processKernel<0>, &StereoEnhancer::processKernel<0>);
     }
+    void setChannelCount(int channels) override { setChannelLayout(ChannelLayout::defaultFor(channels)); }
 
     void reset() override {
-        bass_lpf_l_.reset();
-        bass_lpf_r_.reset();
-        bass_hpf_l_.reset();
-        bass_hpf_r_.reset();
+        for (auto& state : pair_states_) {
+            state.bass_lpf_l.reset();
+            state.bass_lpf_r.reset();
+            state.bass_hpf_l.reset();
+            state.bass_hpf_r.reset();
+        }
     }
     
+    // "width" はサンプルごとにランプする
+    bool setParameter(const std::string& name, double value, size_t ramp_samples) override {
+        if (!enabled_ || name != "width") return false;
+        width_ = value;
+        width_ramp_.setTarget(value, ramp_samples);
+        return true;
+    }
+
+    bool isFusable() const override { return true; }
+    bool isActive() const override { return enabled_; }
+    size_t getTailSamples() const override {
+        return std::max(bass_lpf_.ring_down_samples(), bass_hpf_.ring_down_samples());
+    }
+    bool serializeState(StateArchive& ar) override { ar(pair_states_); return true; }
     const std::string& getName() const override { return name_; }
 
 private:
@@ -51,18 +72,57 @@ private:
     // ◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️↑修正終わり◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️◾️
     double width_ = 1.2, bass_mono_freq_ = 120.0;
     bool enabled_ = true;
-    SimpleBiquad bass_lpf_l_, bass_lpf_r_, bass_hpf_l_, bass_hpf_r_;
+    ParameterRamp width_ramp_;
+    std::vector<float> width_values_;   // ランプ中のブロックのサンプルごとの幅（全ての組で共有）
+    // 左右の組ごとのフィルタ（bass_lpf_ / bass_hpf_ は係数を持つ原型）
+    struct PairState {
+        SimpleBiquad bass_lpf_l, bass_lpf_r, bass_hpf_l, bass_hpf_r;
+        void serializeState(StateArchive& ar) { ar(bass_lpf_l, bass_lpf_r, bass_hpf_l, bass_hpf_r); }
+    };
+    SimpleBiquad bass_lpf_, bass_hpf_;
+    std::vector<std::pair<int, int>> pairs_;
+    std::vector<PairState> pair_states_;
+    ChannelKernel<StereoEnhancer> kernel_;
+
+    void initPair(PairState& state) const {
+        state.bass_lpf_l = bass_lpf_;
+        state.bass_lpf_r = bass_lpf_;
+        state.bass_hpf_l = bass_hpf_;
+        state.bass_hpf_r = bass_hpf_;
+    }
+
+    template <int Channels>
+    void processKernel(float* block, size_t frames, int channels) {
+        const int ch = kernelChannels<Channels>(channels);
+        const float* width = nullptr;
+        if (width_ramp_.ramping()) {
+            width_values_.resize(frames);
+            width_ramp_.fill(width_values_.data(), frames);
+            width = width_values_.data();
+        }
+        for (size_t p = 0; p < pairs_.size(); ++p) {
+            const int l = (Channels == 2) ? 0 : pairs_[p].first;
+            const int r = (Channels == 2) ? 1 : pairs_[p].second;
+            PairState& state = pair_states_[p];
+            for (size_t i = 0; i < frames; ++i) {
+                float* frame = block + i * ch;
+                auto processed = processSample(state, frame[l], frame[r], width ? static_cast<double>(width[i]) : width_);
+                frame[l] = processed.first;
+                frame[r] = processed.second;
+            }
+        }
+    }
 
-    std::pair<float, float> processSample(float left, float right) {
+    std::pair<float, float> processSample(PairState& state, float left, float right, double width) {
         float mid = (left + right) * 0.5f;
         float side = (left - right) * 0.5f;
-        float bass_l = bass_lpf_l_.process(left);
-        float bass_r = bass_lpf_r_.process(right);
+        float bass_l = state.bass_lpf_l.process(left);
+        float bass_r = state.bass_lpf_r.process(right);
         float bass_mono = (bass_l + bass_r) * 0.5f;
-        float high_l = bass_hpf_l_.process(left);
-        float high_r = bass_hpf_r_.process(right);
+        float high_l = state.bass_hpf_l.process(left);
+        float high_r = state.bass_hpf_r.process(right);
         float high_mid = (high_l + high_r) * 0.5f;
-        float high_side = (high_l - high_r) * 0.5f * width_;
+        float high_side = (high_l - high_r) * 0.5f * width;
         float processed_l = bass_mono + high_mid + high_side;
         float processed_r = bass_mono + high_mid - high_side;
         return {processed_l, processed_r};
@@ -0,0 +1,37 @@
+// ./spectral_frame.h
+// 周波数領域エフェクト間で受け渡すSTFTの設定とフレーム
+#pragma once
+
+#include <complex>
+#include <cstddef>
+
+/**
+ * @brief 周波数領域エフェクトが必要とするSTFTの設定（fft_size == 0 は時間領域のエフェクト）
+ */
+struct StftConfig {
+    size_t fft_size = 0;
+    size_t hop_size = 0;
+
+    bool isSpectral() const { return fft_size > 0; }
+    bool operator==(const StftConfig& other) const { return fft_size == other.fft_size && hop_size == other.hop_size; }
+    bool operator!=(const StftConfig& other) const { return !(*this == other); }
+};
+
+/**
+ * @brief 1ホップ分の周波数領域フレーム（全チャンネル）
+ *
+ * bins は (fft_size / 2 + 1) 個の複素数で、振幅は窓の和で正規化済み
+ * （振幅Aの正弦波はそのビンで |X| ≒ A になる）。
+ */
+struct SpectralFrame {
+    std::complex<float>* const* bins = nullptr;  // チャンネルごとのスペクトル
+    int channels = 0;
+    size_t num_bins = 0;
+    size_t fft_size = 0;
+    size_t hop_size = 0;
+    double sample_rate = 0.0;
+
+    std::complex<float>* channel(int c) const { return bins[c]; }
+    // ビン k の中心周波数 [Hz]
+    double binFrequency(size_t k) const { return sample_rate * static_cast<double>(k) / static_cast<double>(fft_size); }
+};
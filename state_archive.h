@@ -0,0 +1,113 @@
+// ./state_archive.h
+// エフェクトの処理状態（フィルタ・エンベロープ・遅延線など）をバイト列に保存・復元する
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @class StateArchive
+ * @brief 処理状態のスナップショットの書き出し・読み込み
+ *
+ * 同じ関数で保存と復元の両方を書けるよう、io() / operator() は saving() に応じて値を
+ * 書き出すか読み込む。状態を持つクラスは serializeState(StateArchive&) を実装し、
+ * io() はそれを持つ型に対してはそれを呼ぶ（係数を含む SimpleBiquad などもコピー可能な型だが、
+ * 状態だけを扱う）。それ以外のコピー可能な型はバイト列としてそのまま扱う。
+ *
+ * スナップショットはパラメータ（係数など）を含まず、同じパラメータで構築したオブジェクトの
+ * 間でのみ有効。状態の配列の長さはセットアップで決まるため、読み込み時に長さが一致しなければ
+ * アーカイブを失敗（ok() == false）にする。処理中に長さが変わるバッファは buffer() で扱う。
+ */
+class StateArchive;
+
+template <typename T, typename = void>
+struct HasSerializeState : std::false_type {};
+template <typename T>
+struct HasSerializeState<T, std::void_t<decltype(std::declval<T&>().serializeState(std::declval<StateArchive&>()))>> : std::true_type {};
+
+class StateArchive {
+public:
+    // buffer の末尾に書き出すアーカイブ
+    static StateArchive writer(std::vector<uint8_t>& buffer) { return StateArchive(&buffer, nullptr, 0); }
+    // data から読み込むアーカイブ
+    static StateArchive reader(const uint8_t* data, size_t size) { return StateArchive(nullptr, data, size); }
+
+    bool saving() const { return out_ != nullptr; }
+    bool ok() const { return ok_; }
+    void fail() { ok_ = false; }
+
+    template <typename T>
+    void io(T& value) {
+        if constexpr (HasSerializeState<T>::value) {
+            value.serializeState(*this);
+        } else {
+            static_assert(std::is_trivially_copyable_v<T>, "io() needs serializeState() or a trivially copyable type");
+            bytes(&value, sizeof(T));
+        }
+    }
+
+    // 長さが一致しなければ失敗する配列
+    template <typename T>
+    void io(std::vector<T>& values) {
+        uint64_t count = values.size();
+        io(count);
+        if (count != values.size()) {
+            fail();
+            return;
+        }
+        elements(values);
+    }
+
+    // 処理中に長さが変わるバッファ（読み込み時に長さも復元する）
+    template <typename T>
+    void buffer(std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>, "buffer() needs trivially copyable elements");
+        uint64_t count = values.size();
+        io(count);
+        if (!saving()) {
+            if (count > (size_ - pos_) / sizeof(T)) {
+                fail();
+                return;
+            }
+            values.resize(static_cast<size_t>(count));
+        }
+        elements(values);
+    }
+
+    template <typename... T>
+    void operator()(T&... values) { (io(values), ...); }
+
+private:
+    StateArchive(std::vector<uint8_t>* out, const uint8_t* in, size_t size) : out_(out), in_(in), size_(size) {}
+
+    template <typename T>
+    void elements(std::vector<T>& values) {
+        if constexpr (!HasSerializeState<T>::value && std::is_trivially_copyable_v<T>) {
+            if (!values.empty()) bytes(values.data(), values.size() * sizeof(T));
+        } else {
+            for (auto& value : values) io(value);
+        }
+    }
+
+    void bytes(void* data, size_t count) {
+        if (saving()) {
+            const auto* begin = static_cast<const uint8_t*>(data);
+            out_->insert(out_->end(), begin, begin + count);
+        } else if (ok_ && count <= size_ - pos_) {
+            std::memcpy(data, in_ + pos_, count);
+            pos_ += count;
+        } else {
+            ok_ = false;
+        }
+    }
+
+    std::vector<uint8_t>* out_ = nullptr;
+    const uint8_t* in_ = nullptr;
+    size_t size_ = 0;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
@@ -0,0 +1,185 @@
+// ./stft_engine.cpp
+#include "stft_engine.h"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+void StftEngine::configure(size_t fft_size, size_t hop_size, int channels, double sample_rate, size_t expected_block_frames) {
+    if (fft_size < 16 || (fft_size & (fft_size - 1)) != 0) {
+        throw std::runtime_error("StftEngine: fft_size must be a power of two >= 16 (got " + std::to_string(fft_size) + ").");
+    }
+    if (hop_size == 0 || hop_size > fft_size / 2 || fft_size % hop_size != 0) {
+        throw std::runtime_error("StftEngine: hop_size must divide fft_size and be <= fft_size / 2 (got " + std::to_string(hop_size) + ").");
+    }
+    fft_size_ = fft_size;
+    hop_size_ = hop_size;
+    num_bins_ = fft_size / 2 + 1;
+    // チャンネルごとの先頭をFFTWの計画時と同じSIMDアラインメント（64バイト）に揃える
+    bin_stride_ = (num_bins_ + 7) & ~static_cast<size_t>(7);
+    channels_ = channels;
+    sample_rate_ = sample_rate;
+
+    // 周期的Hann窓の平方根（分析・合成の積がHann窓になる）
+    std::vector<float> sqrt_hann(fft_size_);
+    double window_sum = 0.0;
+    for (size_t i = 0; i < fft_size_; ++i) {
+        double hann = 0.5 - 0.5 * std::cos(2.0 * M_PI * static_cast<double>(i) / static_cast<double>(fft_size_));
+        sqrt_hann[i] = static_cast<float>(std::sqrt(hann));
+        window_sum += sqrt_hann[i];
+    }
+    // 重ね合わせたHann窓の和（COLA定数）はホップ位置によらず一定なので1点で求める
+    double cola = 0.0;
+    for (size_t i = 0; i < fft_size_; i += hop_size_) cola += static_cast<double>(sqrt_hann[i]) * sqrt_hann[i];
+    cola = std::max(cola, 1e-12);
+
+    analysis_window_.resize(fft_size_);
+    synthesis_window_.resize(fft_size_);
+    const double amplitude_norm = 2.0 / window_sum;
+    const double synthesis_norm = 1.0 / (amplitude_norm * cola * static_cast<double>(fft_size_));
+    for (size_t i = 0; i < fft_size_; ++i) {
+        analysis_window_[i] = static_cast<float>(sqrt_hann[i] * amplitude_norm);
+        synthesis_window_[i] = static_cast<float>(sqrt_hann[i] * synthesis_norm);
+    }
+
+    time_buffer_.assign(fft_size_, 0.0f);
+    frame_pool_.clear();
+    frames_.clear();
+    // ceil(expected_block_frames / hop) 個あれば想定した長さのブロックを1回で処理できる
+    ensurePoolSize(std::max<size_t>(1, (expected_block_frames + hop_size_ - 1) / hop_size_));
+
+    fwd_plan_ = FFTPlanRegistry::getInstance().getForward(fft_size_);
+    bwd_plan_ = FFTPlanRegistry::getInstance().getInverse(fft_size_);
+
+    reset();
+}
+
+bool StftEngine::sanitizeConfig(size_t& fft_size, size_t& hop_size) {
+    const bool valid = fft_size >= 16 && fft_size <= kMaxFftSize && (fft_size & (fft_size - 1)) == 0 &&
+                       hop_size > 0 && hop_size <= fft_size / 2 && fft_size % hop_size == 0;
+    if (valid) return true;
+    const size_t clamped = std::clamp<size_t>(fft_size, 16, kMaxFftSize);
+    size_t power = 16;
+    while (power * 2 <= clamped) power *= 2;
+    // 2つの2の冪のうち近い方（等距離なら大きい方）
+    fft_size = (clamped - power >= power * 2 - clamped && power < kMaxFftSize) ? power * 2 : power;
+    // 範囲外のホップ長は既定の fft_size/4、範囲内なら fft_size を割り切る2の冪に切り下げる
+    const size_t limit = (hop_size == 0 || hop_size > fft_size / 2) ? fft_size / 4 : hop_size;
+    hop_size = 1;
+    while (hop_size * 2 <= limit) hop_size *= 2;
+    return false;
+}
+
+void StftEngine::ensurePoolSize(size_t count) {
+    if (frame_pool_.size() >= count) return;
+    frame_pool_.resize(count);
+    frames_.resize(count);
+    for (size_t f = 0; f < count; ++f) {
+        PooledFrame& pooled = frame_pool_[f];
+        if (pooled.data.size() != static_cast<size_t>(channels_) * bin_stride_) {
+            pooled.data.assign(static_cast<size_t>(channels_) * bin_stride_, {0.0f, 0.0f});
+        }
+        pooled.channel_ptrs.resize(channels_);
+        for (int c = 0; c < channels_; ++c) pooled.channel_ptrs[c] = pooled.data.data() + static_cast<size_t>(c) * bin_stride_;
+
+        SpectralFrame& frame = frames_[f];
+        frame.bins = pooled.channel_ptrs.data();
+        frame.channels = channels_;
+        frame.num_bins = num_bins_;
+        frame.fft_size = fft_size_;
+        frame.hop_size = hop_size_;
+        frame.sample_rate = sample_rate_;
+    }
+}
+
+void StftEngine::reset() {
+    input_fifo_.assign(static_cast<size_t>(channels_) * fft_size_, 0.0f);
+    output_accum_.assign(static_cast<size_t>(channels_) * fft_size_, 0.0f);
+    output_fifo_.assign(static_cast<size_t>(channels_) * hop_size_, 0.0f);
+    fill_pos_ = fft_size_ - hop_size_;
+}
+
+void StftEngine::process(std::vector<float>& block, int channels, const FrameCallback& callback) {
+    if (channels != channels_ || fft_size_ == 0 || frame_pool_.empty()) return;
+    // プールに収まるホップ数ずつに分けて処理する（ホップ数は ceil(フレーム数 / hop) 以下）。
+    // configure() で想定した長さまでのブロックは1回で済み、処理中にプールを拡張しない
+    const size_t num_frames = block.size() / static_cast<size_t>(channels);
+    const size_t span = frame_pool_.size() * hop_size_;
+    for (size_t start = 0; start < num_frames; start += span) {
+        processSpan(block.data() + start * static_cast<size_t>(channels), std::min(span, num_frames - start), callback);
+    }
+}
+
+void StftEngine::processSpan(float* samples, size_t num_frames, const FrameCallback& callback) {
+    const size_t channels = static_cast<size_t>(channels_);
+    const size_t latency_offset = fft_size_ - hop_size_;
+    const size_t start_fill = fill_pos_;
+
+    // ホップのスケジュール: このブロックで揃うフレーム数
+    const size_t num_hops = (start_fill + num_frames - latency_offset) / hop_size_;
+
+    // 1. 入力をFIFOに積み、ホップが揃うたびにプールへ分析する
+    size_t done = 0;
+    size_t hop_index = 0;
+    while (done < num_frames) {
+        const size_t run = std::min(num_frames - done, fft_size_ - fill_pos_);
+        for (size_t c = 0; c < channels; ++c) {
+            float* in_fifo = input_fifo_.data() + c * fft_size_ + fill_pos_;
+            const float* sample = samples + done * channels + c;
+            for (size_t i = 0; i < run; ++i, sample += channels) in_fifo[i] = *sample;
+        }
+        fill_pos_ += run;
+        done += run;
+        if (fill_pos_ == fft_size_) {
+            analyze(hop_index++);
+            fill_pos_ = latency_offset;
+        }
+    }
+
+    // 2. 周波数領域の処理（このブロックのフレームをまとめて渡す）
+    if (num_hops > 0 && callback) callback(frames_.data(), num_hops);
+
+    // 3. 出力FIFOから書き戻し、ホップ境界ごとに次のフレームを再合成する
+    size_t fill = start_fill;
+    done = 0;
+    hop_index = 0;
+    while (done < num_frames) {
+        const size_t run = std::min(num_frames - done, fft_size_ - fill);
+        const size_t out_pos = fill - latency_offset;
+        for (size_t c = 0; c < channels; ++c) {
+            const float* out_fifo = output_fifo_.data() + c * hop_size_ + out_pos;
+            float* sample = samples + done * channels + c;
+            for (size_t i = 0; i < run; ++i, sample += channels) *sample = out_fifo[i];
+        }
+        fill += run;
+        done += run;
+        if (fill == fft_size_) {
+            synthesize(hop_index++);
+            fill = latency_offset;
+        }
+    }
+}
+
+void StftEngine::analyze(size_t frame_index) {
+    SpectralFrame& frame = frames_[frame_index];
+    for (int c = 0; c < channels_; ++c) {
+        float* in_fifo = input_fifo_.data() + static_cast<size_t>(c) * fft_size_;
+        for (size_t i = 0; i < fft_size_; ++i) time_buffer_[i] = in_fifo[i] * analysis_window_[i];
+        fftwf_execute_dft_r2c(fwd_plan_, time_buffer_.data(), reinterpret_cast<fftwf_complex*>(frame.channel(c)));
+        std::copy(in_fifo + hop_size_, in_fifo + fft_size_, in_fifo);
+    }
+}
+
+void StftEngine::synthesize(size_t frame_index) {
+    SpectralFrame& frame = frames_[frame_index];
+    for (int c = 0; c < channels_; ++c) {
+        fftwf_execute_dft_c2r(bwd_plan_, reinterpret_cast<fftwf_complex*>(frame.channel(c)), time_buffer_.data());
+        float* accum = output_accum_.data() + static_cast<size_t>(c) * fft_size_;
+        for (size_t i = 0; i < fft_size_; ++i) accum[i] += time_buffer_[i] * synthesis_window_[i];
+
+        float* out_fifo = output_fifo_.data() + static_cast<size_t>(c) * hop_size_;
+        std::copy(accum, accum + hop_size_, out_fifo);
+        std::copy(accum + hop_size_, accum + fft_size_, accum);
+        std::fill(accum + fft_size_ - hop_size_, accum + fft_size_, 0.0f);
+    }
+}
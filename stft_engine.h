@@ -0,0 +1,96 @@
+// ./stft_engine.h
+// ストリーミングSTFT（分析・合成）エンジン
+#pragma once
+
+#include "fft_plan_registry.h"
+#include "spectral_frame.h"
+#include "state_archive.h"
+#include <vector>
+#include <complex>
+#include <functional>
+#include <cstddef>
+#include <fftw3.h>
+
+/**
+ * @class StftEngine
+ * @brief インターリーブされたブロックをホップ単位でSTFTし、フレームを処理して再合成する
+ *
+ * 分析・合成ともに sqrt-Hann 窓を使い、重ね合わせの和が一定（COLA）になるよう正規化する。
+ * 1ブロック内で揃ったホップはすべて先に分析してフレームプールに並べ、コールバックを
+ * 1回だけ呼んでから順に再合成する（複数のエフェクトがフレーム列をまとめて処理できる）。
+ * バッファはすべて configure() で確保する。想定より長いブロックはプールに収まる長さに分けて
+ * 処理し（コールバックは分けた回数だけ呼ばれる）、処理中には確保しない。
+ * 遅延は fft_size サンプル。
+ */
+class StftEngine {
+public:
+    // frames[0 .. count) は時間順。フレームの内容をインプレースで書き換える
+    using FrameCallback = std::function<void(SpectralFrame* frames, size_t count)>;
+
+    /**
+     * @brief FFT長・ホップ長・チャンネル数を設定してバッファとプランを準備する
+     * @param expected_block_frames 想定する最大ブロック長（フレームプールの事前確保に使う。チェーンでは
+     *                              リサンプル後の最大ブロック長を渡す）
+     * @throws std::runtime_error fft_size が2の冪でない、またはホップ長が fft_size/2 を超える場合
+     */
+    void configure(size_t fft_size, size_t hop_size, int channels, double sample_rate, size_t expected_block_frames = 4096);
+
+    /**
+     * @brief FFT長・ホップ長を configure() が受け付ける値に丸める（params.json の値の検証用）
+     * @return 元の値のまま使える場合は true。そうでなければ最も近い有効な値に書き換えて false
+     *
+     * FFT長は 16〜kMaxFftSize の最も近い2の冪、ホップ長は範囲外なら fft_size/4、
+     * 範囲内なら fft_size を割り切る2の冪に切り下げる。
+     */
+    static bool sanitizeConfig(size_t& fft_size, size_t& hop_size);
+    static constexpr size_t kMaxFftSize = 65536;
+
+    /**
+     * @brief ブロックをインプレースで処理する
+     */
+    void process(std::vector<float>& block, int channels, const FrameCallback& callback);
+
+    void reset();
+    // 入出力のFIFOとオーバーラップ加算の状態（フレームのプールは含めない）
+    void serializeState(StateArchive& ar) { ar(input_fifo_, output_accum_, output_fifo_, fill_pos_); }
+
+    StftConfig getConfig() const { return {fft_size_, hop_size_}; }
+    size_t getNumBins() const { return num_bins_; }
+    int getChannels() const { return channels_; }
+    size_t getLatencySamples() const { return fft_size_; }
+
+private:
+    // プール内の1フレーム分のスペクトル（channels * bin_stride_）
+    struct PooledFrame {
+        FFTWVector<std::complex<float>> data;
+        std::vector<std::complex<float>*> channel_ptrs;
+    };
+
+    size_t fft_size_ = 0;
+    size_t hop_size_ = 0;
+    size_t num_bins_ = 0;
+    size_t bin_stride_ = 0;                // プール内のチャンネル間隔（アラインメントのため num_bins_ 以上）
+    int channels_ = 0;
+    double sample_rate_ = 0.0;
+
+    std::vector<float> analysis_window_;   // sqrt-Hann × 振幅正規化
+    std::vector<float> synthesis_window_;  // sqrt-Hann × COLA正規化 × 逆FFTの正規化
+
+    // チャンネルごとのストリーミング状態（channel * fft_size などで連続配置）
+    std::vector<float> input_fifo_;        // 直近 fft_size サンプル
+    std::vector<float> output_accum_;      // オーバーラップ加算のアキュムレータ
+    std::vector<float> output_fifo_;       // 次のホップで出力するサンプル
+    size_t fill_pos_ = 0;                  // input_fifo_ 内の書き込み位置（fft_size - hop .. fft_size）
+
+    std::vector<PooledFrame> frame_pool_;
+    std::vector<SpectralFrame> frames_;    // プールを指すフレーム記述子（コールバックに渡す）
+
+    FFTWVector<float> time_buffer_;
+    fftwf_plan fwd_plan_ = nullptr;
+    fftwf_plan bwd_plan_ = nullptr;
+
+    void ensurePoolSize(size_t count);
+    void processSpan(float* samples, size_t num_frames, const FrameCallback& callback);
+    void analyze(size_t frame_index);
+    void synthesize(size_t frame_index);
+};
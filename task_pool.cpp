@@ -0,0 +1,126 @@
+// ./task_pool.cpp
+#include "task_pool.h"
+#include "realtime_scheduling.h"
+#include <algorithm>
+
+void WorkStealingPool::start(size_t workers, size_t capacity) {
+    stop();
+    workers = std::max<size_t>(workers, 1);
+    queues_.clear();
+    for (size_t w = 0; w < workers; ++w) {
+        queues_.push_back(std::make_unique<Queue>());
+        queues_.back()->tasks.resize(capacity);
+    }
+    stopping_ = false;
+    for (size_t w = 1; w < workers; ++w) {
+        threads_.emplace_back(&WorkStealingPool::workerLoop, this, w);
+    }
+}
+
+void WorkStealingPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) thread.join();
+    }
+    threads_.clear();
+}
+
+void WorkStealingPool::push(size_t worker, size_t task) {
+    Queue& queue = *queues_[worker];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks[queue.tail++] = task;
+    }
+    pushes_.fetch_add(1);
+    wakeParked();
+}
+
+void WorkStealingPool::wakeParked() {
+    // pushes_ / remaining_ の更新と parked_ の読み出しはどちらも seq_cst なので、眠ろうとしている
+    // ワーカーは更新を見るか、ここで parked_ > 0 を見られて起こされるかのどちらかになる
+    if (parked_.load() == 0) return;
+    { std::lock_guard<std::mutex> lock(park_mutex_); }
+    park_cv_.notify_all();
+}
+
+bool WorkStealingPool::pop(size_t worker, size_t& task) {
+    Queue& queue = *queues_[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tail == queue.head) return false;
+    task = queue.tasks[--queue.tail];
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t thief, size_t& task) {
+    const size_t count = queues_.size();
+    for (size_t i = 1; i < count; ++i) {
+        Queue& queue = *queues_[(thief + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tail == queue.head) continue;
+        task = queue.tasks[queue.head++];
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::drain(size_t worker) {
+    int idle = 0;
+    while (remaining_.load(std::memory_order_acquire) > 0) {
+        // 探す前の push() の回数。探した後に積まれたタスクがあれば眠らない
+        const uint64_t seen = pushes_.load();
+        size_t task = 0;
+        if (pop(worker, task) || steal(worker, task)) {
+            client_->execute(task, worker);
+            if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) wakeParked();
+            idle = 0;
+        } else if (++idle < kSpinCount) {
+            std::this_thread::yield();
+        } else {
+            // 前段を実行中の他のワーカーが後続を積むまで眠る
+            parked_.fetch_add(1);
+            {
+                std::unique_lock<std::mutex> lock(park_mutex_);
+                park_cv_.wait(lock, [&] { return pushes_.load() != seen || remaining_.load() == 0; });
+            }
+            parked_.fetch_sub(1);
+            idle = 0;
+        }
+    }
+}
+
+void WorkStealingPool::workerLoop(size_t worker) {
+    applyWorkerThreadSchedule();
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+            if (stopping_) return;
+            seen = generation_;
+        }
+        drain(worker);
+    }
+}
+
+void WorkStealingPool::run(Client& client, const std::vector<size_t>& roots, size_t total) {
+    if (total == 0 || queues_.empty()) return;
+    for (auto& queue : queues_) {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->head = queue->tail = 0;
+    }
+    client_ = &client;
+    remaining_.store(total, std::memory_order_release);
+    for (size_t task : roots) push(0, task);
+    if (!threads_.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++generation_;
+        }
+        cv_.notify_all();
+    }
+    drain(0);
+}
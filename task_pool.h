@@ -0,0 +1,81 @@
+// ./task_pool.h
+// ブロックごとの依存タスク（エフェクトグラフのノード）を複数スレッドで実行するワークスティーリング・プール
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief ワーカーごとのタスクキューを持ち、空いたワーカーが他のキューから盗んで実行するスレッドプール
+ *
+ * run() の呼び出しスレッドもワーカー0として実行に参加する。タスクは整数のIDで、実行は
+ * Client::execute() に任せる。execute() の中で後続タスクが実行可能になったら push() で自分の
+ * キューに積む（自分のキューは後ろから取り出すので、依存の連鎖は同じワーカーで続けて実行され、
+ * 並列な枝だけが他のワーカーに盗まれる）。
+ * キューは start() で確保した固定長の配列で、run() の中でメモリ確保は行わない。
+ * 実行できるタスクがないワーカーは kSpinCount 回だけ yield しながら探し、それでもなければ
+ * 新しいタスクが積まれるか run() が終わるまで条件変数で眠る（空きのコアを回し続けない）。
+ */
+class WorkStealingPool {
+public:
+    class Client {
+    public:
+        virtual ~Client() = default;
+        virtual void execute(size_t task, size_t worker) = 0;
+    };
+
+    ~WorkStealingPool() { stop(); }
+
+    /**
+     * @brief ワーカースレッドを起動する
+     * @param workers 呼び出しスレッドを含むワーカー数（1 ならスレッドを作らず run() の中で逐次実行する）
+     * @param capacity 1回の run() で実行するタスク数の上限
+     */
+    void start(size_t workers, size_t capacity);
+    void stop();
+    size_t numWorkers() const { return queues_.size(); }
+
+    // worker のキューにタスクを積む（execute() の中から呼ぶ）
+    void push(size_t worker, size_t task);
+
+    // roots から実行を始め、total 個のタスクがすべて終わるまで戻らない
+    void run(Client& client, const std::vector<size_t>& roots, size_t total);
+
+private:
+    // 1回の run() で各タスクは1度だけ積まれるため、先頭・末尾は run() ごとに0へ戻せば折り返さない
+    struct Queue {
+        std::mutex mutex;
+        std::vector<size_t> tasks;
+        size_t head = 0;    // 盗む側（古いタスク）
+        size_t tail = 0;    // 持ち主が積んで取り出す側
+    };
+
+    static constexpr int kSpinCount = 64;
+
+    bool pop(size_t worker, size_t& task);
+    bool steal(size_t thief, size_t& task);
+    void drain(size_t worker);
+    // タスクが積まれた、または run() のタスクがすべて終わったことを眠っているワーカーに知らせる
+    void wakeParked();
+    void workerLoop(size_t worker);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    uint64_t generation_ = 0;           // run() ごとに増やし、待機中のワーカーを起こす
+    bool stopping_ = false;
+    Client* client_ = nullptr;
+    std::atomic<size_t> remaining_{0};  // 今回の run() で未完了のタスク数
+    // タスクを待って眠っているワーカー（push() は parked_ が0なら通知を省く）
+    std::mutex park_mutex_;
+    std::condition_variable park_cv_;
+    std::atomic<size_t> parked_{0};
+    std::atomic<uint64_t> pushes_{0};   // push() の回数（眠る前後で比べて通知の取りこぼしを防ぐ）
+};
@@ -0,0 +1,101 @@
+// ./vocal_instrument_separator.cpp
+// MSVocalInstrumentSeparator のスペクトルマスクモード
+#include "vocal_instrument_separator.h"
+#include "fast_math.h"
+
+namespace {
+constexpr float kMaskEpsilon = 1e-20f;  // 無音ビンでの0除算防止
+}
+
+void MSVocalInstrumentSeparator::setupSpectral(double sr) {
+    // StftEngine::configure() は無効な値で例外を投げるため、ここで有効な値に丸める
+    const size_t requested_fft = fft_size_, requested_hop = hop_size_;
+    if (!StftEngine::sanitizeConfig(fft_size_, hop_size_)) {
+        std::cerr << "[WARN] MSVocalInstrumentSeparator: fft_size " << requested_fft << " / hop_size " << requested_hop
+                  << " is invalid (fft_size must be a power of two >= 16, hop_size must divide it and be <= fft_size / 2). Using "
+                  << fft_size_ << " / " << hop_size_ << "." << std::endl;
+    }
+    const double frames = sr / static_cast<double>(hop_size_) * mask_smoothing_ms_ / 1000.0;
+    spectrum_smoothing_ = (frames > 0) ? static_cast<float>(std::exp(-1.0 / frames)) : 0.0f;
+    num_bins_ = 0;
+}
+
+void MSVocalInstrumentSeparator::prepareSpectralState(size_t num_bins) {
+    num_bins_ = num_bins;
+    const size_t padded = (num_bins + 3) & ~static_cast<size_t>(3);
+    power_left_.assign(padded, 0.0f);
+    power_right_.assign(padded, 0.0f);
+    cross_real_.assign(padded, 0.0f);
+    mid_gain_.assign(padded, 1.0f);
+    side_gain_.assign(padded, 1.0f);
+
+    // 対象帯域の重み: 2次HPF(mask_low_freq) × 2次LPF(mask_high_freq) の振幅特性
+    band_weight_.assign(padded, 0.0f);
+    const double fft_size = static_cast<double>((num_bins - 1) * 2);
+    for (size_t k = 1; k < num_bins; ++k) {
+        double f = sample_rate_ * static_cast<double>(k) / fft_size;
+        double low = mask_low_freq_ / f;
+        double high = f / mask_high_freq_;
+        band_weight_[k] = static_cast<float>(1.0 / std::sqrt((1.0 + low * low * low * low) * (1.0 + high * high * high * high)));
+    }
+}
+
+void MSVocalInstrumentSeparator::processSpectrum(SpectralFrame* frames, size_t count) {
+    if (!enabled_ || !spectral_) return;
+    for (size_t f = 0; f < count; ++f) processSpectralFrame(frames[f]);
+}
+
+void MSVocalInstrumentSeparator::processSpectralFrame(SpectralFrame& frame) {
+    // 状態は setChannelLayout() で fft_size に合わせて確保済み（異なるFFT長のフレームは処理しない）
+    if (front_.first < 0 || front_.second >= frame.channels || frame.num_bins != num_bins_) return;
+    const size_t num_bins = frame.num_bins;
+    std::complex<float>* left = frame.channel(front_.first);
+    std::complex<float>* right = frame.channel(front_.second);
+    const float a = spectrum_smoothing_;
+    const float b = 1.0f - a;
+
+    // 1. L/Rのパワーと相互スペクトルの実部（同相成分）を時間方向に平滑化
+    float* pl = power_left_.data();
+    float* pr = power_right_.data();
+    float* cr = cross_real_.data();
+    for (size_t k = 0; k < num_bins; ++k) {
+        const float lr = left[k].real(), li = left[k].imag();
+        const float rr = right[k].real(), ri = right[k].imag();
+        pl[k] = a * pl[k] + b * (lr * lr + li * li);
+        pr[k] = a * pr[k] + b * (rr * rr + ri * ri);
+        cr[k] = a * cr[k] + b * (lr * rr + li * ri);
+    }
+
+    // 2. ボーカルマスクとMid/Sideゲイン（4ビンずつSIMD。配列は4の倍数に0埋め済み）
+    //    同相コヒーレンス max(Re{L·R*},0)² / (|L|²|R|²) と中央定位度 1 - ((|L|²-|R|²)/(|L|²+|R|²))² の積は
+    //    (2·max(Re{L·R*},0) / (|L|²+|R|²))² に等しいため、平方根なしで1回の除算で求まる。
+    //    中央に定位し、L/Rで同相・相関の高いビンほど1に近づく。ゲインの式はbroadbandモードと同じで、
+    //    ボーカル優勢度の代わりにビンごとのマスクを使う。
+    using namespace fast_math;
+    const v4sf zero = broadcast(0.0f);
+    const v4sf one = broadcast(1.0f);
+    const v4sf eps = broadcast(kMaskEpsilon);
+    const v4sf vocal_enhance = broadcast(static_cast<float>(vocal_enhance_));
+    const v4sf instrument_enhance = broadcast(static_cast<float>(instrument_enhance_));
+    const v4sf width = broadcast(static_cast<float>(stereo_width_));
+    const v4sf side_cut = broadcast(static_cast<float>(vocal_enhance_ * 0.3));
+    const float* weight = band_weight_.data();
+    float* mid_gain = mid_gain_.data();
+    float* side_gain = side_gain_.data();
+    for (size_t k = 0; k < num_bins; k += 4) {
+        v4sf similarity = 2.0f * vmax(load4(cr + k), zero) / (load4(pl + k) + load4(pr + k) + eps);
+        v4sf mask = vmin(similarity * similarity, one) * load4(weight + k);
+        store4(mid_gain + k, one + vocal_enhance * mask);
+        store4(side_gain + k, (one + instrument_enhance * (one - mask)) * width * (one - side_cut * mask));
+    }
+
+    // 3. M/Sに分解してゲインを掛け、L/Rへ戻す（L' = gm·M + gs·S, R' = gm·M - gs·S）
+    for (size_t k = 0; k < num_bins; ++k) {
+        const std::complex<float> mid = (left[k] + right[k]) * 0.5f;
+        const std::complex<float> side = (left[k] - right[k]) * 0.5f;
+        const std::complex<float> m = mid * mid_gain[k];
+        const std::complex<float> s = side * side_gain[k];
+        left[k] = m + s;
+        right[k] = m - s;
+    }
+}
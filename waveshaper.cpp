@@ -0,0 +1,110 @@
+// ./waveshaper.cpp
+#include "waveshaper.h"
+#include "fast_math.h"
+#include <functional>
+
+namespace waveshaper {
+namespace {
+
+constexpr float kLn2 = 0.693147181f;
+
+// ln(cosh(u)) = |u| + ln(1 + e^{-2|u|}) - ln2 をオーバーフローせずに計算する（tanh の逆導関数）。
+// 小さい |u| では ln2 との差が桁落ちするため、u^2/2 - u^4/12 + u^6/45 の級数を使う
+inline float fastLogCosh(float u) {
+    const float a = std::fabs(u);
+    if (a < 0.0625f) {
+        const float u2 = u * u;
+        return u2 * (0.5f + u2 * (-1.0f / 12.0f + u2 * (1.0f / 45.0f)));
+    }
+    const float e = fast_math::fast_exp2(-2.0f * fast_math::kLog2E * a);
+    return a + kLn2 * (fast_math::fast_log2(1.0f + e) - 1.0f);
+}
+
+// チューブ: f(x) = sign(x) * (|x| - x^2 / (1 + k|x|))、k = 2 * drive
+struct TubeCurve {
+    double k;
+    double value(double x) const {
+        double a = std::fabs(x);
+        return std::copysign(a - a * a / (1.0 + k * a), x);
+    }
+    // f は奇関数なので F は偶関数。∫ a^2/(1+ka) da = (ka^2/2 - ka + ln(1+ka)) / k^3 は ka が小さいと
+    // 桁落ちするため、ka < 0.25 では a^3 * Σ (-ka)^n / (n+3) の級数（打ち切り誤差 < 3e-7）に切り替える
+    float antiderivative(float x) const {
+        const float kf = static_cast<float>(k);
+        const float a = std::fabs(x);
+        const float ka = kf * a;
+        float rational_integral;
+        if (ka < 0.25f) {
+            const float series = 1.0f / 3.0f + ka * (-1.0f / 4.0f + ka * (1.0f / 5.0f + ka * (-1.0f / 6.0f + ka * (1.0f / 7.0f
+                               + ka * (-1.0f / 8.0f + ka * (1.0f / 9.0f + ka * (-1.0f / 10.0f + ka * (1.0f / 11.0f))))))));
+            rational_integral = a * a * a * series;
+        } else {
+            rational_integral = (0.5f * ka * ka - ka + kLn2 * fast_math::fast_log2(1.0f + ka)) / (kf * kf * kf);
+        }
+        return 0.5f * a * a - rational_integral;
+    }
+};
+
+// テープ: f(x) = tanh(drive * x)
+struct TapeCurve {
+    double drive;
+    double value(double x) const { return std::tanh(drive * x); }
+    float antiderivative(float x) const {
+        const float d = static_cast<float>(drive);
+        return fastLogCosh(d * x) / d;
+    }
+};
+
+// トランス: f(x) = tanh(drive * x) + 0.8 * tanh(1.5 * drive * x)
+struct TransformerCurve {
+    double drive;
+    static constexpr double kSecondGain = 0.8;
+    static constexpr double kSecondScale = 1.5;
+    double value(double x) const {
+        double u = drive * x;
+        return std::tanh(u) + kSecondGain * std::tanh(kSecondScale * u);
+    }
+    float antiderivative(float x) const {
+        const float d = static_cast<float>(drive);
+        const float u = d * x;
+        constexpr float kSecond = static_cast<float>(kSecondGain / kSecondScale);
+        return (fastLogCosh(u) + kSecond * fastLogCosh(static_cast<float>(kSecondScale) * u)) / d;
+    }
+};
+
+struct CurveEntry {
+    const char* name;
+    std::function<std::unique_ptr<Shaper>(double drive)> create;
+};
+
+template <class Curve>
+std::unique_ptr<Shaper> makeShaper(const Curve& curve) {
+    return std::make_unique<AdaaShaper<Curve>>(curve);
+}
+
+// カーブ表（新しいカーブはここに追加する）
+const std::vector<CurveEntry>& curveTable() {
+    static const std::vector<CurveEntry> table = {
+        {"tube",        [](double drive) { return makeShaper(TubeCurve{2.0 * drive}); }},
+        {"tape",        [](double drive) { return makeShaper(TapeCurve{drive}); }},
+        {"transformer", [](double drive) { return makeShaper(TransformerCurve{drive}); }},
+    };
+    return table;
+}
+
+} // namespace
+
+std::unique_ptr<Shaper> createShaper(const std::string& type, double drive) {
+    for (const auto& entry : curveTable()) {
+        if (type == entry.name) return entry.create(drive);
+    }
+    return nullptr;
+}
+
+std::vector<std::string> availableCurves() {
+    std::vector<std::string> names;
+    for (const auto& entry : curveTable()) names.push_back(entry.name);
+    return names;
+}
+
+} // namespace waveshaper
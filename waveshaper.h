@@ -0,0 +1,87 @@
+// ./waveshaper.h
+// 1次ADAA（逆導関数によるアンチエイリアシング）を用いたウェーブシェイパー
+//
+// 非線形関数 f をそのままサンプルに適用すると、生成された倍音がナイキスト周波数で折り返す。
+// ADAAでは f の逆導関数 F を使い、隣接サンプル間の平均値
+//     y[n] = (F(x[n]) - F(x[n-1])) / (x[n] - x[n-1])
+// を出力することで、折り返し成分を大きく減らす（半サンプルの遅延が生じる）。
+//
+// 新しいカーブを追加するには、value() と antiderivative() を持つ構造体を waveshaper.cpp に定義し、
+// カーブ表に1行追加するだけでよい（ブロックループは processAdaaBlock の1つだけ）。
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace waveshaper {
+
+// チャンネルごとのADAA状態（直前の入力とその逆導関数値）
+struct AdaaState {
+    float prev_x = 0.0f;
+    float prev_F = 0.0f;
+    bool primed = false;
+};
+
+// 入力差がこれより小さい場合は差分商が桁落ちするため、中点での f の値で代用する。
+// 逆導関数はfloatで計算するので、丸め誤差（|F| * 2^-24 程度）を dx で割った誤差と、
+// 中点で代用する誤差（f'' * dx^2 / 24）が釣り合うあたりに置く
+constexpr float kAdaaEpsilon = 4e-3f;
+
+/**
+ * @brief 1次ADAAでカーブをブロックに適用する
+ * @tparam Curve float antiderivative(float)（高速近似）と double value(double)（桁落ちする場合の厳密な値）を持つ型
+ */
+template <class Curve>
+void processAdaaBlock(const Curve& curve, AdaaState& state, const float* in, float* out, size_t count) {
+    float prev_x = state.prev_x;
+    float prev_F = state.primed ? state.prev_F : curve.antiderivative(prev_x);
+    for (size_t i = 0; i < count; ++i) {
+        const float x = in[i];
+        const float F = curve.antiderivative(x);
+        const float dx = x - prev_x;
+        out[i] = (std::fabs(dx) < kAdaaEpsilon) ? static_cast<float>(curve.value(0.5 * (static_cast<double>(x) + prev_x)))
+                                                 : (F - prev_F) / dx;
+        prev_x = x;
+        prev_F = F;
+    }
+    state.prev_x = prev_x;
+    state.prev_F = prev_F;
+    state.primed = true;
+}
+
+/**
+ * @class Shaper
+ * @brief セットアップ時に選ばれたカーブでブロックを処理するインターフェース
+ *
+ * 仮想呼び出しはブロックごとに1回だけで、サンプルループはカーブ型ごとにテンプレートで展開される。
+ */
+class Shaper {
+public:
+    virtual ~Shaper() = default;
+    virtual void process(AdaaState& state, const float* in, float* out, size_t count) const = 0;
+};
+
+template <class Curve>
+class AdaaShaper : public Shaper {
+public:
+    explicit AdaaShaper(const Curve& curve) : curve_(curve) {}
+    void process(AdaaState& state, const float* in, float* out, size_t count) const override {
+        processAdaaBlock(curve_, state, in, out, count);
+    }
+private:
+    Curve curve_;
+};
+
+/**
+ * @brief カーブ名とドライブ量からシェイパーを作成する
+ * @return 未知のカーブ名の場合は nullptr
+ */
+std::unique_ptr<Shaper> createShaper(const std::string& type, double drive);
+
+// 登録済みのカーブ名の一覧（警告メッセージ用）
+std::vector<std::string> availableCurves();
+
+} // namespace waveshaper